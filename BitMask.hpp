@@ -1,27 +1,18 @@
 #pragma once
-#include "chunk_mesh.h"
+#include "padded_chunk.h"
 
 #include <cassert>
 #include <cstdint>
 #include <enklume/block_data.h>
 
-struct n_idx { int x, y, z; };
-
-inline bool isOccluded(const ChunkData* chunk, ChunkNeighbors& neighbors, const int x, const int y, const int z) {
-    const std::array<n_idx, 6> n_idxs{{
-        {x, y+ 1, z},
-        {x, y- 1, z},
-        {x + 1, y, z},
-        {x - 1, y, z},
-        {x, y, z + 1},
-        {x, y, z - 1}
-    }};
-
-    for (const auto &[x, y, z] : n_idxs) {
-        if (access_safe(chunk, neighbors, x, y, z) == BlockAir) return false;
-    }
-
-    return true;
+/// bit per FaceDirection for the sides of the block at x, y, z that border air, 0 when it is hidden
+inline uint8_t exposedFaces(const PaddedChunk& chunk, const int x, const int y, const int z) {
+    return (chunk.get(x - 1, y, z) == BlockAir) << FaceMinusX |
+           (chunk.get(x + 1, y, z) == BlockAir) << FacePlusX |
+           (chunk.get(x, y, z - 1) == BlockAir) << FaceMinusZ |
+           (chunk.get(x, y, z + 1) == BlockAir) << FacePlusZ |
+           (chunk.get(x, y - 1, z) == BlockAir) << FaceMinusY |
+           (chunk.get(x, y + 1, z) == BlockAir) << FacePlusY;
 }
 
 // returns position of first non-zero from LSB to MSB
@@ -47,14 +38,6 @@ public:
     static_assert(CUNK_CHUNK_SIZE == 16, "BitMask relies on uint16_t, so chunk size must also be 16.");
 
     BitMask() = default;
-    BitMask(const ChunkData* chunk, ChunkNeighbors& neighbors, const int y, const BlockId t) : type(t) {
-        for (int x = 0; x < CUNK_CHUNK_SIZE; x++) {
-            for (int z = 0; z < CUNK_CHUNK_SIZE; z++) {
-                if (!isOccluded(chunk, neighbors, x, y, z) && access_safe(chunk, neighbors, x, y, z) == t)
-                    setBit(x, z);
-            }
-        }
-    }
 
     bool isSet(const int x, const int z) const { return mask[x] & (1u << z); }
 
@@ -63,4 +46,30 @@ public:
         assert(!isSet(x, z));
         mask[x] |= (1u << z);
     }
-};
\ No newline at end of file
+};
+
+/**
+ * The exposed blocks of one y slice as a BitMask per block type, built in a single pass over the slice:
+ * `exposed` (from PaddedChunk::exposed_faces()) already says which blocks border air, so only those get their type looked up.
+ * Only the types that occur are listed in `types`, in the order they were first seen.
+ */
+struct SliceBitMasks {
+    BitMask masks[BlockCount];
+    BlockId types[BlockCount];
+    int num_types = 0;
+
+    SliceBitMasks() = default;
+    SliceBitMasks(const PaddedChunk& chunk, const int y, const uint16_t exposed[CUNK_CHUNK_SIZE]) {
+        for (int x = 0; x < CUNK_CHUNK_SIZE; x++) {
+            for (uint16_t bits = exposed[x]; bits != 0; bits &= bits - 1) {
+                const int z = trailingZeros(bits);
+                const BlockId t = chunk.get(x, y, z);
+                if (masks[t].type == BlockAir) {
+                    masks[t].type = t;
+                    types[num_types++] = t;
+                }
+                masks[t].setBit(x, z);
+            }
+        }
+    }
+};
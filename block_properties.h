@@ -0,0 +1,39 @@
+#ifndef SIGCRAFT_BLOCK_PROPERTIES_H
+#define SIGCRAFT_BLOCK_PROPERTIES_H
+
+#include <array>
+#include <cstdint>
+
+extern "C" {
+#include "enklume/block_data.h"
+}
+
+/// what the renderers need to know about one BlockId
+struct BlockProperties {
+    float color[3];
+    /// the slot of the block texture array the block's textures are in: its side, top and bottom textures are
+    /// layers texture_index * TEXTURES_PER_BLOCK + 0, 1 and 2. Blocks without textures of their own get BlockUnknown's.
+    uint32_t texture_index;
+    /// whether the block hides what is behind it
+    bool opaque;
+    /// whether things collide with the block
+    bool solid;
+};
+
+/**
+ * The BlockProperties of every BlockId, so looking a block up is indexing an array.
+ * Colors, opacity and solidity come from BLOCK_TYPES, the texture indices are filled in by TextureManager once it
+ * has loaded the textures. It's a few hundred bytes, so it gets passed around by value.
+ */
+struct BlockTable {
+    std::array<BlockProperties, BlockCount> blocks = {{
+#define B(name, r, g, b, opaque, solid) { { r, g, b }, 0, opaque, solid },
+        BLOCK_TYPES(B)
+#undef B
+    }};
+
+    const BlockProperties& operator[](BlockData id) const { return blocks[id]; }
+    BlockProperties& operator[](BlockData id) { return blocks[id]; }
+};
+
+#endif
@@ -0,0 +1,152 @@
+#include "brick_map.h"
+
+#include "host_buffer.h"
+#include "imr/util.h"
+
+#include <climits>
+#include <cstring>
+
+bool pack_brick(const ChunkSection& section, Brick& brick) {
+    bool occupied = false;
+    for (int y = 0; y < CUNK_CHUNK_SIZE; y++) {
+        for (int z = 0; z < CUNK_CHUNK_SIZE; z++) {
+            for (int x = 0; x < CUNK_CHUNK_SIZE; x++) {
+                const BlockData block = section.block_data[y][z][x];
+                brick.blocks[y][z][x] = static_cast<uint8_t>(block);
+                occupied |= block != BlockAir;
+            }
+        }
+    }
+    return occupied;
+}
+
+/// no chunk has these coordinates, so an empty column never matches the chunk raymarch.frag looks for
+static constexpr int32_t NO_CHUNK = INT32_MIN;
+
+BrickMap::BrickMap(imr::Device& device, const int radius, const size_t capacity)
+    : grid_size(2 * radius + 1), capacity(capacity), device(device) {
+    constexpr VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+
+    Column empty = { NO_CHUNK, NO_CHUNK, {} };
+    std::fill(std::begin(empty.bricks), std::end(empty.bricks), -1);
+    columns.assign(grid_size * grid_size, empty);
+    column_hashes.assign(columns.size(), 0);
+    dirty.assign(columns.size(), false);
+    grid = std::make_unique<imr::Buffer>(device, columns.size() * sizeof(Column), usage);
+    grid->uploadDataSync(0, columns.size() * sizeof(Column), columns.data());
+
+    bricks = std::make_unique<imr::Buffer>(device, capacity * sizeof(Brick), usage);
+    // handed out from the back, lowest first
+    for (size_t brick = capacity; brick > 0; brick--)
+        free_bricks.push_back(static_cast<int32_t>(brick - 1));
+}
+
+size_t BrickMap::column_index(const int cx, const int cz) const {
+    const int gx = (cx % grid_size + grid_size) % grid_size;
+    const int gz = (cz % grid_size + grid_size) % grid_size;
+    return gx * grid_size + gz;
+}
+
+bool BrickMap::has_chunk(const int cx, const int cz, const uint64_t content_hash) const {
+    const size_t index = column_index(cx, cz);
+    return columns[index].chunk_x == cx && columns[index].chunk_z == cz && column_hashes[index] == content_hash;
+}
+
+void BrickMap::upload(const Column& column) {
+    const size_t index = &column - columns.data();
+    if (!dirty[index])
+        dirty_columns.push_back(index);
+    dirty[index] = true;
+}
+
+void BrickMap::record_uploads(VkCommandBuffer cmdbuf, imr::Swapchain::Frame& frame) {
+    if (dirty_columns.empty() && brick_copies.empty())
+        return;
+    auto barrier = [&](VkPipelineStageFlags2 src_stages, VkAccessFlags2 src_access, VkPipelineStageFlags2 dst_stages, VkAccessFlags2 dst_access) {
+        device.dispatch.cmdPipelineBarrier2KHR(cmdbuf, tmpPtr((VkDependencyInfo) {
+            .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+            .dependencyFlags = 0,
+            .memoryBarrierCount = 1,
+            .pMemoryBarriers = tmpPtr((VkMemoryBarrier2) {
+                .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+                .srcStageMask = src_stages,
+                .srcAccessMask = src_access,
+                .dstStageMask = dst_stages,
+                .dstAccessMask = dst_access,
+            })
+        }));
+    };
+    // the frames before this one may still be marching through the old columns
+    barrier(VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, 0, VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT);
+    if (!brick_copies.empty()) {
+        auto staging = std::make_shared<HostBuffer>(device, staged_bricks.size() * sizeof(Brick), VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+        memcpy(staging->data, staged_bricks.data(), staged_bricks.size() * sizeof(Brick));
+        vkCmdCopyBuffer(cmdbuf, staging->buffer, bricks->handle, brick_copies.size(), brick_copies.data());
+        frame.addCleanupAction([staging] {});
+        staged_bricks.clear();
+        brick_copies.clear();
+    }
+    for (const size_t index : dirty_columns) {
+        vkCmdUpdateBuffer(cmdbuf, grid->handle, index * sizeof(Column), sizeof(Column), &columns[index]);
+        dirty[index] = false;
+    }
+    dirty_columns.clear();
+    barrier(VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT);
+}
+
+void BrickMap::clear(Column& column, imr::Swapchain::Frame& frame) {
+    std::vector<int32_t> freed;
+    for (int32_t& brick : column.bricks) {
+        if (brick >= 0)
+            freed.push_back(brick);
+        brick = -1;
+    }
+    column.chunk_x = column.chunk_z = NO_CHUNK;
+    column_hashes[&column - columns.data()] = 0;
+    upload(column);
+    if (!freed.empty()) {
+        frame.addCleanupAction([this, freed = std::move(freed)] {
+            free_bricks.insert(free_bricks.end(), freed.begin(), freed.end());
+        });
+    }
+}
+
+bool BrickMap::set_chunk(const Chunk& chunk, imr::Swapchain::Frame& frame) {
+    Brick packed[CUNK_CHUNK_SECTIONS_COUNT];
+    bool occupied[CUNK_CHUNK_SECTIONS_COUNT] = {};
+    size_t needed = 0;
+    for (int section = 0; section < CUNK_CHUNK_SECTIONS_COUNT; section++) {
+        if (const ChunkSection* s = chunk.data.sections[section])
+            needed += occupied[section] = pack_brick(*s, packed[section]);
+    }
+    if (needed > free_bricks.size())
+        return false;
+
+    Column& c = columns[column_index(chunk.cx, chunk.cz)];
+    if (c.chunk_x != NO_CHUNK)
+        clear(c, frame);
+    for (int section = 0; section < CUNK_CHUNK_SECTIONS_COUNT; section++) {
+        if (!occupied[section])
+            continue;
+        const int32_t brick = free_bricks.back();
+        free_bricks.pop_back();
+        brick_copies.push_back({ .srcOffset = staged_bricks.size() * sizeof(Brick), .dstOffset = brick * sizeof(Brick), .size = sizeof(Brick) });
+        staged_bricks.push_back(packed[section]);
+        c.bricks[section] = brick;
+    }
+    c.chunk_x = chunk.cx;
+    c.chunk_z = chunk.cz;
+    column_hashes[&c - columns.data()] = chunk.content_hash;
+    upload(c);
+    return true;
+}
+
+void BrickMap::drop_outside(const int cx, const int cz, const int radius, imr::Swapchain::Frame& frame) {
+    for (Column& c : columns) {
+        if (c.chunk_x == NO_CHUNK)
+            continue;
+        const int dx = c.chunk_x - cx, dz = c.chunk_z - cz;
+        if (dx * dx + dz * dz > radius * radius)
+            clear(c, frame);
+    }
+}
@@ -0,0 +1,90 @@
+#ifndef SIGCRAFT_BRICK_MAP_H
+#define SIGCRAFT_BRICK_MAP_H
+
+#include "world.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "imr/imr.h"
+
+extern "C" {
+#include "enklume/block_data.h"
+}
+
+/// the block ids of a section as bytes, indexed [y][z][x] like ChunkSection::block_data. Air is 0, so they double
+/// as the section's occupancy.
+struct Brick {
+    uint8_t blocks[CUNK_CHUNK_SIZE][CUNK_CHUNK_SIZE][CUNK_CHUNK_SIZE];
+};
+
+static_assert(BlockCount <= 256, "bricks store block ids in a byte");
+
+/// false if `section` is all air, which needs no brick
+bool pack_brick(const ChunkSection& section, Brick& brick);
+
+/**
+ * The blocks around the player for raymarch.frag, in two levels: bricks of the sections that aren't air, in one pool,
+ * and a coarse grid with a column per chunk that has the brick of each of its sections, or -1 where it is air.
+ * Columns are indexed by chunk coordinates modulo the grid size, so the grid never moves with the player: a chunk
+ * takes over its column from whatever chunk was there before. A brick is only handed out again once the frames that
+ * may still read it have retired, but columns change while frames in flight read them. So set_chunk() only stages the
+ * bricks and columns on the host, and record_uploads() writes all of them with the commands of a frame, after the
+ * frames before it are done reading them: the bricks in one copy from a host-visible staging buffer, the columns with
+ * vkCmdUpdateBuffer.
+ */
+struct BrickMap {
+    /// raymarch.frag's Column
+    struct Column {
+        int32_t chunk_x, chunk_z;
+        int32_t bricks[CUNK_CHUNK_SECTIONS_COUNT];
+    };
+
+    static_assert(sizeof(Column) == 104);
+
+    /// columns per axis, so no two chunks within `radius` of the player ever share one
+    const int grid_size;
+    const size_t capacity;
+    std::unique_ptr<imr::Buffer> grid;
+    std::unique_ptr<imr::Buffer> bricks;
+
+    /// `capacity` bricks for a grid covering `radius` chunks around the player
+    BrickMap(imr::Device& device, int radius, size_t capacity);
+
+    /// whether the column of chunk `cx`, `cz` has its bricks, built from `content_hash`
+    bool has_chunk(int cx, int cz, uint64_t content_hash) const;
+    /// uploads the bricks of `chunk` into its column, or returns false if the pool is out of bricks for them.
+    /// The bricks of the chunk that had the column before get freed once `frame` has retired.
+    bool set_chunk(const Chunk& chunk, imr::Swapchain::Frame& frame);
+    /// empties the columns of chunks outside the circle of `radius` chunks around cx, cz
+    void drop_outside(int cx, int cz, int radius, imr::Swapchain::Frame& frame);
+    /// records the writes of the bricks and columns changed since the last call into `cmdbuf`, outside of a render
+    /// pass, followed by a barrier for the fragment shaders reading them. The staged bricks are freed once `frame`
+    /// has retired.
+    void record_uploads(VkCommandBuffer cmdbuf, imr::Swapchain::Frame& frame);
+
+    size_t used_bricks() const { return capacity - free_bricks.size(); }
+
+private:
+    imr::Device& device;
+    /// host copies of the columns, plus the content hash of the chunk each was built from
+    std::vector<Column> columns;
+    std::vector<uint64_t> column_hashes;
+    std::vector<int32_t> free_bricks;
+    /// the indices of the columns record_uploads() has to write, each once
+    std::vector<size_t> dirty_columns;
+    std::vector<bool> dirty;
+    /// the bricks record_uploads() has to copy into the pool, and where each of them goes
+    std::vector<Brick> staged_bricks;
+    std::vector<VkBufferCopy> brick_copies;
+
+    size_t column_index(int cx, int cz) const;
+    /// frees the bricks of `column` once `frame` has retired, and uploads it empty
+    void clear(Column& column, imr::Swapchain::Frame& frame);
+    /// has record_uploads() write `column`
+    void upload(const Column& column);
+};
+
+#endif
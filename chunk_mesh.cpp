@@ -1,56 +1,49 @@
 #include "chunk_mesh.h"
-#include "nasl/nasl.h"
+#include "padded_chunk.h"
+#include "mesh_cache.h"
+#include "BitMask.hpp"
 
+#include <algorithm>
 #include <assert.h>
+#include <cstring>
 #include <vector>
 
+// every face is a quad of 4 corners, drawn as the triangles (0, 1, 2) and (0, 2, 3), see QuadIndexBuffer
 #define MINUS_X_FACE(V) \
-V(-1, -1, -1,   0, 0, -1, 0, 0) \
-V(-1,  1, -1,   0, 1, -1, 0, 0) \
-V(-1,  1,  1,   1, 1, -1, 0, 0) \
-V(-1, -1, -1,   0, 0, -1, 0, 0) \
-V(-1,  1,  1,   1, 1, -1, 0, 0) \
-V(-1, -1,  1,   1, 0, -1, 0, 0)
+V(-1, -1, -1) \
+V(-1,  1, -1) \
+V(-1,  1,  1) \
+V(-1, -1,  1)
 
 #define PLUS_X_FACE(V) \
-V(1,   1, -1,   1, 1, 1, 0, 0) \
-V(1,  -1, -1,   1, 0, 1, 0, 0) \
-V(1,   1,  1,   0, 1, 1, 0, 0) \
-V(1,   1,  1,   0, 1, 1, 0, 0) \
-V(1,  -1, -1,   1, 0, 1, 0, 0) \
-V(1,  -1,  1,   0, 0, 1, 0, 0)
+V( 1, -1, -1) \
+V( 1, -1,  1) \
+V( 1,  1,  1) \
+V( 1,  1, -1)
 
 #define MINUS_Z_FACE(V) \
-V(1,   1, -1,   0, 1, 0, 0, -1) \
-V(-1, -1, -1,   1, 0, 0, 0, -1) \
-V(1,  -1, -1,   0, 0, 0, 0, -1) \
-V(-1,  1, -1,   1, 1, 0, 0, -1) \
-V(-1, -1, -1,   1, 0, 0, 0, -1) \
-V(1,   1, -1,   0, 1, 0, 0, -1)
+V(-1, -1, -1) \
+V( 1, -1, -1) \
+V( 1,  1, -1) \
+V(-1,  1, -1)
 
 #define PLUS_Z_FACE(V) \
-V(1,  -1,  1,   1, 0, 0, 0, 1) \
-V(-1, -1,  1,   0, 0, 0, 0, 1) \
-V(1,   1,  1,   1, 1, 0, 0, 1) \
-V(1,   1,  1,   1, 1, 0, 0, 1) \
-V(-1, -1,  1,   0, 0, 0, 0, 1) \
-V(-1,  1,  1,   0, 1, 0, 0, 1)
+V(-1, -1,  1) \
+V(-1,  1,  1) \
+V( 1,  1,  1) \
+V( 1, -1,  1)
 
 #define MINUS_Y_FACE(V) \
-V(-1, -1, -1,   0, 0, 0, -1, 0) \
-V(1,  -1,  1,   1, 1, 0, -1, 0) \
-V(1,  -1, -1,   1, 0, 0, -1, 0) \
-V(1,  -1,  1,   1, 1, 0, -1, 0) \
-V(-1, -1, -1,   0, 0, 0, -1, 0) \
-V(-1, -1,  1,   0, 1, 0, -1, 0)
+V(-1, -1, -1) \
+V(-1, -1,  1) \
+V( 1, -1,  1) \
+V( 1, -1, -1)
 
 #define PLUS_Y_FACE(V) \
-V(1,   1,  1,   1, 0, 0, 1, 0) \
-V(-1,  1, -1,   0, 1, 0, 1, 0) \
-V(1,   1, -1,   1, 1, 0, 1, 0) \
-V(-1,  1,  1,   0, 0, 0, 1, 0) \
-V(-1,  1, -1,   0, 1, 0, 1, 0) \
-V(1,   1,  1,   1, 0, 0, 1, 0)
+V(-1,  1, -1) \
+V( 1,  1, -1) \
+V( 1,  1,  1) \
+V(-1,  1,  1)
 
 #define CUBE(V) \
 MINUS_X_FACE(V) \
@@ -60,90 +53,137 @@ PLUS_Z_FACE(V)  \
 MINUS_Y_FACE(V) \
 PLUS_Y_FACE(V)\
 
-//#define V(cx, cy, cz, t, s, nx, ny, nz) tmp[0] = (int) ((cx + 1) / 2) + (float) x; tmp[1] = (int) ((cy + 1) / 2) + (float) y; tmp[2] = (int) ((cz + 1) / 2) + (float) z; tmp[3] = t; tmp[4] = s; g.push_back(tmp[0]); g.push_back(tmp[1]); g.push_back(tmp[2]); g.push_back(tmp[3]); g.push_back(tmp[4]);
-#define V(cx, cy, cz, t, s, nx, ny, nz) \
-v.vx = ((cx + 1) / 2) + x;             \
-v.vy = ((cy + 1) / 2) + y;             \
-v.vz = ((cz + 1) / 2) + z;             \
-v.tt = t * 255;             \
-v.ss = t * 255;             \
-v.nnx = nx * 127 + 128;            \
-v.nny = ny * 127 + 128;            \
-v.nnz = nz * 127 + 128;            \
-v.br = color.x * 255;            \
-v.bg = color.y * 255;            \
-v.bb = color.z * 255;            \
-add_vertex();
-
-static void paste_minus_x_face(std::vector<uint8_t>& g, nasl::vec3 color, unsigned x, unsigned y, unsigned z) {
-    ChunkMesh::Vertex v;
-    auto add_vertex = [&](){
-        uint8_t tmp[sizeof(v)];
-        memcpy(tmp, &v, sizeof(v));
-        for (auto b : tmp)
-            g.push_back(b);
+#define V(cx, cy, cz) \
+add_vertex(((cx + 1) / 2) * sx + x, ((cy + 1) / 2) * sy + y, ((cz + 1) / 2) * sz + z);
+
+static void paste_minus_x_face(uint8_t*& out, BlockData block_data, unsigned x, unsigned y, unsigned z, unsigned sx = 1, unsigned sy = 1, unsigned sz = 1) {
+    auto add_vertex = [&](unsigned vx, unsigned vy, unsigned vz) {
+        const auto v = ChunkMesh::Vertex::pack(vx, vy, vz, FaceMinusX, block_data);
+        memcpy(out, &v, sizeof(v));
+        out += sizeof(v);
     };
     MINUS_X_FACE(V)
 }
 
-static void paste_plus_x_face(std::vector<uint8_t>& g, nasl::vec3 color, unsigned x, unsigned y, unsigned z) {
-    ChunkMesh::Vertex v;
-    auto add_vertex = [&](){
-        uint8_t tmp[sizeof(v)];
-        memcpy(tmp, &v, sizeof(v));
-        for (auto b : tmp)
-            g.push_back(b);
+static void paste_plus_x_face(uint8_t*& out, BlockData block_data, unsigned x, unsigned y, unsigned z, unsigned sx = 1, unsigned sy = 1, unsigned sz = 1) {
+    auto add_vertex = [&](unsigned vx, unsigned vy, unsigned vz) {
+        const auto v = ChunkMesh::Vertex::pack(vx, vy, vz, FacePlusX, block_data);
+        memcpy(out, &v, sizeof(v));
+        out += sizeof(v);
     };
     PLUS_X_FACE(V)
 }
 
-static void paste_minus_y_face(std::vector<uint8_t>& g, nasl::vec3 color, unsigned x, unsigned y, unsigned z) {
-    ChunkMesh::Vertex v;
-    auto add_vertex = [&](){
-        uint8_t tmp[sizeof(v)];
-        memcpy(tmp, &v, sizeof(v));
-        for (auto b : tmp)
-            g.push_back(b);
+static void paste_minus_y_face(uint8_t*& out, BlockData block_data, unsigned x, unsigned y, unsigned z, unsigned sx = 1, unsigned sy = 1, unsigned sz = 1) {
+    auto add_vertex = [&](unsigned vx, unsigned vy, unsigned vz) {
+        const auto v = ChunkMesh::Vertex::pack(vx, vy, vz, FaceMinusY, block_data);
+        memcpy(out, &v, sizeof(v));
+        out += sizeof(v);
     };
     MINUS_Y_FACE(V)
 }
 
-static void paste_plus_y_face(std::vector<uint8_t>& g, nasl::vec3 color, unsigned x, unsigned y, unsigned z) {
-    ChunkMesh::Vertex v;
-    auto add_vertex = [&](){
-        uint8_t tmp[sizeof(v)];
-        memcpy(tmp, &v, sizeof(v));
-        for (auto b : tmp)
-            g.push_back(b);
+static void paste_plus_y_face(uint8_t*& out, BlockData block_data, unsigned x, unsigned y, unsigned z, unsigned sx = 1, unsigned sy = 1, unsigned sz = 1) {
+    auto add_vertex = [&](unsigned vx, unsigned vy, unsigned vz) {
+        const auto v = ChunkMesh::Vertex::pack(vx, vy, vz, FacePlusY, block_data);
+        memcpy(out, &v, sizeof(v));
+        out += sizeof(v);
     };
     PLUS_Y_FACE(V)
 }
 
-static void paste_minus_z_face(std::vector<uint8_t>& g, nasl::vec3 color, unsigned x, unsigned y, unsigned z) {
-    ChunkMesh::Vertex v;
-    auto add_vertex = [&](){
-        uint8_t tmp[sizeof(v)];
-        memcpy(tmp, &v, sizeof(v));
-        for (auto b : tmp)
-            g.push_back(b);
+static void paste_minus_z_face(uint8_t*& out, BlockData block_data, unsigned x, unsigned y, unsigned z, unsigned sx = 1, unsigned sy = 1, unsigned sz = 1) {
+    auto add_vertex = [&](unsigned vx, unsigned vy, unsigned vz) {
+        const auto v = ChunkMesh::Vertex::pack(vx, vy, vz, FaceMinusZ, block_data);
+        memcpy(out, &v, sizeof(v));
+        out += sizeof(v);
     };
     MINUS_Z_FACE(V)
 }
 
-static void paste_plus_z_face(std::vector<uint8_t>& g, nasl::vec3 color, unsigned x, unsigned y, unsigned z) {
-    float tmp[5];
-    ChunkMesh::Vertex v;
-    auto add_vertex = [&](){
-        uint8_t tmp[sizeof(v)];
-        memcpy(tmp, &v, sizeof(v));
-        for (auto b : tmp)
-            g.push_back(b);
+static void paste_plus_z_face(uint8_t*& out, BlockData block_data, unsigned x, unsigned y, unsigned z, unsigned sx = 1, unsigned sy = 1, unsigned sz = 1) {
+    auto add_vertex = [&](unsigned vx, unsigned vy, unsigned vz) {
+        const auto v = ChunkMesh::Vertex::pack(vx, vy, vz, FacePlusZ, block_data);
+        memcpy(out, &v, sizeof(v));
+        out += sizeof(v);
     };
     PLUS_Z_FACE(V)
 }
 
 #undef V
 
+/// pastes one quad covering sx * sy * sz blocks from x, y, z on; the size along the face normal must be 1
+static void paste_face(MeshFormat format, FaceDirection direction, uint8_t*& out, BlockData block_data, unsigned x, unsigned y, unsigned z, unsigned sx = 1, unsigned sy = 1, unsigned sz = 1) {
+    if (format == MeshFaces) {
+        // the sizes along the two axes in the plane of the face, in x, y, z order
+        const unsigned size_a = direction == FaceMinusX || direction == FacePlusX ? sy : sx;
+        const unsigned size_b = direction == FaceMinusZ || direction == FacePlusZ ? sy : sz;
+        const auto f = ChunkMesh::Face::pack(x, y, z, direction, size_a, size_b, block_data);
+        memcpy(out, &f, sizeof(f));
+        out += sizeof(f);
+        return;
+    }
+    switch (direction) {
+        case FaceMinusX: paste_minus_x_face(out, block_data, x, y, z, sx, sy, sz); break;
+        case FacePlusX:  paste_plus_x_face(out, block_data, x, y, z, sx, sy, sz);  break;
+        case FaceMinusZ: paste_minus_z_face(out, block_data, x, y, z, sx, sy, sz); break;
+        case FacePlusZ:  paste_plus_z_face(out, block_data, x, y, z, sx, sy, sz);  break;
+        case FaceMinusY: paste_minus_y_face(out, block_data, x, y, z, sx, sy, sz); break;
+        default:         paste_plus_y_face(out, block_data, x, y, z, sx, sy, sz);  break;
+    }
+}
+
+/**
+ * The exposed faces of one 16x16 layer of blocks facing the same way, as one bitmask per block type:
+ * rows[type][a] has bit b set when the block at (a, b) in the layer shows a face there.
+ * Only the types that actually occur are cleared and merged.
+ */
+struct FaceLayer {
+    uint16_t rows[BlockCount][CUNK_CHUNK_SIZE];
+    bool present[BlockCount] = {};
+    BlockId types[BlockCount];
+    int num_types = 0;
+
+    void clear() {
+        for (int i = 0; i < num_types; i++)
+            present[types[i]] = false;
+        num_types = 0;
+    }
+
+    void add(BlockData block_data, int a, int b) {
+        if (!present[block_data]) {
+            present[block_data] = true;
+            types[num_types++] = static_cast<BlockId>(block_data);
+            memset(rows[block_data], 0, sizeof(rows[block_data]));
+        }
+        rows[block_data][a] |= 1u << b;
+    }
+
+    /// merges the faces of each type into rectangles, the same way greedyMeshSlice() does,
+    /// and calls emit(type, a, b, a_length, b_length) for each of them
+    template<typename F>
+    void merge(F emit) {
+        for (int i = 0; i < num_types; i++) {
+            uint16_t* mask = rows[types[i]];
+            for (int a = 0; a < CUNK_CHUNK_SIZE; a++) {
+                while (mask[a] != 0) {
+                    const int b_start = trailingZeros(mask[a]);
+                    const int b_length = trailingOnes(mask[a] >> b_start);
+                    const uint16_t pattern = ((1u << b_length) - 1) << b_start;
+
+                    int a_end = a + 1;
+                    while (a_end < CUNK_CHUNK_SIZE && (mask[a_end] & pattern) == pattern) {
+                        mask[a_end] &= ~pattern;
+                        a_end++;
+                    }
+                    mask[a] &= ~pattern;
+                    emit(types[i], a, b_start, a_end - a, b_length);
+                }
+            }
+        }
+    }
+};
+
 BlockData access_safe(const ChunkData* chunk, ChunkNeighbors& neighbours, int x, int y, int z) {
     unsigned int i, k;
     if (x < 0) {
@@ -175,62 +215,441 @@ BlockData access_safe(const ChunkData* chunk, ChunkNeighbors& neighbours, int x,
     return BlockAir;
 }
 
-void chunk_mesh(const ChunkData* chunk, ChunkNeighbors& neighbours, std::vector<uint8_t>& g, size_t* num_verts) {
+void chunk_mesh_section(const PaddedChunk& chunk, int section, uint8_t* out, size_t* num_verts, MeshFormat format) {
     *num_verts = 0;
-    for (int section = 0; section < CUNK_CHUNK_SECTIONS_COUNT; section++) {
-        for (int x = 0; x < CUNK_CHUNK_SIZE; x++)
-            for (int y = 0; y < CUNK_CHUNK_SIZE; y++)
-                for (int z = 0; z < CUNK_CHUNK_SIZE; z++) {
-                    int world_y = y + section * CUNK_CHUNK_SIZE;
-                    BlockData block_data = access_safe(chunk, neighbours, x, world_y, z);
-                    if (block_data != BlockAir) {
-                        nasl::vec3 color;
-                        color.x = block_colors[block_data].r;
-                        color.y = block_colors[block_data].g;
-                        color.z = block_colors[block_data].b;
-                        if (access_safe(chunk, neighbours, x, world_y + 1, z) == BlockAir) {
-                            paste_plus_y_face(g, color, x, world_y, z);
-                            *num_verts += 6;
-                        }
-                        if (access_safe(chunk, neighbours, x, world_y - 1, z) == BlockAir) {
-                            paste_minus_y_face(g, color, x, world_y, z);
-                            *num_verts += 6;
-                        }
-
-                        if (access_safe(chunk, neighbours, x + 1, world_y, z) == BlockAir) {
-                            paste_plus_x_face(g, color, x, world_y, z);
-                            *num_verts += 6;
-                        }
-                        if (access_safe(chunk, neighbours, x - 1, world_y, z) == BlockAir) {
-                            paste_minus_x_face(g, color, x, world_y, z);
-                            *num_verts += 6;
-                        }
-
-                        if (access_safe(chunk, neighbours, x, world_y, z + 1) == BlockAir) {
-                            paste_plus_z_face(g, color, x, world_y, z);
-                            *num_verts += 6;
-                        }
-                        if (access_safe(chunk, neighbours, x, world_y, z - 1) == BlockAir) {
-                            paste_minus_z_face(g, color, x, world_y, z);
-                            *num_verts += 6;
-                        }
+    if (chunk.empty_section[section])
+        return;
+    for (int x = 0; x < CUNK_CHUNK_SIZE; x++)
+        for (int y = 0; y < CUNK_CHUNK_SIZE; y++)
+            for (int z = 0; z < CUNK_CHUNK_SIZE; z++) {
+                int world_y = y + section * CUNK_CHUNK_SIZE;
+                BlockData block_data = chunk.get(x, world_y, z);
+                if (block_data != BlockAir) {
+                    if (chunk.get(x, world_y + 1, z) == BlockAir) {
+                        paste_face(format, FacePlusY, out, block_data, x, world_y, z);
+                        *num_verts += 4;
+                    }
+                    if (chunk.get(x, world_y - 1, z) == BlockAir) {
+                        paste_face(format, FaceMinusY, out, block_data, x, world_y, z);
+                        *num_verts += 4;
                     }
+
+                    if (chunk.get(x + 1, world_y, z) == BlockAir) {
+                        paste_face(format, FacePlusX, out, block_data, x, world_y, z);
+                        *num_verts += 4;
+                    }
+                    if (chunk.get(x - 1, world_y, z) == BlockAir) {
+                        paste_face(format, FaceMinusX, out, block_data, x, world_y, z);
+                        *num_verts += 4;
+                    }
+
+                    if (chunk.get(x, world_y, z + 1) == BlockAir) {
+                        paste_face(format, FacePlusZ, out, block_data, x, world_y, z);
+                        *num_verts += 4;
+                    }
+                    if (chunk.get(x, world_y, z - 1) == BlockAir) {
+                        paste_face(format, FaceMinusZ, out, block_data, x, world_y, z);
+                        *num_verts += 4;
+                    }
+                }
+            }
+}
+
+void greedy_chunk_mesh_section(const PaddedChunk& chunk, int section, uint8_t* out, size_t* num_verts, MeshFormat format) {
+    *num_verts = 0;
+    if (chunk.empty_section[section])
+        return;
+    FaceLayer layer;
+    const int base_y = section * CUNK_CHUNK_SIZE;
+
+    // horizontal faces: one layer per y, a = x and b = z
+    for (int y = base_y; y < base_y + CUNK_CHUNK_SIZE; y++) {
+        for (FaceDirection direction : { FaceMinusY, FacePlusY }) {
+            const int dy = direction == FacePlusY ? 1 : -1;
+            layer.clear();
+            for (int x = 0; x < CUNK_CHUNK_SIZE; x++)
+                for (int z = 0; z < CUNK_CHUNK_SIZE; z++) {
+                    BlockData block_data = chunk.get(x, y, z);
+                    if (block_data != BlockAir && chunk.get(x, y + dy, z) == BlockAir)
+                        layer.add(block_data, x, z);
+                }
+            layer.merge([&](BlockId type, int a, int b, int a_length, int b_length) {
+                paste_face(format, direction, out, type, a, y, b, a_length, 1, b_length);
+                *num_verts += 4;
+            });
+        }
+    }
+
+    // vertical faces: one layer per x (or z), a = y within the section and b = z (or x)
+    for (int side = 0; side < SideCount; side++) {
+        const auto direction = static_cast<FaceDirection>(side);
+        const bool along_x = side_dx[side] != 0;
+        for (int i = 0; i < CUNK_CHUNK_SIZE; i++) {
+            layer.clear();
+            for (int y = 0; y < CUNK_CHUNK_SIZE; y++)
+                for (int j = 0; j < CUNK_CHUNK_SIZE; j++) {
+                    const int x = along_x ? i : j;
+                    const int z = along_x ? j : i;
+                    BlockData block_data = chunk.get(x, base_y + y, z);
+                    if (block_data != BlockAir && chunk.get(x + side_dx[side], base_y + y, z + side_dz[side]) == BlockAir)
+                        layer.add(block_data, y, j);
+                }
+            layer.merge([&](BlockId type, int a, int b, int a_length, int b_length) {
+                if (along_x)
+                    paste_face(format, direction, out, type, i, base_y + a, b, 1, a_length, b_length);
+                else
+                    paste_face(format, direction, out, type, b, base_y + a, i, b_length, a_length, 1);
+                *num_verts += 4;
+            });
+        }
+    }
+}
+
+void chunk_mesh(const PaddedChunk& chunk, uint8_t* out, size_t* num_verts, MeshFormat format) {
+    *num_verts = 0;
+    for (int section = 0; section < CUNK_CHUNK_SECTIONS_COUNT; section++) {
+        size_t section_verts;
+        chunk_mesh_section(chunk, section, out, &section_verts, format);
+        out += section_verts / 4 * mesh_quad_bytes(format);
+        *num_verts += section_verts;
+    }
+}
+
+void greedy_chunk_mesh(const PaddedChunk& chunk, uint8_t* out, size_t* num_verts, MeshFormat format) {
+    *num_verts = 0;
+    for (int section = 0; section < CUNK_CHUNK_SECTIONS_COUNT; section++) {
+        size_t section_verts;
+        greedy_chunk_mesh_section(chunk, section, out, &section_verts, format);
+        out += section_verts / 4 * mesh_quad_bytes(format);
+        *num_verts += section_verts;
+    }
+}
+
+void chunk_mesh_border(const ChunkData* chunk, const ChunkData* neighbour, ChunkSide side, uint8_t* out, size_t* num_verts, MeshFormat format) {
+    *num_verts = 0;
+    constexpr int last = CUNK_CHUNK_SIZE - 1;
+    for (int section = 0; section < CUNK_CHUNK_SECTIONS_COUNT; section++) {
+        const ChunkSection* own = chunk->sections[section];
+        if (!own)
+            continue;
+        const ChunkSection* other = neighbour->sections[section];
+        for (int y = 0; y < CUNK_CHUNK_SIZE; y++) {
+            for (int i = 0; i < CUNK_CHUNK_SIZE; i++) {
+                // position of the edge block in this chunk, and of the block across the edge in the neighbour
+                int x, z, nx, nz;
+                switch (side) {
+                    case SideMinusX: x = 0;    z = i;    nx = last; nz = i;    break;
+                    case SidePlusX:  x = last; z = i;    nx = 0;    nz = i;    break;
+                    case SideMinusZ: x = i;    z = 0;    nx = i;    nz = last; break;
+                    default:         x = i;    z = last; nx = i;    nz = 0;    break;
                 }
+                BlockData block_data = own->block_data[y][z][x];
+                if (block_data == BlockAir)
+                    continue;
+                if (other && other->block_data[y][nz][nx] != BlockAir)
+                    continue;
+
+                int world_y = y + section * CUNK_CHUNK_SIZE;
+                paste_face(format, static_cast<FaceDirection>(side), out, block_data, x, world_y, z);
+                *num_verts += 4;
+            }
+        }
+    }
+}
+
+void greedy_chunk_mesh_border(const ChunkData* chunk, const ChunkData* neighbour, ChunkSide side, uint8_t* out, size_t* num_verts, MeshFormat format) {
+    *num_verts = 0;
+    constexpr int last = CUNK_CHUNK_SIZE - 1;
+    const auto direction = static_cast<FaceDirection>(side);
+    const bool along_x = side_dx[side] != 0;
+    // the edge column of this chunk, and the column across the edge in the neighbour
+    const int edge = side_dx[side] + side_dz[side] < 0 ? 0 : last;
+    const int across = last - edge;
+    FaceLayer layer;
+    for (int section = 0; section < CUNK_CHUNK_SECTIONS_COUNT; section++) {
+        const ChunkSection* own = chunk->sections[section];
+        if (!own)
+            continue;
+        const ChunkSection* other = neighbour->sections[section];
+        layer.clear();
+        // a = y within the section, b = position along the edge
+        for (int y = 0; y < CUNK_CHUNK_SIZE; y++) {
+            for (int i = 0; i < CUNK_CHUNK_SIZE; i++) {
+                BlockData block_data = along_x ? own->block_data[y][i][edge] : own->block_data[y][edge][i];
+                if (block_data == BlockAir)
+                    continue;
+                if (other && (along_x ? other->block_data[y][i][across] : other->block_data[y][across][i]) != BlockAir)
+                    continue;
+                layer.add(block_data, y, i);
+            }
+        }
+        const int base_y = section * CUNK_CHUNK_SIZE;
+        layer.merge([&](BlockId type, int a, int b, int a_length, int b_length) {
+            if (along_x)
+                paste_face(format, direction, out, type, edge, base_y + a, b, 1, a_length, b_length);
+            else
+                paste_face(format, direction, out, type, b, base_y + a, edge, b_length, a_length, 1);
+            *num_verts += 4;
+        });
+    }
+}
+
+LodCells::LodCells(const ChunkData& chunk, int lod) : size(CUNK_CHUNK_SIZE >> lod), height(CUNK_CHUNK_MAX_HEIGHT >> lod) {
+    static_assert(BlockAir == 0);
+    memset(cells, 0, sizeof(cells));
+    const int f = 1 << lod;
+    for (int cy = 0; cy < height; cy++) {
+        // cells never straddle two sections
+        const ChunkSection* section = chunk.sections[cy * f / CUNK_CHUNK_SIZE];
+        if (!section)
+            continue;
+        for (int cz = 0; cz < size; cz++) {
+            for (int cx = 0; cx < size; cx++) {
+                int counts[BlockCount] = {};
+                for (int y = cy * f % CUNK_CHUNK_SIZE; y < cy * f % CUNK_CHUNK_SIZE + f; y++)
+                    for (int z = cz * f; z < cz * f + f; z++)
+                        for (int x = cx * f; x < cx * f + f; x++)
+                            counts[section->block_data[y][z][x]]++;
+                if (2 * counts[BlockAir] > f * f * f)
+                    continue;
+                int majority = BlockAir + 1;
+                for (int type = majority + 1; type < BlockCount; type++) {
+                    if (counts[type] > counts[majority])
+                        majority = type;
+                }
+                cells[cy + 1][cz + 1][cx + 1] = majority;
+            }
+        }
+    }
+}
+
+void lod_chunk_mesh(const ChunkData& chunk, int lod, uint8_t* out, size_t* num_verts, size_t first_vert[FaceCount][CUNK_CHUNK_SECTIONS_COUNT + 1], MeshFormat format) {
+    assert(lod > 0 && lod < MESH_LOD_COUNT);
+    const LodCells cells(chunk, lod);
+
+    const int f = 1 << lod;
+    const int section_cells = CUNK_CHUNK_SIZE >> lod;
+    const size_t quad_bytes = mesh_quad_bytes(format);
+    const uint8_t* start = out;
+    for (int direction = 0; direction < FaceCount; direction++) {
+        const int dx = face_dx[direction], dy = face_dy[direction], dz = face_dz[direction];
+        for (int cy = 0; cy < cells.height; cy++) {
+            if (cy % section_cells == 0)
+                first_vert[direction][cy / section_cells] = (out - start) / quad_bytes * 4;
+            for (int cz = 0; cz < cells.size; cz++) {
+                for (int cx = 0; cx < cells.size; cx++) {
+                    const BlockId type = cells.get(cx, cy, cz);
+                    if (type == BlockAir || cells.get(cx + dx, cy + dy, cz + dz) != BlockAir)
+                        continue;
+                    // a face on the far side of the cell is the one of its last block there, one block thick like every face
+                    paste_face(format, static_cast<FaceDirection>(direction), out, type,
+                               cx * f + (dx > 0 ? f - 1 : 0), cy * f + (dy > 0 ? f - 1 : 0), cz * f + (dz > 0 ? f - 1 : 0),
+                               dx ? 1 : f, dy ? 1 : f, dz ? 1 : f);
+                }
+            }
+        }
+        first_vert[direction][CUNK_CHUNK_SECTIONS_COUNT] = (out - start) / quad_bytes * 4;
     }
+    *num_verts = (out - start) / quad_bytes * 4;
 }
 
-ChunkMesh::ChunkMesh(imr::Device& d, ChunkNeighbors& n) {
-    std::vector<uint8_t> g;
-    chunk_mesh(n.neighbours[1][1], n, g, &num_verts);
+static FaceDirection quad_direction(MeshFormat format, const uint8_t* quad) {
+    uint32_t packed;
+    memcpy(&packed, quad, sizeof(packed));
+    if (format == MeshFaces)
+        return ChunkMesh::Face { packed }.face();
+    return ChunkMesh::Vertex { packed }.face();
+}
 
-    //fprintf(stderr, "%zu vertices, totalling %zu KiB of data\n", num_verts, num_verts * sizeof(float) * 5 / 1024);
-    //fflush(stderr);
+/// stable counting sort of the quads of each section by FaceDirection, see ChunkMesh::first_vert
+static void sort_by_direction(MeshFormat format, const uint8_t* in, const size_t section_bytes[CUNK_CHUNK_SECTIONS_COUNT + 1], uint8_t* out, size_t first_vert[FaceCount][CUNK_CHUNK_SECTIONS_COUNT + 1]) {
+    const size_t quad_bytes = mesh_quad_bytes(format);
+    size_t quads[FaceCount][CUNK_CHUNK_SECTIONS_COUNT] = {};
+    for (int section = 0; section < CUNK_CHUNK_SECTIONS_COUNT; section++)
+        for (size_t offset = section_bytes[section]; offset < section_bytes[section + 1]; offset += quad_bytes)
+            quads[quad_direction(format, in + offset)][section]++;
 
-    size_t buffer_size = g.size() * sizeof(uint8_t);
-    void* buffer = g.data();
+    size_t first_quad[FaceCount][CUNK_CHUNK_SECTIONS_COUNT];
+    size_t total = 0;
+    for (int direction = 0; direction < FaceCount; direction++) {
+        for (int section = 0; section < CUNK_CHUNK_SECTIONS_COUNT; section++) {
+            first_quad[direction][section] = total;
+            first_vert[direction][section] = total * 4;
+            total += quads[direction][section];
+        }
+        first_vert[direction][CUNK_CHUNK_SECTIONS_COUNT] = total * 4;
+    }
 
-    if (buffer_size > 0) {
-        buf = std::make_unique<imr::Buffer>(d, buffer_size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
-        buf->uploadDataSync(0, buffer_size, buffer);
+    for (int section = 0; section < CUNK_CHUNK_SECTIONS_COUNT; section++) {
+        for (size_t offset = section_bytes[section]; offset < section_bytes[section + 1]; offset += quad_bytes) {
+            size_t& quad = first_quad[quad_direction(format, in + offset)][section];
+            memcpy(out + quad * quad_bytes, in + offset, quad_bytes);
+            quad++;
+        }
     }
-}
\ No newline at end of file
+}
+
+uint8_t facing_directions(const nasl::vec3& eye, int cx, int cz) {
+    // vertices are drawn half a block off, see the translation in GameMesh::renderFrame()
+    const float min[3] = { cx * CUNK_CHUNK_SIZE - 0.5f, -0.5f, cz * CUNK_CHUNK_SIZE - 0.5f };
+    const float max[3] = { min[0] + CUNK_CHUNK_SIZE, min[1] + CUNK_CHUNK_MAX_HEIGHT, min[2] + CUNK_CHUNK_SIZE };
+    const float position[3] = { eye.x, eye.y, eye.z };
+    constexpr FaceDirection minus[3] = { FaceMinusX, FaceMinusY, FaceMinusZ };
+    constexpr FaceDirection plus[3] = { FacePlusX, FacePlusY, FacePlusZ };
+
+    uint8_t directions = 0;
+    for (int axis = 0; axis < 3; axis++) {
+        if (position[axis] < max[axis])
+            directions |= 1 << minus[axis];
+        if (position[axis] > min[axis])
+            directions |= 1 << plus[axis];
+    }
+    return directions;
+}
+
+static void upload_part(imr::Device& d, MeshFormat format, ChunkMesh::Part& part, const uint8_t* data, size_t* buffer_size) {
+    size_t size = part.num_verts / 4 * mesh_quad_bytes(format);
+    if (size > 0) {
+        VkBufferUsageFlags usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        if (format == MeshFaces)
+            usage |= VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+        else
+            usage |= VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+        part.buf = std::make_unique<imr::Buffer>(d, size, usage);
+        upload_readonly(*part.buf, data, size);
+    }
+    *buffer_size += size;
+}
+
+std::unique_ptr<imr::Buffer> QuadIndexBuffer::reserve(imr::Device& d, size_t quads) {
+    size_t new_max_quads = std::max<size_t>(max_quads, 4096);
+    while (new_max_quads < quads)
+        new_max_quads *= 2;
+    if (new_max_quads == max_quads)
+        return nullptr;
+
+    std::vector<uint32_t> indices(new_max_quads * 6);
+    for (size_t quad = 0; quad < new_max_quads; quad++) {
+        const uint32_t first = quad * 4;
+        const uint32_t pattern[6] = { first, first + 1, first + 2, first, first + 2, first + 3 };
+        memcpy(&indices[quad * 6], pattern, sizeof(pattern));
+    }
+    auto old = std::move(buf);
+    const size_t size = indices.size() * sizeof(uint32_t);
+    buf = std::make_unique<imr::Buffer>(d, size, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+    buf->uploadDataSync(0, size, indices.data());
+    max_quads = new_max_quads;
+    return old;
+}
+
+/// the cache key of one part of a chunk's mesh: `kind` says which part, `detail` is whatever else it depends on
+static uint64_t part_key(uint64_t content_hash, MeshFormat format, uint64_t kind, uint64_t detail) {
+    uint64_t key = hash_combine(content_hash, MESHER_VERSION);
+    key = hash_combine(key, GREEDY_MESHING);
+    key = hash_combine(key, format);
+    key = hash_combine(key, kind);
+    return hash_combine(key, detail);
+}
+
+/// uploads the part cached under `key` or, if there is none, the one `mesh` returns, which is then cached
+template<typename F>
+static void build_part(imr::Device& d, MeshFormat format, MeshCache* cache, uint64_t key, ChunkMesh::Part& part, size_t* buffer_size, F mesh) {
+    if (auto cached = cache ? cache->load(key) : nullptr) {
+        part.num_verts = cached->size / mesh_quad_bytes(format) * 4;
+        upload_part(d, format, part, cached->data, buffer_size);
+        return;
+    }
+    const uint8_t* out = mesh(&part.num_verts);
+    upload_part(d, format, part, out, buffer_size);
+    if (cache)
+        cache->store(key, { std::span(out, part.num_verts / 4 * mesh_quad_bytes(format)) });
+}
+
+ChunkMesh::ChunkMesh(imr::Device& d, const ChunkData& chunk, MeshFormat format, int lod, MeshCache* cache, uint64_t content_hash)
+    : format(format), lod(lod), cache(cache), content_hash(content_hash) {
+    // LOD meshes are closed on every side already
+    if (lod > 0)
+        std::fill(std::begin(has_border), std::end(has_border), true);
+
+    // the core is cached with its ranges in front of it
+    const uint64_t key = part_key(content_hash, format, 'C', lod);
+    auto cached = cache ? cache->load(key) : nullptr;
+    if (cached && cached->size >= sizeof(first_vert)) {
+        memcpy(first_vert, cached->data, sizeof(first_vert));
+        core.num_verts = (cached->size - sizeof(first_vert)) / mesh_quad_bytes(format) * 4;
+        upload_part(d, format, core, cached->data + sizeof(first_vert), &buffer_size);
+        return;
+    }
+
+    const uint8_t* out;
+    if (lod > 0) {
+        uint8_t* lod_out = mesher_scratch(lod_mesh_max_faces(lod) * mesh_quad_bytes(format));
+        lod_chunk_mesh(chunk, lod, lod_out, &core.num_verts, first_vert, format);
+        out = lod_out;
+    } else {
+        // neighbours are treated as solid, their edges get meshed in mesh_border()
+        ChunkNeighbors n = {};
+        n.neighbours[1][1] = &chunk;
+        const PaddedChunk& padded = PaddedChunk::scratch(n, BlockStone);
+
+        const size_t quad_bytes = mesh_quad_bytes(format);
+        size_t section_bytes[CUNK_CHUNK_SECTIONS_COUNT + 1];
+        uint8_t* sections = mesh_sections(padded, [&](int section) {
+            return padded.count_exposed_faces(section) * quad_bytes;
+        }, [&](int section, uint8_t* section_out) {
+            size_t verts;
+            if (GREEDY_MESHING)
+                greedy_chunk_mesh_section(padded, section, section_out, &verts, format);
+            else
+                chunk_mesh_section(padded, section, section_out, &verts, format);
+            return verts / 4 * quad_bytes;
+        }, section_bytes);
+        core.num_verts = section_bytes[CUNK_CHUNK_SECTIONS_COUNT] / quad_bytes * 4;
+
+        //fprintf(stderr, "%zu vertices, totalling %zu KiB of data\n", core.num_verts, core.num_verts * sizeof(Vertex) / 1024);
+        //fflush(stderr);
+
+        // mesh_sections() already used the mesher scratch, the sorted copy needs memory of its own
+        thread_local std::vector<uint8_t> sorted;
+        if (sorted.size() < section_bytes[CUNK_CHUNK_SECTIONS_COUNT])
+            sorted.resize(section_bytes[CUNK_CHUNK_SECTIONS_COUNT]);
+        sort_by_direction(format, sections, section_bytes, sorted.data(), first_vert);
+        out = sorted.data();
+    }
+
+    upload_part(d, format, core, out, &buffer_size);
+    if (cache) {
+        cache->store(key, {
+            std::span(reinterpret_cast<const uint8_t*>(first_vert), sizeof(first_vert)),
+            std::span(out, core.num_verts / 4 * mesh_quad_bytes(format)),
+        });
+    }
+}
+
+void ChunkMesh::mesh_border(imr::Device& d, const ChunkData& chunk, const ChunkData& neighbour, ChunkSide side) {
+    assert(!has_border[side]);
+    const uint64_t key = part_key(content_hash, format, 'B', hash_combine(side, neighbour_edge_key(neighbour, side)));
+    build_part(d, format, cache, key, borders[side], &buffer_size, [&](size_t* num_verts) {
+        uint8_t* out = mesher_scratch(MAX_BORDER_FACES * mesh_quad_bytes(format));
+        if (GREEDY_MESHING)
+            greedy_chunk_mesh_border(&chunk, &neighbour, side, out, num_verts, format);
+        else
+            chunk_mesh_border(&chunk, &neighbour, side, out, num_verts, format);
+        return out;
+    });
+    has_border[side] = true;
+}
+
+void ChunkMesh::mesh_skirt(imr::Device& d, const ChunkData& chunk, ChunkSide side) {
+    assert(lod == 0 && !has_skirt[side]);
+    build_part(d, format, cache, part_key(content_hash, format, 'S', side), skirts[side], &buffer_size, [&](size_t* num_verts) {
+        static const ChunkData air = {};
+        uint8_t* out = mesher_scratch(MAX_BORDER_FACES * mesh_quad_bytes(format));
+        if (GREEDY_MESHING)
+            greedy_chunk_mesh_border(&chunk, &air, side, out, num_verts, format);
+        else
+            chunk_mesh_border(&chunk, &air, side, out, num_verts, format);
+        return out;
+    });
+    has_skirt[side] = true;
+}
@@ -2,8 +2,11 @@
 #define SIGCRAFT_CHUNK_MESH_H
 
 #include "imr/imr.h"
+#include "nasl/nasl.h"
 
+#include <cassert>
 #include <cstddef>
+#include <vector>
 
 extern "C" {
 #include "enklume/block_data.h"
@@ -15,22 +18,225 @@ struct ChunkNeighbors {
 
 BlockData access_safe(const ChunkData* chunk, ChunkNeighbors& neighbours, int x, int y, int z);
 
-struct ChunkMesh {
+/// the four horizontal edges of a chunk, where its faces depend on a neighbouring chunk
+enum ChunkSide {
+    SideMinusX,
+    SidePlusX,
+    SideMinusZ,
+    SidePlusZ,
+    SideCount
+};
+
+/// chunk offset of the neighbour on each side
+constexpr int side_dx[SideCount] = { -1, 1, 0, 0 };
+constexpr int side_dz[SideCount] = { 0, 0, -1, 1 };
+
+/// the six face directions; the horizontal ones match ChunkSide
+enum FaceDirection {
+    FaceMinusX = SideMinusX,
+    FacePlusX = SidePlusX,
+    FaceMinusZ = SideMinusZ,
+    FacePlusZ = SidePlusZ,
+    FaceMinusY,
+    FacePlusY,
+    FaceCount
+};
+
+/// the offset to the neighbouring block in each FaceDirection
+constexpr int face_dx[FaceCount] = { -1, 1, 0, 0, 0, 0 };
+constexpr int face_dy[FaceCount] = { 0, 0, 0, 0, -1, 1 };
+constexpr int face_dz[FaceCount] = { 0, 0, -1, 1, 0, 0 };
+
+/**
+ * Bit d is set for every FaceDirection d that a face inside chunk (cx, cz) can show its front to a camera at `eye`.
+ * All faces of a direction lie within the chunk's bounding box, so if the eye is behind the box along that
+ * direction's normal, every one of them is back-facing.
+ */
+uint8_t facing_directions(const nasl::vec3& eye, int cx, int cz);
+
+struct PaddedChunk;
+struct MeshCache;
+
+/// how a ChunkMesh stores its quads. Either way a part with n vertices is drawn with the QuadIndexBuffer.
+enum MeshFormat {
+    /// 4 ChunkMesh::Vertex per quad, fetched through the vertex input state (basic.vert)
+    MeshVertices,
+    /// one ChunkMesh::Face per quad in a storage buffer, expanded from gl_VertexIndex (face.vert)
+    MeshFaces,
+};
+
+/// whether ChunkMesh merges coplanar faces of the same block type into larger quads
+constexpr bool GREEDY_MESHING = true;
+
+/*
+ * The meshers write their quads to `out`, which has to have room for as many quads as there are faces to mesh:
+ * PaddedChunk::count_exposed_faces() for a whole chunk, MAX_BORDER_FACES for an edge.
+ * `num_verts` is set to 4 per quad written, see mesh_quad_bytes() for the size in bytes.
+ */
+/// emits a quad for every block face that borders air
+void chunk_mesh(const PaddedChunk& chunk, uint8_t* out, size_t* num_verts, MeshFormat format = MeshVertices);
+/// emits the faces on one outer edge of `chunk` that border air in `neighbour`
+void chunk_mesh_border(const ChunkData* chunk, const ChunkData* neighbour, ChunkSide side, uint8_t* out, size_t* num_verts, MeshFormat format = MeshVertices);
+/// like chunk_mesh(), but merges the faces of each 16x16 layer into rectangles per block type
+void greedy_chunk_mesh(const PaddedChunk& chunk, uint8_t* out, size_t* num_verts, MeshFormat format = MeshVertices);
+/// chunk_mesh() and greedy_chunk_mesh() for a single section, which only reads the PaddedChunk so sections can be meshed in parallel
+void chunk_mesh_section(const PaddedChunk& chunk, int section, uint8_t* out, size_t* num_verts, MeshFormat format = MeshVertices);
+void greedy_chunk_mesh_section(const PaddedChunk& chunk, int section, uint8_t* out, size_t* num_verts, MeshFormat format = MeshVertices);
+/// like chunk_mesh_border(), merging the faces of each section of the edge into rectangles
+void greedy_chunk_mesh_border(const ChunkData* chunk, const ChunkData* neighbour, ChunkSide side, uint8_t* out, size_t* num_verts, MeshFormat format = MeshVertices);
+
+/// the most faces a single edge of a chunk can have
+constexpr size_t MAX_BORDER_FACES = CUNK_CHUNK_SIZE * CUNK_CHUNK_MAX_HEIGHT;
+
+/// how many levels of detail a chunk can be meshed at, level l merges 2^l blocks along every axis into one cell
+constexpr int MESH_LOD_COUNT = 4;
+static_assert(CUNK_CHUNK_SIZE % (1 << (MESH_LOD_COUNT - 1)) == 0, "cells have to tile chunks and sections");
+
+/// the most faces lod_chunk_mesh() can emit
+constexpr size_t lod_mesh_max_faces(int lod) {
+    return 6 * (CUNK_CHUNK_SIZE >> lod) * (CUNK_CHUNK_SIZE >> lod) * (CUNK_CHUNK_MAX_HEIGHT >> lod);
+}
+
+/**
+ * Meshes `chunk` at level of detail `lod` > 0, with one quad per exposed cell face. A cell of 2^lod blocks per axis is solid
+ * if at least half of its blocks are, and then takes the most common block type among them. Everything outside the chunk
+ * counts as air, so the mesh is closed on all sides and leaves no cracks next to chunks drawn at another level.
+ * The quads are written ordered by direction, `first_vert` is filled like ChunkMesh::first_vert.
+ */
+void lod_chunk_mesh(const ChunkData& chunk, int lod, uint8_t* out, size_t* num_verts, size_t first_vert[FaceCount][CUNK_CHUNK_SECTIONS_COUNT + 1], MeshFormat format = MeshVertices);
+
+/// the block type of every cell of a chunk at some level of detail, see lod_chunk_mesh()
+struct LodCells {
+    /// big enough for the finest level with cells, plus a border of air
+    static constexpr int SIZE = CUNK_CHUNK_SIZE / 2 + 2;
+    static constexpr int HEIGHT = CUNK_CHUNK_MAX_HEIGHT / 2 + 2;
+
+    /// indexed [y + 1][z + 1][x + 1], like PaddedChunk
+    uint8_t cells[HEIGHT][SIZE][SIZE];
+    /// cells per axis at this level
+    int size, height;
+
+    LodCells(const ChunkData& chunk, int lod);
+
+    BlockId get(int x, int y, int z) const {
+        return static_cast<BlockId>(cells[y + 1][z + 1][x + 1]);
+    }
+};
+
+/**
+ * Meshes only store the 4 corners of each quad, this holds the indices that turn them into two triangles.
+ * The pattern is the same for every quad, so a single buffer serves all chunks: a part with n vertices
+ * is drawn with n / 4 * 6 indices from the start of it.
+ */
+struct QuadIndexBuffer {
     std::unique_ptr<imr::Buffer> buf;
-    size_t num_verts;
+    size_t max_quads = 0;
+
+    /// grows the buffer to cover at least `quads` quads. Returns the buffer it replaced, if any,
+    /// since frames in flight may still be reading from it.
+    std::unique_ptr<imr::Buffer> reserve(imr::Device&, size_t quads);
+};
+
+/**
+ * The mesh of a chunk is built as soon as the chunk is loaded: the core holds every face that only depends
+ * on the chunk itself, treating missing neighbours as solid, with its sections meshed in parallel.
+ * The faces on each outer edge are a small separate patch that is meshed once the neighbour on that side is loaded.
+ * The core is ordered by FaceDirection, so whole directions can be skipped when they face away from the camera;
+ * every border only has faces of the direction matching its side.
+ * Meshes with a level of detail above 0 are a closed lod_chunk_mesh() in the core, and don't need any borders.
+ */
+struct ChunkMesh {
+    struct Part {
+        std::unique_ptr<imr::Buffer> buf;
+        size_t num_verts = 0;
+    };
+
+    Part core;
+    /// the core vertices of direction d in section s are [first_vert[d][s], first_vert[d][s + 1]),
+    /// one direction after the other, so first_vert[d][CUNK_CHUNK_SECTIONS_COUNT] == first_vert[d + 1][0]
+    size_t first_vert[FaceCount][CUNK_CHUNK_SECTIONS_COUNT + 1] = {};
+    /// indexed by ChunkSide
+    Part borders[SideCount];
+    bool has_border[SideCount] = {};
+    /// all faces on an edge, as if the neighbour was air. Drawn instead of the border next to a chunk
+    /// with a coarser level of detail, whose surface doesn't match and would leave cracks otherwise.
+    Part skirts[SideCount];
+    bool has_skirt[SideCount] = {};
+    size_t buffer_size = 0;
+    MeshFormat format;
+    int lod;
+    /// where the parts of this mesh are looked up before meshing them, and stored after, if not null.
+    /// `content_hash` is hash_chunk() of the chunk, the parts' cache keys are derived from it.
+    MeshCache* cache;
+    uint64_t content_hash;
+    /// set for cores meshed on the GPU (see GpuMesher): a VkDrawIndexedIndirectCommand per FaceDirection,
+    /// whose ranges the CPU never sees, so first_vert stays empty
+    std::unique_ptr<imr::Buffer> indirect;
+
+    ChunkMesh(imr::Device&, const ChunkData& chunk, MeshFormat format = MeshVertices, int lod = 0, MeshCache* cache = nullptr, uint64_t content_hash = 0);
+    /// an empty level 0 mesh, for meshers that fill in the core themselves
+    explicit ChunkMesh(MeshFormat format) : format(format), lod(0), cache(nullptr), content_hash(0) {}
 
-    ChunkMesh(imr::Device&, ChunkNeighbors& n);
+    void mesh_border(imr::Device&, const ChunkData& chunk, const ChunkData& neighbour, ChunkSide side);
+    void mesh_skirt(imr::Device&, const ChunkData& chunk, ChunkSide side);
 
+    /// the range of core vertices with faces in `direction`
+    size_t direction_first_vert(FaceDirection direction) const { return first_vert[direction][0]; }
+    size_t direction_verts(FaceDirection direction) const { return first_vert[direction][CUNK_CHUNK_SECTIONS_COUNT] - first_vert[direction][0]; }
+
+    /**
+     * A quad corner packed into 32 bits, unpacked again in basic.vert:
+     * bits 0-4 x, 5-13 y, 14-18 z (chunk-local, up to and including the far edge), 19-21 FaceDirection, 22-29 BlockId.
+     * The normal follows from the face direction and the color is looked up by block id.
+     */
     struct Vertex {
-        int16_t vx, vy, vz;
-        uint8_t tt;
-        uint8_t ss;
-        uint8_t nnx, nny, nnz;
-        uint8_t pad;
-        uint8_t br, bg, bb, pad2;
+        uint32_t packed;
+
+        static Vertex pack(unsigned x, unsigned y, unsigned z, FaceDirection face, BlockData block) {
+            assert(x <= CUNK_CHUNK_SIZE && y <= CUNK_CHUNK_MAX_HEIGHT && z <= CUNK_CHUNK_SIZE && block < 256);
+            return { x | y << 5 | z << 14 | static_cast<uint32_t>(face) << 19 | block << 22 };
+        }
+
+        unsigned x() const { return packed & 0x1F; }
+        unsigned y() const { return (packed >> 5) & 0x1FF; }
+        unsigned z() const { return (packed >> 14) & 0x1F; }
+        FaceDirection face() const { return static_cast<FaceDirection>((packed >> 19) & 0x7); }
+        BlockId block() const { return static_cast<BlockId>((packed >> 22) & 0xFF); }
+    };
+
+    static_assert(sizeof(Vertex) == sizeof(uint32_t));
+
+    /**
+     * A whole quad packed into 32 bits, for MeshFaces, expanded again in face.vert:
+     * bits 0-3 x, 4-12 y, 13-16 z of the block the face belongs to, 17-19 FaceDirection,
+     * 20-23 and 24-27 the size of the quad minus one along the two axes in its plane (x, y, z order), 28-31 BlockId.
+     */
+    struct Face {
+        uint32_t packed;
+
+        static Face pack(unsigned x, unsigned y, unsigned z, FaceDirection face, unsigned size_a, unsigned size_b, BlockData block) {
+            assert(x < CUNK_CHUNK_SIZE && y < CUNK_CHUNK_MAX_HEIGHT && z < CUNK_CHUNK_SIZE);
+            assert(size_a >= 1 && size_a <= CUNK_CHUNK_SIZE && size_b >= 1 && size_b <= CUNK_CHUNK_SIZE);
+            return { x | y << 4 | z << 13 | static_cast<uint32_t>(face) << 17 | (size_a - 1) << 20 | (size_b - 1) << 24 | block << 28 };
+        }
+
+        unsigned x() const { return packed & 0xF; }
+        unsigned y() const { return (packed >> 4) & 0x1FF; }
+        unsigned z() const { return (packed >> 13) & 0xF; }
+        FaceDirection face() const { return static_cast<FaceDirection>((packed >> 17) & 0x7); }
+        unsigned size_a() const { return ((packed >> 20) & 0xF) + 1; }
+        unsigned size_b() const { return ((packed >> 24) & 0xF) + 1; }
+        BlockId block() const { return static_cast<BlockId>(packed >> 28); }
     };
 
-    static_assert(sizeof(Vertex) == sizeof(uint8_t) * 16);
+    static_assert(sizeof(Face) == sizeof(uint32_t));
+    static_assert(BlockCount <= 16, "Face packs the block id into 4 bits");
+    static_assert(CUNK_CHUNK_SIZE < 32 && CUNK_CHUNK_MAX_HEIGHT < 512, "Vertex packs positions into 5/9/5 bits");
 };
 
+/// bytes per quad of mesh output in the given format
+constexpr size_t mesh_quad_bytes(MeshFormat format) {
+    return format == MeshFaces ? sizeof(ChunkMesh::Face) : 4 * sizeof(ChunkMesh::Vertex);
+}
+
 #endif
@@ -12,33 +12,34 @@
 
 typedef uint32_t BlockData;
 
+// name, color, whether it hides what's behind it, whether it can be collided with
 #define BLOCK_TYPES(B) \
-B(Air, 0, 0, 0) \
-B(Stone, 0.5, 0.5, 0.5) \
-B(Dirt, 0.25, 0.25, 0) \
-B(Grass, 0.2, 0.8, 0.1) \
-B(TallGrass, 0.2, 0.9, 0.1) \
-B(Sand, 0.8, 0.8, 0) \
-B(Gravel, 0.9, 0.9, 0.9) \
-B(Planks, 0.8, 0.5, 0.0) \
-B(Water, 0.0, 0.2, 0.8) \
-B(Leaves, 0.1, 0.4, 0.1) \
-B(Wood, 0.3, 0.1, 0.0) \
-B(Snow, 1.0, 1.0, 1.0) \
-B(Lava, 1.0, 0.2, 0.0) \
-B(Bedrock, 0.1, 0.1, 0.1) \
-B(SandStone, 0.8, 0.8, 0) \
-B(Unknown, 1.0, 0.0, 1.0)
+B(Air, 0, 0, 0, 0, 0) \
+B(Stone, 0.5, 0.5, 0.5, 1, 1) \
+B(Dirt, 0.25, 0.25, 0, 1, 1) \
+B(Grass, 0.2, 0.8, 0.1, 1, 1) \
+B(TallGrass, 0.2, 0.9, 0.1, 0, 0) \
+B(Sand, 0.8, 0.8, 0, 1, 1) \
+B(Gravel, 0.9, 0.9, 0.9, 1, 1) \
+B(Planks, 0.8, 0.5, 0.0, 1, 1) \
+B(Water, 0.0, 0.2, 0.8, 0, 0) \
+B(Leaves, 0.1, 0.4, 0.1, 0, 1) \
+B(Wood, 0.3, 0.1, 0.0, 1, 1) \
+B(Snow, 1.0, 1.0, 1.0, 1, 1) \
+B(Lava, 1.0, 0.2, 0.0, 1, 0) \
+B(Bedrock, 0.1, 0.1, 0.1, 1, 1) \
+B(SandStone, 0.8, 0.8, 0, 1, 1) \
+B(Unknown, 1.0, 0.0, 1.0, 1, 1)
 
 enum BlockId {
-#define B(name, r, g, b) Block##name,
+#define B(name, r, g, b, opaque, solid) Block##name,
 BLOCK_TYPES(B)
 #undef B
     BlockCount
 };
 
 static struct { float r, g, b; } block_colors[] = {
-#define B(name, r, g, b) { r, g, b},
+#define B(name, r, g, b, opaque, solid) { r, g, b},
     BLOCK_TYPES(B)
 #undef B
 };
@@ -1,12 +1,118 @@
 #include "game.h"
 
+#include <algorithm>
+#include <unistd.h>
+
+ViewSettings::ViewSettings() {
+    const size_t available = sysconf(_SC_AVPHYS_PAGES) * sysconf(_SC_PAGE_SIZE);
+    memory_budget = available / 4;
+    render_distance = memory_scaled_render_distance(ESTIMATED_CHUNK_BYTES);
+    std::cout << "Render distance: " << render_distance << " (" << memory_budget / (1024 * 1024) << " MiB chunk budget)" << std::endl;
+}
+
+int ViewSettings::memory_scaled_render_distance(size_t chunk_bytes) const {
+    const double chunks = static_cast<double>(memory_budget) / static_cast<double>(chunk_bytes);
+    // the loaded area is a circle of radius render_distance + UNLOAD_MARGIN
+    const int radius = static_cast<int>(sqrt(chunks / M_PI)) - UNLOAD_MARGIN;
+    return std::clamp(radius, MIN_RENDER_DISTANCE, MAX_RENDER_DISTANCE);
+}
+
+void Game::change_render_distance(int delta) {
+    settings.render_distance = std::clamp(settings.render_distance + delta, MIN_RENDER_DISTANCE, MAX_RENDER_DISTANCE);
+    settings.auto_render_distance = false;
+    std::cout << "Render distance: " << settings.render_distance << std::endl;
+}
+
+void Game::adapt_render_distance(size_t measured_bytes, size_t measured_chunks) {
+    if (!settings.auto_render_distance || measured_chunks < CHUNK_COST_SAMPLES)
+        return;
+    const int radius = settings.memory_scaled_render_distance(measured_bytes / measured_chunks);
+    // only follow bigger changes, so the radius doesn't jitter with every chunk that gets meshed
+    if (abs(radius - settings.render_distance) > 1) {
+        settings.render_distance = radius;
+        std::cout << "Render distance: " << radius << " (measured " << measured_bytes / measured_chunks / 1024 << " KiB per chunk)" << std::endl;
+    }
+}
+
+void Game::release_gpu_resources(Chunk* chunk, imr::Swapchain::SimplifiedRenderContext& context, uint8_t representations) {
+    chunk->region.world.shrink_retained_chunk(chunk, chunk->gpu_bytes(representations));
+    if (representations & RepresentationVoxels)
+        release_later(std::move(chunk->voxels), context);
+    if (representations & RepresentationGreedyVoxels)
+        release_later(std::move(chunk->greedy_voxels), context);
+    if (representations & RepresentationVoxelLods) {
+        for (auto& lod : chunk->lod_voxels)
+            release_later(std::move(lod), context);
+    }
+    if (representations & RepresentationMesh) {
+        for (auto& mesh : chunk->meshes)
+            release_later(std::move(mesh), context);
+    }
+}
+
+void Game::retire_chunk(Chunk* chunk, imr::Swapchain::SimplifiedRenderContext& context) {
+    if (!RETAIN_GPU_BUFFERS)
+        release_gpu_resources(chunk, context);
+    world->retain_chunk(chunk);
+}
+
+void Game::evict_cached_chunks(imr::Swapchain::SimplifiedRenderContext& context) {
+    world->evict_cached_chunks([&](Chunk* chunk) {
+        release_gpu_resources(chunk, context);
+    });
+}
+
+void Game::trim_inactive_representations(imr::Swapchain::SimplifiedRenderContext& context, int player_chunk_x, int player_chunk_z) {
+    const uint8_t inactive = RepresentationAll & ~active_representation();
+    size_t inactive_bytes = 0;
+    std::vector<Chunk*> holding;
+    for (auto chunk : world->loaded_chunks()) {
+        if (size_t bytes = chunk->gpu_bytes(inactive)) {
+            inactive_bytes += bytes;
+            holding.push_back(chunk);
+        }
+    }
+    if (inactive_bytes <= INACTIVE_GPU_BUDGET)
+        return;
+
+    auto distance = [&](const Chunk* chunk) {
+        const int dx = chunk->cx - player_chunk_x;
+        const int dz = chunk->cz - player_chunk_z;
+        return dx * dx + dz * dz;
+    };
+    std::sort(holding.begin(), holding.end(), [&](const Chunk* a, const Chunk* b) {
+        return distance(a) > distance(b);
+    });
+    for (auto chunk : holding) {
+        if (inactive_bytes <= INACTIVE_GPU_BUDGET)
+            break;
+        inactive_bytes -= chunk->gpu_bytes(inactive);
+        release_gpu_resources(chunk, context, inactive);
+    }
+}
+
+void Game::record_gpu_meshing(imr::Swapchain::SimplifiedRenderContext& context) {
+    if (gpu_mesher)
+        context.frame().addCleanupAction(gpu_mesher->record(context.cmdbuf()));
+}
+
 GameVoxels::GameVoxels(imr::Device &device, GLFWwindow *window, imr::Swapchain &swapchain, World *world, Camera &camera,
-                       const bool greedyVoxels)
+                       ViewSettings &settings, const bool greedyVoxels)
     : Game(device, window, swapchain, VoxelShaders(device, swapchain, {
                                                        greedyVoxels ? "greedyVoxel.vert.spv" : "voxel.vert.spv",
                                                        "voxel.frag.spv"
-                                                   }), world, camera),
+                                                   }), world, camera, settings),
       greedyVoxels(greedyVoxels) {
+    static_assert(PER_FRAME_PUSH_CONSTANTS == 164 && sizeof(push_constants) == 184, "the push constants of voxel.vert and greedyVoxel.vert");
+    auto table = voxel_block_properties(textureManager.m_blockTable);
+    block_table = std::make_unique<imr::Buffer>(device, sizeof(table), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
+    block_table->uploadDataSync(0, sizeof(table), table.data());
+    push_constants.block_table = block_table->device_address();
+    activate();
+}
+
+void GameVoxels::activate() {
+    prev_frame = imr_get_time_nano();
     glfwSetWindowUserPointer(window, this);
     glfwSetKeyCallback(window, [](GLFWwindow *window, int key, int scancode, int action, int mods) {
         auto* game = static_cast<GameVoxels*>(glfwGetWindowUserPointer(window));
@@ -23,26 +129,118 @@ GameVoxels::GameVoxels(imr::Device &device, GLFWwindow *window, imr::Swapchain &
         } else if (key == GLFW_KEY_F11 && action == GLFW_PRESS) {
             game->greedyVoxels = !game->greedyVoxels;
             game->reload_shaders = true;
-            game->toggleGreedy = true;
         } else if (key == GLFW_KEY_F10 && action == GLFW_PRESS) {
             game->toggleMode = true;
         } else if (key == GLFW_KEY_F3 && action == GLFW_PRESS) {
             game->texturesEnabled = !game->texturesEnabled;
+        } else if (key == GLFW_KEY_F4 && action == GLFW_PRESS) {
+            game->world->print_cache_stats();
+            std::cout << "Chunks per level of detail:";
+            for (int lod = 0; lod < VOXEL_LOD_COUNT; lod++)
+                std::cout << " " << game->frame_lod_chunks[lod] << " at " << (1 << lod) << "x";
+            std::cout << std::endl;
+        } else if (key == GLFW_KEY_F5 && action == GLFW_PRESS) {
+            game->change_render_distance(-2);
+        } else if (key == GLFW_KEY_F6 && action == GLFW_PRESS) {
+            game->change_render_distance(2);
+        } else if (key == GLFW_KEY_F7 && action == GLFW_PRESS) {
+            game->lod_cell_pixels = game->lod_cell_pixels == 0.0f ? 1.0f : game->lod_cell_pixels == 8.0f ? 0.0f : game->lod_cell_pixels * 2.0f;
+            if (game->lod_cell_pixels > 0.0f)
+                std::cout << "Merging distant voxels into cells of at most " << game->lod_cell_pixels << " pixels" << std::endl;
+            else
+                std::cout << "Drawing every voxel at full detail" << std::endl;
+        } else if (key == GLFW_KEY_F8 && action == GLFW_PRESS) {
+            game->gpu_meshing = !game->gpu_meshing;
+            game->rebuild_voxels = true;
+            std::cout << (game->gpu_meshing ? "Building voxels on the GPU (greedy voxels are still built on the CPU)" : "Building voxels on the CPU") << std::endl;
+        } else if (key == GLFW_KEY_F12 && action == GLFW_PRESS) {
+            if (game->renderer == VoxelsRasterized)
+                game->renderer = VoxelsSplatted;
+            else if (game->renderer == VoxelsSplatted && game->atomic64)
+                game->renderer = VoxelsSplatted64;
+            else
+                game->renderer = VoxelsRasterized;
+            const char* names[] = { "Rasterizing a quad per voxel", "Splatting voxels in two passes", "Splatting voxels with 64 bit atomics" };
+            std::cout << names[game->renderer] << std::endl;
+        } else if (key == GLFW_KEY_F9 && action == GLFW_PRESS) {
+            game->batch_chunks = game->batch_chunks == 0 ? 4 : game->batch_chunks == 4 ? MAX_BATCH_CHUNKS : 0;
+            // the chunks need the host copies of their boxes for batching
+            game->rebuild_voxels = true;
+            if (game->batch_chunks)
+                std::cout << "Merging greedy voxels into batches of " << game->batch_chunks << "x" << game->batch_chunks << " chunks" << std::endl;
+            else
+                std::cout << "Drawing greedy voxels per chunk" << std::endl;
         }
     });
 }
 
-void GameVoxels::renderFrame() {
-    if (toggleGreedy) {
-        swapchain.drain();
-        for (const auto chunk : world->loaded_chunks()) {
-            if (std::unique_ptr<ChunkVoxels> stolen = std::move(chunk->voxels)) {
-                delete stolen.release();
-            }
-            world->unload_chunk(chunk);
+static int to_batch_coordinate(int c, int batch_chunks) {
+    if (c < 0)
+        return (c - batch_chunks + 1) / batch_chunks;
+    return c / batch_chunks;
+}
+
+int GameVoxels::voxel_lod(int cx, int cz) const {
+    int current_lod = -1;
+    if (Chunk* chunk = world->get_loaded_chunk(cx, cz)) {
+        for (int level = VOXEL_LOD_COUNT - 1; level >= 0; level--) {
+            if (chunk->voxels_for(greedyVoxels, level))
+                current_lod = level;
         }
-        toggleGreedy = false;
     }
+    return chunk_lod(cx, cz, VOXEL_LOD_COUNT, lod_cell_pixels, current_lod);
+}
+
+bool GameVoxels::batch_members(const Int2 batch, std::vector<const ChunkVoxels*>& members) {
+    constexpr uint8_t all_neighbours = (1 << SideCount) - 1;
+    members.clear();
+    for (int dx = 0; dx < batch_chunks; dx++) {
+        for (int dz = 0; dz < batch_chunks; dz++) {
+            const Chunk* chunk = world->get_loaded_chunk(batch.x * batch_chunks + dx, batch.z * batch_chunks + dz);
+            // batches are drawn at full detail
+            if (!chunk || chunk->retained || voxel_lod(chunk->cx, chunk->cz) > 0)
+                return false;
+            const ChunkVoxels* voxels = chunk->greedy_voxels.get();
+            if (!voxels || voxels->neighbour_mask != all_neighbours || voxels->boxes.size() != voxels->num_voxels)
+                return false;
+            // a batch only has one loading animation
+            if (push_constants.time - voxels->spawn_time < LOADING_ANIMATION_SECONDS)
+                return false;
+            members.push_back(voxels);
+        }
+    }
+    return true;
+}
+
+void GameVoxels::update_batches(imr::Swapchain::SimplifiedRenderContext& context, const int player_chunk_x, const int player_chunk_z) {
+    std::vector<const ChunkVoxels*> members;
+    for (auto it = batches.begin(); it != batches.end();) {
+        if (!greedyVoxels || batch_chunks == 0 || !batch_members(it->first, members) || members != it->second.members) {
+            release_later(std::move(it->second.voxels), context);
+            it = batches.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    if (!greedyVoxels || batch_chunks == 0)
+        return;
+
+    const int radius = settings.render_distance;
+    int built = 0;
+    for (int bx = to_batch_coordinate(player_chunk_x - radius, batch_chunks); bx <= to_batch_coordinate(player_chunk_x + radius, batch_chunks); bx++) {
+        for (int bz = to_batch_coordinate(player_chunk_z - radius, batch_chunks); bz <= to_batch_coordinate(player_chunk_z + radius, batch_chunks); bz++) {
+            if (built == MAX_BATCH_BUILDS_PER_FRAME)
+                return;
+            const Int2 batch = { bx, bz };
+            if (batches.contains(batch) || !batch_members(batch, members))
+                continue;
+            batches[batch] = { std::make_unique<ChunkVoxels>(device, members, batch_chunks), members };
+            built++;
+        }
+    }
+}
+
+void GameVoxels::renderFrame() {
     if (reload_shaders) {
         vkDeviceWaitIdle(device.device);
         const std::vector<std::string> shaderFiles = {
@@ -53,6 +251,8 @@ void GameVoxels::renderFrame() {
         textureManager.onShaderReload(*shaders.pipeline);
         reload_shaders = false;
         textureManager.m_blockTextures->bindHelper->set_combined_image_sampler(0, 0, *textureManager.m_blockTextures->textures, sampler.sampler);
+        if (splatter)
+            splatter->reload_shaders();
         std::cout << "Vertex shader: " << shaderFiles[0] << std::endl;
         std::cout << "Pixel shader: " << shaderFiles[1] << std::endl;
     }
@@ -61,6 +261,26 @@ void GameVoxels::renderFrame() {
         camera_update(window, &camera_input);
         camera_move_freelook(&camera, &camera_input, &camera_state, delta);
 
+        if (rebuild_voxels) {
+            for (auto chunk : world->loaded_chunks())
+                release_gpu_resources(chunk, context, RepresentationVoxels | RepresentationGreedyVoxels);
+            for (auto& [position, batch] : batches)
+                release_later(std::move(batch.voxels), context);
+            batches.clear();
+            rebuild_voxels = false;
+        }
+
+        record_gpu_meshing(context);
+
+        if (renderer == VoxelsSplatted64 && !atomic64) {
+            std::cout << "No 64 bit atomics on this GPU, splatting in two passes" << std::endl;
+            renderer = VoxelsSplatted;
+        }
+        if (renderer == VoxelsRasterized || (splatter && splatter->atomic64 != (renderer == VoxelsSplatted64)))
+            release_later(std::move(splatter), context);
+        if (renderer != VoxelsRasterized && !splatter)
+            splatter = std::make_unique<VoxelSplatter>(device, swapchain, textureManager, sampler, renderer == VoxelsSplatted64);
+
         auto& image = context.image();
         auto cmdbuf = context.cmdbuf();
 
@@ -130,6 +350,9 @@ void GameVoxels::renderFrame() {
         push_constants.camera_position = camera.position;
         push_constants.screen_size = vec2(context.image().size().width, context.image().size().height);
         push_constants.textures = texturesEnabled;
+        push_constants.time = (float) ((imr_get_time_nano() - start_time) / 1000L) / 1000000.0f;
+        update_pixels_per_block(context.image().size().height);
+        vkCmdPushConstants(cmdbuf, pipeline->layout(), VK_SHADER_STAGE_VERTEX_BIT, 0, PER_FRAME_PUSH_CONSTANTS, &push_constants);
 
         context.frame().withRenderTargets(cmdbuf, { &image }, &*depthBuffer, [&]{
 
@@ -137,69 +360,202 @@ void GameVoxels::renderFrame() {
                 Chunk* loaded = world->get_loaded_chunk(cx, cz);
                 if (!loaded)
                     world->load_chunk(cx, cz);
-                else {
-                    if (loaded->voxels) return;
-
-                    bool all_neighbours_loaded = true;
-                    ChunkNeighbors n = {};
-                    for (int dx = -1; dx < 2; dx++) {
-                        for (int dz = -1; dz < 2; dz++) {
-                            const int nx = cx + dx;
-                            const int nz = cz + dz;
-
-                            const auto neighborChunk = world->get_loaded_chunk(nx, nz);
-                            if (neighborChunk)
-                                n.neighbours[dx + 1][dz + 1] = &neighborChunk->data;
-                            else
-                                all_neighbours_loaded = false;
-                        }
+                else if (loaded->retained)
+                    world->reuse_chunk(loaded);
+            };
+
+            // the level of detail a chunk has voxels for, preferring `lod`; -1 if it has none
+            auto built_lod = [&](Chunk* chunk, const int lod) {
+                if (chunk->voxels_for(greedyVoxels, lod))
+                    return lod;
+                for (int level = 0; level < VOXEL_LOD_COUNT; level++) {
+                    if (chunk->voxels_for(greedyVoxels, level))
+                        return level;
+                }
+                return -1;
+            };
+            // new voxels carry on with the loading animation of the ones they replace
+            auto spawn_time = [&](Chunk* chunk) {
+                const int level = built_lod(chunk, 0);
+                return level < 0 ? push_constants.time : chunk->voxels_for(greedyVoxels, level)->spawn_time;
+            };
+
+            // level 0 voxels for `chunk`, which replace all of its others
+            auto replace_voxels = [&](Chunk* chunk, std::unique_ptr<ChunkVoxels> voxels) {
+                voxels->spawn_time = spawn_time(chunk);
+                for (auto& cells : chunk->lod_voxels)
+                    release_later(std::move(cells), context);
+                // the batch with the old voxels gets merged again
+                if (greedyVoxels && batch_chunks > 0) {
+                    auto batch = batches.find({ to_batch_coordinate(chunk->cx, batch_chunks), to_batch_coordinate(chunk->cz, batch_chunks) });
+                    if (batch != batches.end()) {
+                        release_later(std::move(batch->second.voxels), context);
+                        batches.erase(batch);
+                    }
+                }
+                auto& current = chunk->voxels_for(greedyVoxels);
+                release_later(std::move(current), context);
+                current = std::move(voxels);
+            };
+
+            auto build_voxels = [&](const int cx, const int cz) {
+                Chunk* chunk = world->get_loaded_chunk(cx, cz);
+                // levels of detail above 0 don't depend on the neighbours, and replace the others once built
+                if (const int lod = voxel_lod(cx, cz); lod > 0) {
+                    auto& cells = chunk->voxels_for(greedyVoxels, lod);
+                    if (cells)
+                        return;
+                    const float spawned = spawn_time(chunk);
+                    cells = std::make_unique<ChunkVoxels>(device, chunk->data, lod, &world->mesh_cache, chunk->content_hash);
+                    cells->spawn_time = spawned;
+                    for (int other = 0; other < VOXEL_LOD_COUNT; other++) {
+                        if (other != lod)
+                            release_later(std::move(chunk->voxels_for(greedyVoxels, other)), context);
+                    }
+                    return;
+                }
+
+                auto& current = chunk->voxels_for(greedyVoxels);
+                constexpr uint8_t all_neighbours = (1 << SideCount) - 1;
+                if (current && current->neighbour_mask == all_neighbours)
+                    return;
+
+                ChunkNeighbors n = {};
+                for (int dx = -1; dx < 2; dx++) {
+                    for (int dz = -1; dz < 2; dz++) {
+                        const int nx = cx + dx;
+                        const int nz = cz + dz;
+
+                        const auto neighborChunk = world->get_loaded_chunk(nx, nz);
+                        if (neighborChunk)
+                            n.neighbours[dx + 1][dz + 1] = &neighborChunk->data;
                     }
-                    if (all_neighbours_loaded)
-                        loaded->voxels = std::make_unique<ChunkVoxels>(device, n, ivec2{cx, cz}, greedyVoxels, textureManager.m_idToIndex);
                 }
+
+                // missing neighbours are treated as solid, so we rebuild once more of them are loaded
+                const uint8_t mask = loaded_neighbours_mask(n);
+                if (current && (current->neighbour_mask | mask) == current->neighbour_mask)
+                    return;
+
+                // the GpuMesher hands the voxels out in a later frame, see replace_voxels
+                if (gpu_meshing && !greedyVoxels) {
+                    if (!gpu().queued(cx, cz, true))
+                        gpu().voxels(n, cx, cz);
+                    return;
+                }
+                replace_voxels(chunk, std::make_unique<ChunkVoxels>(device, n, greedyVoxels, &world->mesh_cache, chunk->content_hash, batch_chunks > 0));
+            };
+
+            // voxels from the GpuMesher, unless the chunk got voxels with as many neighbours or another level in the meantime
+            if (gpu_mesher) {
+                for (auto& built : gpu_mesher->take_voxels()) {
+                    Chunk* chunk = world->get_loaded_chunk(built.cx, built.cz);
+                    bool wanted = chunk && !greedyVoxels && voxel_lod(built.cx, built.cz) == 0;
+                    if (wanted) {
+                        const auto& current = chunk->voxels_for(false);
+                        wanted = !current || (current->neighbour_mask | built.voxels->neighbour_mask) != current->neighbour_mask;
+                    }
+                    if (!wanted) {
+                        release_later(std::move(built.voxels), context);
+                        continue;
+                    }
+                    replace_voxels(chunk, std::move(built.voxels));
+                }
+            }
+
+            auto draw_voxels = [&](const ChunkVoxels& voxels, const int cx, const int cz) {
+                // splatted after the loop, outside of rendering
+                if (splatter) {
+                    splatter->add(voxels, ivec2{ cx, cz });
+                    return;
+                }
+                push_constants.spawn_time = voxels.spawn_time;
+                push_constants.voxel_buffer = voxels.voxel_buffer_device_address();
+                push_constants.chunk_position = ivec2{ cx, cz };
+                vkCmdPushConstants(
+                    cmdbuf, pipeline->layout(), VK_SHADER_STAGE_VERTEX_BIT,
+                    PER_FRAME_PUSH_CONSTANTS, sizeof(push_constants) - PER_FRAME_PUSH_CONSTANTS, &push_constants.spawn_time);
+                if (voxels.indirect)
+                    vkCmdDrawIndirect(cmdbuf, voxels.indirect->handle, 0, 1, sizeof(VkDrawIndirectCommand));
+                else
+                    vkCmdDraw(cmdbuf, 6, voxels.num_voxels, 0, 0);
             };
 
             const int player_chunk_x = camera.position.x / 16;
             const int player_chunk_z = camera.position.z / 16;
 
-            constexpr int radius = RENDER_DISTANCE;
+            const int radius = settings.render_distance;
             for (int dx = -radius; dx <= radius; dx++) {
                 for (int dz = -radius; dz <= radius; dz++) {
-                    load_chunk(player_chunk_x + dx, player_chunk_z + dz);
+                    if (within_render_distance(dx, dz, radius))
+                        load_chunk(player_chunk_x + dx, player_chunk_z + dz);
+                }
+            }
+            for (int dx = -radius; dx <= radius; dx++) {
+                for (int dz = -radius; dz <= radius; dz++) {
+                    if (within_render_distance(dx, dz, radius))
+                        build_voxels(player_chunk_x + dx, player_chunk_z + dz);
                 }
             }
 
+             update_batches(context, player_chunk_x, player_chunk_z);
+
+             const int unload_radius = radius + UNLOAD_MARGIN;
+             size_t measured_bytes = 0, measured_chunks = 0;
+             std::fill(std::begin(frame_lod_chunks), std::end(frame_lod_chunks), 0);
              for (const auto chunk : world->loaded_chunks()) {
+                 if (chunk->retained)
+                     continue;
                  // unload
-                 if (abs(chunk->cx - player_chunk_x) > radius || abs(chunk->cz - player_chunk_z) > radius) {
-                     if (std::unique_ptr<ChunkVoxels> stolen = std::move(chunk->voxels)) {
-                         const ChunkVoxels* released = stolen.release();
-                         context.frame().addCleanupAction([=]{
-                             delete released;
-                         });
-                     }
-                     world->unload_chunk(chunk);
+                 if (!within_render_distance(chunk->cx - player_chunk_x, chunk->cz - player_chunk_z, unload_radius)) {
+                     retire_chunk(chunk, context);
                      continue;
                  }
 
-                 const auto& voxels = chunk->voxels;
-                 if (!voxels || voxels->num_voxels == 0)
+                 // until the level of detail it should have is built, the chunk is drawn with the one it has
+                 const int lod = built_lod(chunk, voxel_lod(chunk->cx, chunk->cz));
+                 if (lod < 0)
+                     continue;
+                 const auto& voxels = chunk->voxels_for(greedyVoxels, lod);
+                 measured_bytes += chunk->memory_footprint();
+                 measured_chunks++;
+                 frame_lod_chunks[lod]++;
+                 if (voxels->num_voxels == 0)
+                     continue;
+                 // drawn with the batch it was merged into
+                 if (!batches.empty() && batches.contains({ to_batch_coordinate(chunk->cx, batch_chunks), to_batch_coordinate(chunk->cz, batch_chunks) }))
                      continue;
 
-                 if (!greedyVoxels) {
-                    voxels->update(delta);
-                 }
-                 push_constants.rotation = voxels->rotation;
-                 push_constants.radius = voxels->radius;
-                 push_constants.height_adjust = voxels->height_adjust;
-                 push_constants.voxel_buffer = voxels->voxel_buffer_device_address();
-                 vkCmdPushConstants(
-                     cmdbuf, pipeline->layout(), VK_SHADER_STAGE_VERTEX_BIT,
-                     0, sizeof(push_constants), &push_constants);
-                 vkCmdDraw(cmdbuf, 6, voxels->num_voxels, 0, 0);
+                 draw_voxels(*voxels, chunk->cx, chunk->cz);
+             }
+             for (const auto& [position, batch] : batches) {
+                 measured_bytes += batch.voxels->buffer_size;
+                 if (batch.voxels->num_voxels > 0)
+                     draw_voxels(*batch.voxels, position.x * batch_chunks, position.z * batch_chunks);
              }
+
+             evict_cached_chunks(context);
+             trim_inactive_representations(context, player_chunk_x, player_chunk_z);
+             adapt_render_distance(measured_bytes, measured_chunks);
         });
 
+        if (splatter) {
+            const VoxelSplatter::View view = {
+                .matrix = push_constants.matrix,
+                .inverse_matrix = push_constants.inverse_matrix,
+                .camera_position = push_constants.camera_position,
+                .time = push_constants.time,
+                .screen_size = push_constants.screen_size,
+                .greedy = greedyVoxels,
+                .textures = texturesEnabled,
+                .block_table = push_constants.block_table,
+            };
+            splatter->splat(context, view);
+            context.frame().withRenderTargets(cmdbuf, { &image }, &*depthBuffer, [&]{
+                splatter->resolve(cmdbuf, view);
+            });
+        }
+
         auto now = imr_get_time_nano();
         delta = ((float) ((now - prev_frame) / 1000L)) / 1000000.0f;
         prev_frame = now;
@@ -208,8 +564,19 @@ void GameVoxels::renderFrame() {
     });
 }
 
-GameMesh::GameMesh(imr::Device& device, GLFWwindow* window, imr::Swapchain& swapchain, World* world, Camera& camera)
-    : Game(device, window, swapchain, MeshShaders(device, swapchain), world, camera) {
+GameMesh::GameMesh(imr::Device& device, GLFWwindow* window, imr::Swapchain& swapchain, World* world, Camera& camera, ViewSettings& settings)
+    : Game(device, window, swapchain, MeshShaders(device, swapchain), world, camera, settings) {
+    quad_indices.reserve(device, 0);
+
+    static_assert(sizeof(block_colors[0]) == 3 * sizeof(float));
+    block_colors_buffer = std::make_unique<imr::Buffer>(device, sizeof(block_colors), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
+    block_colors_buffer->uploadDataSync(0, sizeof(block_colors), block_colors);
+    push_constants.block_colors = block_colors_buffer->device_address();
+    activate();
+}
+
+void GameMesh::activate() {
+    prev_frame = imr_get_time_nano();
     glfwSetWindowUserPointer(window, this);
 
     glfwSetKeyCallback(window, [](GLFWwindow* window, int key, int scancode, int action, int mods) {
@@ -218,10 +585,70 @@ GameMesh::GameMesh(imr::Device& device, GLFWwindow* window, imr::Swapchain& swap
             game->reload_shaders = true;
         } else if (key == GLFW_KEY_F10 && action == GLFW_PRESS) {
             game->toggleMode = true;
+        } else if (key == GLFW_KEY_F11 && action == GLFW_PRESS) {
+            game->mesh_format = game->mesh_format == MeshVertices ? MeshFaces : MeshVertices;
+            game->reload_shaders = true;
+            game->rebuild_meshes = true;
+            std::cout << (game->mesh_format == MeshFaces ? "Pulling faces in the vertex shader" : "Using vertex buffers") << std::endl;
+        } else if (key == GLFW_KEY_F4 && action == GLFW_PRESS) {
+            game->world->print_cache_stats();
+            std::cout << "Last frame drew " << game->frame_drawn_verts << " of " << game->frame_mesh_verts << " mesh vertices ("
+                      << 100.0 * game->frame_drawn_verts / std::max<size_t>(game->frame_mesh_verts, 1) << "%), skipping directions facing away" << std::endl;
+            std::cout << "Chunks per level of detail:";
+            for (int lod = 0; lod < MESH_LOD_COUNT; lod++)
+                std::cout << " " << game->frame_lod_chunks[lod] << " at " << (1 << lod) << "x";
+            std::cout << std::endl;
+        } else if (key == GLFW_KEY_F5 && action == GLFW_PRESS) {
+            game->change_render_distance(-2);
+        } else if (key == GLFW_KEY_F6 && action == GLFW_PRESS) {
+            game->change_render_distance(2);
+        } else if (key == GLFW_KEY_F8 && action == GLFW_PRESS) {
+            game->gpu_meshing = !game->gpu_meshing;
+            game->rebuild_meshes = true;
+            std::cout << (game->gpu_meshing ? "Meshing on the GPU (levels of detail and borders are still meshed on the CPU)" : "Meshing on the CPU") << std::endl;
         }
     });
 }
 
+void Game::update_pixels_per_block(uint32_t height) {
+    // camera.fov is in degrees, like perspective_mat4() takes it
+    pixels_per_block = height / (2.0f * tanf(camera.fov * static_cast<float>(M_PI) / 360.0f));
+}
+
+int Game::chunk_lod(int cx, int cz, int lod_count, float cell_pixels, int current_lod) const {
+    // how far the closest point of the chunk is, with the half block offset meshes and voxels are drawn with
+    const float min_x = cx * CUNK_CHUNK_SIZE - 0.5f, min_z = cz * CUNK_CHUNK_SIZE - 0.5f;
+    const float dx = std::max({ min_x - camera.position.x, camera.position.x - (min_x + CUNK_CHUNK_SIZE), 0.0f });
+    const float dy = std::max({ -0.5f - camera.position.y, camera.position.y - (CUNK_CHUNK_MAX_HEIGHT - 0.5f), 0.0f });
+    const float dz = std::max({ min_z - camera.position.z, camera.position.z - (min_z + CUNK_CHUNK_SIZE), 0.0f });
+    const float distance = sqrtf(dx * dx + dy * dy + dz * dz);
+
+    auto coarsest = [&](float pixels) {
+        int lod = 0;
+        while (lod + 1 < lod_count && (1 << (lod + 1)) * pixels_per_block <= pixels * distance)
+            lod++;
+        return lod;
+    };
+    const int lod = coarsest(cell_pixels);
+    if (current_lod < 0 || lod == current_lod)
+        return lod;
+    // coarser once the coarser cells are smaller than the threshold by the margin, finer once the current cells are bigger
+    if (lod > current_lod)
+        return std::max(current_lod, coarsest(cell_pixels / (1.0f + LOD_HYSTERESIS)));
+    return std::min(current_lod, coarsest(cell_pixels * (1.0f + LOD_HYSTERESIS)));
+}
+
+int GameMesh::chunk_lod(int cx, int cz) const {
+    int current_lod = -1;
+    if (const Chunk* chunk = world->get_loaded_chunk(cx, cz)) {
+        for (int level = MESH_LOD_COUNT - 1; level >= 0; level--) {
+            if (chunk->meshes[level])
+                current_lod = level;
+        }
+    }
+    return Game::chunk_lod(cx, cz, MESH_LOD_COUNT, LOD_CELL_PIXELS, current_lod);
+}
+
 void GameMesh::renderFrame() {
     swapchain.renderFrameSimplified([&](imr::Swapchain::SimplifiedRenderContext& context) {
         camera_update(window, &camera_input);
@@ -229,9 +656,30 @@ void GameMesh::renderFrame() {
 
         if (reload_shaders) {
             swapchain.drain();
-            shaders = MeshShaders(device, swapchain);
+            shaders = MeshShaders(device, swapchain, mesh_format);
             reload_shaders = false;
         }
+        if (rebuild_meshes) {
+            for (auto chunk : world->loaded_chunks())
+                release_gpu_resources(chunk, context, RepresentationMesh);
+            rebuild_meshes = false;
+        }
+
+        // meshes from the GpuMesher replace the levels of detail drawn while they were on their way,
+        // unless the chunk got another mesh or level in the meantime
+        record_gpu_meshing(context);
+        if (gpu_mesher) {
+            for (auto& built : gpu_mesher->take_meshes()) {
+                Chunk* chunk = world->get_loaded_chunk(built.cx, built.cz);
+                if (!chunk || chunk->meshes[0] || built.mesh->format != mesh_format || chunk_lod(built.cx, built.cz) > 0) {
+                    release_later(std::move(built.mesh), context);
+                    continue;
+                }
+                chunk->meshes[0] = std::move(built.mesh);
+                for (int other = 1; other < MESH_LOD_COUNT; other++)
+                    release_later(std::move(chunk->meshes[other]), context);
+            }
+        }
 
         auto& image = context.image();
         auto cmdbuf = context.cmdbuf();
@@ -292,78 +740,372 @@ void GameMesh::renderFrame() {
         mat4 view_mat = camera_get_view_mat4(&camera, context.image().size().width, context.image().size().height);
         m = m * view_mat;
         m = m * translate_mat4(vec3(-0.5, -0.5f, -0.5f));
+        update_pixels_per_block(context.image().size().height);
 
         auto& pipeline = shaders.pipeline;
         vkCmdBindPipeline(cmdbuf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->pipeline());
 
         push_constants.time = ((imr_get_time_nano() / 1000) % 10000000000) / 1000000.0f;
 
-        context.frame().withRenderTargets(cmdbuf, { &image }, &*depthBuffer, [&]() {
-            push_constants.matrix = m;
-
-            auto load_chunk = [&](int cx, int cz) {
-                auto loaded = world->get_loaded_chunk(cx, cz);
-                if (!loaded)
-                    world->load_chunk(cx, cz);
-                else {
-                    if (loaded->mesh)
-                        return;
+        auto load_chunk = [&](int cx, int cz) {
+            auto loaded = world->get_loaded_chunk(cx, cz);
+            if (!loaded)
+                world->load_chunk(cx, cz);
+            else if (loaded->retained)
+                world->reuse_chunk(loaded);
+        };
 
-                    bool all_neighbours_loaded = true;
-                    ChunkNeighbors n = {};
-                    for (int dx = -1; dx < 2; dx++) {
-                        for (int dz = -1; dz < 2; dz++) {
-                            int nx = cx + dx;
-                            int nz = cz + dz;
-
-                            auto neighborChunk = world->get_loaded_chunk(nx, nz);
-                            if (neighborChunk)
-                                n.neighbours[dx + 1][dz + 1] = &neighborChunk->data;
-                            else
-                                all_neighbours_loaded = false;
-                        }
-                    }
-                    if (all_neighbours_loaded)
-                        loaded->mesh = std::make_unique<ChunkMesh>(device, n);
+        auto build_mesh = [&](int cx, int cz) {
+            auto chunk = world->get_loaded_chunk(cx, cz);
+            const int lod = chunk_lod(cx, cz);
+            auto& mesh = chunk->meshes[lod];
+            if (!mesh) {
+                // the GpuMesher hands the mesh out in a later frame, the chunk keeps its other levels until then
+                if (gpu_meshing && lod == 0) {
+                    if (!gpu().queued(cx, cz, false))
+                        gpu().mesh(chunk->data, cx, cz, mesh_format);
+                    return;
                 }
-            };
+                mesh = std::make_unique<ChunkMesh>(device, chunk->data, mesh_format, lod, &world->mesh_cache, chunk->content_hash);
+                for (int other = 0; other < MESH_LOD_COUNT; other++) {
+                    if (other != lod)
+                        release_later(std::move(chunk->meshes[other]), context);
+                }
+            }
+            if (lod > 0)
+                return;
 
-            int player_chunk_x = camera.position.x / 16;
-            int player_chunk_z = camera.position.z / 16;
+            // the edges facing a neighbour are meshed once that neighbour is loaded
+            for (int side = 0; side < SideCount; side++) {
+                const int neighbour_x = cx + side_dx[side], neighbour_z = cz + side_dz[side];
+                auto neighborChunk = world->get_loaded_chunk(neighbour_x, neighbour_z);
+                if (!neighborChunk)
+                    continue;
+                if (!mesh->has_border[side])
+                    mesh->mesh_border(device, chunk->data, neighborChunk->data, static_cast<ChunkSide>(side));
+                if (!mesh->has_skirt[side] && chunk_lod(neighbour_x, neighbour_z) > 0)
+                    mesh->mesh_skirt(device, chunk->data, static_cast<ChunkSide>(side));
+            }
+        };
 
-            int radius = RENDER_DISTANCE;
-            for (int dx = -radius; dx <= radius; dx++) {
-                for (int dz = -radius; dz <= radius; dz++) {
+        int player_chunk_x = camera.position.x / 16;
+        int player_chunk_z = camera.position.z / 16;
+
+        int radius = settings.render_distance;
+        for (int dx = -radius; dx <= radius; dx++) {
+            for (int dz = -radius; dz <= radius; dz++) {
+                if (within_render_distance(dx, dz, radius))
                     load_chunk(player_chunk_x + dx, player_chunk_z + dz);
-                }
             }
+        }
+        for (int dx = -radius; dx <= radius; dx++) {
+            for (int dz = -radius; dz <= radius; dz++) {
+                if (within_render_distance(dx, dz, radius))
+                    build_mesh(player_chunk_x + dx, player_chunk_z + dz);
+            }
+        }
+
+        // the index buffer has to cover the largest part drawn this frame, and can only grow outside the render pass
+        size_t max_quads = 0;
+        for (auto chunk : world->loaded_chunks()) {
+            for (const auto& mesh : chunk->meshes) {
+                if (!mesh)
+                    continue;
+                max_quads = std::max(max_quads, mesh->core.num_verts / 4);
+                for (int side = 0; side < SideCount; side++)
+                    max_quads = std::max({ max_quads, mesh->borders[side].num_verts / 4, mesh->skirts[side].num_verts / 4 });
+            }
+        }
+        release_later(quad_indices.reserve(device, max_quads), context);
+
+        context.frame().withRenderTargets(cmdbuf, { &image }, &*depthBuffer, [&]() {
+            push_constants.matrix = m;
+            vkCmdBindIndexBuffer(cmdbuf, quad_indices.buf->handle, 0, VK_INDEX_TYPE_UINT32);
 
+            int unload_radius = radius + UNLOAD_MARGIN;
+            size_t measured_bytes = 0, measured_chunks = 0;
+            frame_drawn_verts = frame_mesh_verts = 0;
+            std::fill(std::begin(frame_lod_chunks), std::end(frame_lod_chunks), 0);
             for (auto chunk : world->loaded_chunks()) {
-                if (abs(chunk->cx - player_chunk_x) > radius || abs(chunk->cz - player_chunk_z) > radius) {
-                    std::unique_ptr<ChunkMesh> stolen = std::move(chunk->mesh);
-                    if (stolen) {
-                        ChunkMesh* released = stolen.release();
-                        context.frame().addCleanupAction([=]() {
-                            delete released;
-                        });
-                    }
-                    world->unload_chunk(chunk);
+                if (chunk->retained)
+                    continue;
+                if (!within_render_distance(chunk->cx - player_chunk_x, chunk->cz - player_chunk_z, unload_radius)) {
+                    retire_chunk(chunk, context);
                     continue;
                 }
 
-                auto& mesh = chunk->mesh;
-                if (!mesh || mesh->num_verts == 0)
+                const int lod = chunk_lod(chunk->cx, chunk->cz);
+                const ChunkMesh* mesh = chunk->meshes[lod].get();
+                // chunks outside the render distance don't get meshed anymore, they keep the level they had
+                for (int level = 0; !mesh && level < MESH_LOD_COUNT; level++)
+                    mesh = chunk->meshes[level].get();
+                if (!mesh)
                     continue;
+                measured_bytes += chunk->memory_footprint();
+                measured_chunks++;
+                frame_lod_chunks[mesh->lod]++;
 
                 push_constants.chunk_position = { chunk->cx, 0, chunk->cz };
-                vkCmdPushConstants(cmdbuf, pipeline->layout(), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(push_constants), &push_constants);
+                const uint8_t facing = facing_directions(camera.position, chunk->cx, chunk->cz);
+
+                // makes `part` the one the next draws read from
+                auto bind_part = [&](const ChunkMesh::Part& part) {
+                    if (mesh->format == MeshFaces)
+                        push_constants.faces = part.buf->device_address();
+                    else
+                        vkCmdBindVertexBuffers(cmdbuf, 0, 1, &part.buf->handle, tmpPtr((VkDeviceSize) 0));
+                    vkCmdPushConstants(cmdbuf, pipeline->layout(), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(push_constants), &push_constants);
+                };
+
+                // draws the vertices [first_vert, first_vert + num_verts) of a part
+                auto draw_part = [&](const ChunkMesh::Part& part, size_t first_vert, size_t num_verts) {
+                    if (num_verts == 0)
+                        return;
+                    bind_part(part);
+                    // the indices of quad q refer to its vertices 4q to 4q + 3, so a range of quads starts at index 6q
+                    vkCmdDrawIndexed(cmdbuf, num_verts / 4 * 6, 1, first_vert / 4 * 6, 0, 0);
+                    frame_drawn_verts += num_verts;
+                };
+
+                if (mesh->indirect) {
+                    // the GPU wrote the ranges of the directions into the draw commands, how much they draw isn't known here
+                    frame_mesh_verts += mesh->core.num_verts;
+                    if (mesh->core.num_verts > 0) {
+                        bind_part(mesh->core);
+                        for (int direction = 0; direction < FaceCount; direction++) {
+                            if (facing & (1 << direction))
+                                vkCmdDrawIndexedIndirect(cmdbuf, mesh->indirect->handle, direction * sizeof(VkDrawIndexedIndirectCommand), 1, sizeof(VkDrawIndexedIndirectCommand));
+                        }
+                    }
+                } else {
+                    // adjacent directions that both face the camera are drawn together
+                    size_t first_vert = 0, num_verts = 0;
+                    for (int direction = 0; direction < FaceCount; direction++) {
+                        const size_t verts = mesh->direction_verts(static_cast<FaceDirection>(direction));
+                        frame_mesh_verts += verts;
+                        if (!(facing & (1 << direction)) || verts == 0)
+                            continue;
+                        const size_t first = mesh->direction_first_vert(static_cast<FaceDirection>(direction));
+                        if (num_verts > 0 && first_vert + num_verts != first) {
+                            draw_part(mesh->core, first_vert, num_verts);
+                            num_verts = 0;
+                        }
+                        if (num_verts == 0)
+                            first_vert = first;
+                        num_verts += verts;
+                    }
+                    draw_part(mesh->core, first_vert, num_verts);
+                }
+
+                for (int side = 0; side < SideCount; side++) {
+                    // next to a coarser chunk, the border could show the sky through the gaps between the two surfaces
+                    const bool coarser_neighbour = mesh->has_skirt[side] && chunk_lod(chunk->cx + side_dx[side], chunk->cz + side_dz[side]) > mesh->lod;
+                    const auto& edge = coarser_neighbour ? mesh->skirts[side] : mesh->borders[side];
+                    frame_mesh_verts += edge.num_verts;
+                    if (facing & (1 << side))
+                        draw_part(edge, 0, edge.num_verts);
+                }
+            }
+
+            evict_cached_chunks(context);
+            trim_inactive_representations(context, player_chunk_x, player_chunk_z);
+            adapt_render_distance(measured_bytes, measured_chunks);
+        });
+
+        auto now = imr_get_time_nano();
+        delta = ((float) ((now - prev_frame) / 1000L)) / 1000000.0f;
+        prev_frame = now;
+
+        glfwPollEvents();
+    });
+}
+
+GameBricks::GameBricks(imr::Device& device, GLFWwindow* window, imr::Swapchain& swapchain, World* world, Camera& camera, ViewSettings& settings)
+    : Game(device, window, swapchain, VoxelShaders(device, swapchain, { "raymarch.vert.spv", "raymarch.frag.spv" }), world, camera, settings) {
+    static_assert(offsetof(decltype(push_constants), grid) == 88 && sizeof(push_constants) == 120, "the push constants of raymarch.frag");
+    auto table = voxel_block_properties(textureManager.m_blockTable);
+    block_table = std::make_unique<imr::Buffer>(device, sizeof(table), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
+    block_table->uploadDataSync(0, sizeof(table), table.data());
+    // the render distance never gets bigger than this, so every chunk that is drawn has a column of its own
+    brick_map = std::make_unique<BrickMap>(device, MAX_RENDER_DISTANCE, BRICK_CAPACITY);
+    push_constants.block_table = block_table->device_address();
+    push_constants.grid = brick_map->grid->device_address();
+    push_constants.bricks = brick_map->bricks->device_address();
+    push_constants.grid_size = brick_map->grid_size;
+    activate();
+}
+
+void GameBricks::activate() {
+    prev_frame = imr_get_time_nano();
+    glfwSetWindowUserPointer(window, this);
+
+    glfwSetKeyCallback(window, [](GLFWwindow* window, int key, int scancode, int action, int mods) {
+        auto* game = static_cast<GameBricks*>(glfwGetWindowUserPointer(window));
+        if (key == GLFW_KEY_R && mods & GLFW_MOD_CONTROL) {
+            game->reload_shaders = true;
+        } else if (key == GLFW_KEY_F10 && action == GLFW_PRESS) {
+            game->toggleMode = true;
+        } else if (key == GLFW_KEY_F3 && action == GLFW_PRESS) {
+            game->texturesEnabled = !game->texturesEnabled;
+        } else if (key == GLFW_KEY_F4 && action == GLFW_PRESS) {
+            game->world->print_cache_stats();
+            const size_t used = game->brick_map->used_bricks();
+            std::cout << "Bricks: " << used << " of " << game->brick_map->capacity << " ("
+                      << used * sizeof(Brick) / (1024 * 1024) << " MiB)" << std::endl;
+        } else if (key == GLFW_KEY_F5 && action == GLFW_PRESS) {
+            game->change_render_distance(-2);
+        } else if (key == GLFW_KEY_F6 && action == GLFW_PRESS) {
+            game->change_render_distance(2);
+        }
+    });
+}
+
+void GameBricks::renderFrame() {
+    if (reload_shaders) {
+        vkDeviceWaitIdle(device.device);
+        shaders = VoxelShaders(device, swapchain, { "raymarch.vert.spv", "raymarch.frag.spv" });
+        textureManager.onShaderReload(*shaders.pipeline);
+        reload_shaders = false;
+        textureManager.m_blockTextures->bindHelper->set_combined_image_sampler(0, 0, *textureManager.m_blockTextures->textures, sampler.sampler);
+    }
+
+    swapchain.renderFrameSimplified([&](imr::Swapchain::SimplifiedRenderContext& context) {
+        camera_update(window, &camera_input);
+        camera_move_freelook(&camera, &camera_input, &camera_state, delta);
+
+        auto& image = context.image();
+        auto cmdbuf = context.cmdbuf();
+
+        textureManager.m_blockTextures->bindHelper->commit_frame(cmdbuf);
+
+        if (!depthBuffer || depthBuffer->size().width != context.image().size().width || depthBuffer->size().height != context.image().size().height) {
+            auto depthBufferFlags = static_cast<VkImageUsageFlagBits>(VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT);
+            depthBuffer = std::make_unique<imr::Image>(device, VK_IMAGE_TYPE_2D, context.image().size(), VK_FORMAT_D32_SFLOAT, depthBufferFlags);
 
-                vkCmdBindVertexBuffers(cmdbuf, 0, 1, &mesh->buf->handle, tmpPtr((VkDeviceSize) 0));
+            vk.cmdPipelineBarrier2KHR(cmdbuf, tmpPtr((VkDependencyInfo) {
+                .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+                .dependencyFlags = 0,
+                .imageMemoryBarrierCount = 1,
+                .pImageMemoryBarriers = tmpPtr((VkImageMemoryBarrier2) {
+                    .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+                    .srcStageMask = 0,
+                    .srcAccessMask = 0,
+                    .dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                    .dstAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT | VK_ACCESS_2_MEMORY_READ_BIT,
+                    .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+                    .newLayout = VK_IMAGE_LAYOUT_GENERAL,
+                    .image = depthBuffer->handle(),
+                    .subresourceRange = depthBuffer->whole_image_subresource_range()
+                })
+            }));
+        }
+
+        vk.cmdClearColorImage(cmdbuf, image.handle(), VK_IMAGE_LAYOUT_GENERAL, tmpPtr((VkClearColorValue) {
+            // blueish color for sky, where the rays hit nothing
+            .float32 = { 0.294f, 0.498f, 0.875f, 1.0f },
+        }), 1, tmpPtr(image.whole_image_subresource_range()));
+
+        vk.cmdClearDepthStencilImage(cmdbuf, depthBuffer->handle(), VK_IMAGE_LAYOUT_GENERAL, tmpPtr((VkClearDepthStencilValue) {
+            .depth = 1.0f,
+            .stencil = 0,
+        }), 1, tmpPtr(depthBuffer->whole_image_subresource_range()));
+
+        vk.cmdPipelineBarrier2KHR(cmdbuf, tmpPtr((VkDependencyInfo) {
+            .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+            .dependencyFlags = 0,
+            .memoryBarrierCount = 1,
+            .pMemoryBarriers = tmpPtr((VkMemoryBarrier2) {
+                .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+                .srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+                .srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                .dstStageMask = VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT,
+                .dstAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT | VK_ACCESS_2_MEMORY_READ_BIT,
+            })
+        }));
+
+        mat4 m = identity_mat4;
+        mat4 flip_y = identity_mat4;
+        flip_y.rows[1][1] = -1;
+        m = m * flip_y;
+        mat4 view_mat = camera_get_view_mat4(&camera, context.image().size().width, context.image().size().height);
+        m = m * view_mat;
+
+        const int player_chunk_x = camera.position.x / 16;
+        const int player_chunk_z = camera.position.z / 16;
+        const int radius = settings.render_distance;
+
+        push_constants.inverse_matrix = invert_mat4(m);
+        push_constants.camera_position = camera.position;
+        push_constants.textures = texturesEnabled;
+        push_constants.screen_size = vec2(context.image().size().width, context.image().size().height);
+        // to the edge of the render distance, plus the chunk the player is in
+        push_constants.max_distance = static_cast<float>((radius + 1) * CUNK_CHUNK_SIZE);
+
+        // chunks beyond the render distance may lose their columns to the ones coming in on the other side
+        brick_map->drop_outside(player_chunk_x, player_chunk_z, radius, context.frame());
 
-                assert(mesh->num_verts > 0);
-                vkCmdDraw(cmdbuf, mesh->num_verts, 1, 0, 0);
+        std::vector<Chunk*> missing;
+        for (int dx = -radius; dx <= radius; dx++) {
+            for (int dz = -radius; dz <= radius; dz++) {
+                if (!within_render_distance(dx, dz, radius))
+                    continue;
+                const int cx = player_chunk_x + dx, cz = player_chunk_z + dz;
+                Chunk* chunk = world->get_loaded_chunk(cx, cz);
+                if (!chunk)
+                    world->load_chunk(cx, cz);
+                else if (chunk->retained)
+                    world->reuse_chunk(chunk);
+                else if (!brick_map->has_chunk(cx, cz, chunk->content_hash))
+                    missing.push_back(chunk);
             }
+        }
+        // the closest chunks get their bricks first
+        auto distance = [&](const Chunk* chunk) {
+            const int dx = chunk->cx - player_chunk_x;
+            const int dz = chunk->cz - player_chunk_z;
+            return dx * dx + dz * dz;
+        };
+        std::sort(missing.begin(), missing.end(), [&](const Chunk* a, const Chunk* b) {
+            return distance(a) < distance(b);
         });
+        if (missing.size() > MAX_BRICK_CHUNKS_PER_FRAME)
+            missing.resize(MAX_BRICK_CHUNKS_PER_FRAME);
+        for (Chunk* chunk : missing) {
+            if (brick_map->set_chunk(*chunk, context.frame()))
+                continue;
+            if (!out_of_bricks)
+                std::cout << "Out of bricks, lower the render distance to see every chunk" << std::endl;
+            out_of_bricks = true;
+            break;
+        }
+        brick_map->record_uploads(cmdbuf, context.frame());
+
+        auto& pipeline = shaders.pipeline;
+        vkCmdBindPipeline(cmdbuf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->pipeline());
+        vkCmdPushConstants(cmdbuf, pipeline->layout(), VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(push_constants), &push_constants);
+
+        context.frame().withRenderTargets(cmdbuf, { &image }, &*depthBuffer, [&]() {
+            vkCmdDraw(cmdbuf, 3, 1, 0, 0);
+        });
+
+        const int unload_radius = radius + UNLOAD_MARGIN;
+        size_t measured_bytes = 0, measured_chunks = 0;
+        for (auto chunk : world->loaded_chunks()) {
+            if (chunk->retained)
+                continue;
+            if (!within_render_distance(chunk->cx - player_chunk_x, chunk->cz - player_chunk_z, unload_radius)) {
+                retire_chunk(chunk, context);
+                continue;
+            }
+            measured_bytes += chunk->memory_footprint();
+            measured_chunks++;
+        }
+        // the bricks are what this mode keeps on the GPU instead of meshes or voxels
+        measured_bytes += brick_map->used_bricks() * sizeof(Brick);
+
+        evict_cached_chunks(context);
+        trim_inactive_representations(context, player_chunk_x, player_chunk_z);
+        adapt_render_distance(measured_bytes, measured_chunks);
 
         auto now = imr_get_time_nano();
         delta = ((float) ((now - prev_frame) / 1000L)) / 1000000.0f;
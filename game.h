@@ -1,17 +1,64 @@
 #ifndef GAME_H
 #define GAME_H
+#include <cstddef>
 #include <iostream>
 #include <GLFW/glfw3.h>
 
 #include "camera.h"
 #include "world.h"
+#include "gpu_mesher.h"
 #include "shaders.h"
 #include "imr/util.h"
 #include "texture.hpp"
+#include "brick_map.h"
+#include "voxel_splat.h"
 
-constexpr size_t RENDER_DISTANCE = 16;
+constexpr int MIN_RENDER_DISTANCE = 4;
+constexpr int MAX_RENDER_DISTANCE = 64;
+/// chunks are only moved to the cache once they are this many chunks beyond the render distance,
+/// so flying back and forth across the edge does not reload them
+constexpr int UNLOAD_MARGIN = 2;
+/// per-chunk cost (decoded data plus GPU buffers) assumed until we have measured enough chunks
+constexpr size_t ESTIMATED_CHUNK_BYTES = 512 * 1024;
+/// how many chunks need to be measured before the automatic render distance trusts the measurement
+constexpr size_t CHUNK_COST_SAMPLES = 256;
+/// whether cached chunks keep their mesh/voxel buffers, trading VRAM for not rebuilding them
+constexpr bool RETAIN_GPU_BUFFERS = true;
+/// how many bytes of GPU buffers the render modes that aren't active may keep, so switching back is instant
+constexpr size_t INACTIVE_GPU_BUDGET = 512 * 1024 * 1024;
+/// how many batches of greedy voxels get merged per frame at most, so turning batching on doesn't stall a frame
+constexpr int MAX_BATCH_BUILDS_PER_FRAME = 2;
+/// how many chunks get their bricks uploaded per frame at most in brick mode, nearest first
+constexpr int MAX_BRICK_CHUNKS_PER_FRAME = 32;
+/// how many bricks brick mode has room for, 128 MiB of them
+constexpr size_t BRICK_CAPACITY = 128 * 1024 * 1024 / sizeof(Brick);
+/// mesh mode draws a chunk at the coarsest level of detail whose cells cover at most this many pixels on screen,
+/// and so do the voxel modes until F7 changes their threshold
+constexpr float LOD_CELL_PIXELS = 4.0f;
+/// a chunk only changes its level of detail once its cells are this much past LOD_CELL_PIXELS, so a camera moving
+/// back and forth around the threshold doesn't rebuild the chunk every frame
+constexpr float LOD_HYSTERESIS = 0.25f;
 using KeyCallback = void(*)(GLFWwindow*, int, int, int, int);
 
+/// View settings that outlive a single Game, so switching render modes keeps them.
+struct ViewSettings {
+    /// how much memory the loaded chunks may use, a quarter of what was available at startup
+    size_t memory_budget;
+    /// radius (in chunks) of the circle around the player that gets loaded and drawn
+    int render_distance;
+    /// while set, render_distance follows the memory budget and the measured per-chunk cost
+    bool auto_render_distance = true;
+
+    ViewSettings();
+
+    /// largest radius whose circle of chunks fits into the memory budget
+    int memory_scaled_render_distance(size_t chunk_bytes) const;
+};
+
+inline bool within_render_distance(int dx, int dz, int radius) {
+    return dx * dx + dz * dz <= radius * radius;
+}
+
 struct Game {
 protected:
     imr::Device& device;
@@ -22,66 +69,227 @@ protected:
     Shaders shaders;
     World* world;
     Camera& camera;
+    ViewSettings& settings;
     CameraFreelookState camera_state = {
         .fly_speed = 100.0f,
         .mouse_sensitivity = 1,
     };
     CameraInput camera_input = {};
     bool reload_shaders = false;
+    /// whether new meshes/voxels are built by the GpuMesher, toggled with F8
+    bool gpu_meshing = false;
+    std::unique_ptr<GpuMesher> gpu_mesher;
     uint64_t prev_frame = imr_get_time_nano();
     float delta = 0;
+    /// how many pixels a block one unit in front of the camera covers, updated every frame
+    float pixels_per_block = 1.0f;
 
-    Game(imr::Device& device, GLFWwindow* window, imr::Swapchain& swapchain, Shaders shaders, World* world, Camera& camera)
-        : device(device), window(window), swapchain(swapchain), shaders(std::move(shaders)), world(world), camera(camera)
+    Game(imr::Device& device, GLFWwindow* window, imr::Swapchain& swapchain, Shaders shaders, World* world, Camera& camera, ViewSettings& settings)
+        : device(device), window(window), swapchain(swapchain), shaders(std::move(shaders)), world(world), camera(camera), settings(settings)
     {}
 
+    /// shrinks or grows the render distance by `delta` chunks and stops adapting it automatically
+    void change_render_distance(int delta);
+    /// re-derives the automatic render distance from the measured cost of the chunks drawn this frame
+    void adapt_render_distance(size_t measured_bytes, size_t measured_chunks);
+
+    /// deletes a GPU resource once the frame that may still be using it has retired
+    template <typename T>
+    static void release_later(std::unique_ptr<T> resource, imr::Swapchain::SimplifiedRenderContext& context) {
+        if (const T* released = resource.release()) {
+            context.frame().addCleanupAction([=]{
+                delete released;
+            });
+        }
+    }
+    /// frees the given ChunkRepresentation bits of a chunk once the frame that may still be using them has retired.
+    /// A retained chunk stops counting them against the cache budget right away.
+    static void release_gpu_resources(Chunk* chunk, imr::Swapchain::SimplifiedRenderContext& context, uint8_t representations = RepresentationAll);
+    /// moves a chunk that left the unload radius into the world's cache
+    void retire_chunk(Chunk* chunk, imr::Swapchain::SimplifiedRenderContext& context);
+    /// trims the world's cache to its budget
+    void evict_cached_chunks(imr::Swapchain::SimplifiedRenderContext& context);
+    /// drops representations this mode doesn't draw, farthest chunks first, until they fit INACTIVE_GPU_BUDGET
+    void trim_inactive_representations(imr::Swapchain::SimplifiedRenderContext& context, int player_chunk_x, int player_chunk_z);
+
+    /// sets pixels_per_block for an image `height` pixels tall
+    void update_pixels_per_block(uint32_t height);
+    /// the coarsest of `lod_count` levels of detail whose cells cover at most `cell_pixels` pixels at the closest
+    /// point of the chunk; 0 if `cell_pixels` is. A chunk drawn at `current_lod` (-1 if none) keeps it until that is
+    /// off by LOD_HYSTERESIS.
+    int chunk_lod(int cx, int cz, int lod_count, float cell_pixels, int current_lod) const;
+
+    /// created the first time GPU meshing is turned on
+    GpuMesher& gpu() {
+        if (!gpu_mesher)
+            gpu_mesher = std::make_unique<GpuMesher>(device);
+        return *gpu_mesher;
+    }
+    /// records the work of the chunks queued on the GpuMesher into the frame, before rendering starts
+    void record_gpu_meshing(imr::Swapchain::SimplifiedRenderContext& context);
+
+    /// the ChunkRepresentation bits this mode draws
+    virtual uint8_t active_representation() const = 0;
+
 public:
     bool toggleMode = false;
     virtual ~Game() = default;
 
+    /// makes this the mode receiving window input; games stay alive while another mode is active
+    virtual void activate() = 0;
     virtual void renderFrame() = 0;
 };
 
 
+/// how GameVoxels draws its voxels, F12 switches between them
+enum VoxelRenderer {
+    /// a quad per voxel, ray traced in voxel.frag
+    VoxelsRasterized,
+    /// splatted by a VoxelSplatter, in two passes
+    VoxelsSplatted,
+    /// splatted by a VoxelSplatter with 64 bit atomics, in one pass, if the GPU has them
+    VoxelsSplatted64,
+};
+
 struct GameVoxels final : Game {
 private:
     Sampler sampler{device};
     TextureManager textureManager{device, *shaders.pipeline, sampler};
-    bool toggleGreedy = false;
     int debugShader = 0;
     bool texturesEnabled = true;
+    /// set when the voxels have to be built again, after switching between CPU and GPU meshing
+    bool rebuild_voxels = false;
     std::vector<std::string> vertexShaders = { "voxel.vert.spv", "greedyVoxel.vert.spv" };
     std::vector<std::string> fragmentShaders = {"voxel.frag.spv", "visualize_billboards.frag.spv", "outline_billboards.frag.spv"};
+    /// the VoxelBlockProperties of every BlockId, the voxels only hold block ids
+    std::unique_ptr<imr::Buffer> block_table;
+    /// created once the voxels get splatted, see VoxelRenderer
+    std::unique_ptr<VoxelSplatter> splatter;
+    /// push_constants.time counts the seconds since this
+    uint64_t start_time = imr_get_time_nano();
+    /// everything up to spawn_time is pushed once per frame, only the rest for every chunk
     struct {
         mat4 matrix;
         mat4 inverse_matrix;
         vec3 camera_position;
-        VkDeviceAddress voxel_buffer;
+        /// what the loading animation is played with, compared against ChunkVoxels::spawn_time
+        float time;
+        VkDeviceAddress block_table;
         vec2 screen_size;
         bool textures;
-        mat4 rotation;
-        float radius;
-        float height_adjust;
+        float spawn_time;
+        VkDeviceAddress voxel_buffer;
+        /// the voxels are relative to their chunk, at chunk_position * CUNK_CHUNK_SIZE
+        ivec2 chunk_position;
     } push_constants;
+    static constexpr uint32_t PER_FRAME_PUSH_CONSTANTS = offsetof(decltype(push_constants), spawn_time);
+    /// with greedy voxels, how many chunks along x and z get merged into one batch and drawn with one draw call;
+    /// 0 draws every chunk on its own. F9 switches between 0, 4 and MAX_BATCH_CHUNKS.
+    int batch_chunks = 0;
+    struct VoxelBatch {
+        std::unique_ptr<ChunkVoxels> voxels;
+        /// the greedy voxels of the chunks it was merged from, it is dropped once one of them is replaced
+        std::vector<const ChunkVoxels*> members;
+    };
+    /// by the coordinates of their first chunk divided by batch_chunks
+    std::unordered_map<Int2, VoxelBatch> batches;
+
+    /// the greedy voxels of the chunks of a batch, if they are all drawn, built with all of their neighbours and done
+    /// with their loading animation
+    bool batch_members(Int2 batch, std::vector<const ChunkVoxels*>& members);
+    /// drops the batches whose chunks changed and merges new ones within the render distance
+    void update_batches(imr::Swapchain::SimplifiedRenderContext& context, int player_chunk_x, int player_chunk_z);
+
+    /// chunks whose LodCells cells cover at most this many pixels are drawn with lod_chunk_voxels(), 0 turns that off.
+    /// F7 switches between 0, 1, 2, 4 and 8.
+    float lod_cell_pixels = LOD_CELL_PIXELS;
+    /// how many chunks were drawn at each level of detail last frame (printed with F4)
+    size_t frame_lod_chunks[VOXEL_LOD_COUNT] = {};
+
+    /// the level of detail to draw a chunk's voxels at
+    int voxel_lod(int cx, int cz) const;
+
+    uint8_t active_representation() const override {
+        return (greedyVoxels ? RepresentationGreedyVoxels : RepresentationVoxels) | RepresentationVoxelLods;
+    }
 
 public:
-    GameVoxels(imr::Device &device, GLFWwindow *window, imr::Swapchain &swapchain, World *world, Camera &camera, bool greedyVoxels);
+    GameVoxels(imr::Device &device, GLFWwindow *window, imr::Swapchain &swapchain, World *world, Camera &camera, ViewSettings &settings, bool greedyVoxels);
+    void activate() override;
     void renderFrame() override;
     bool greedyVoxels;
+    VoxelRenderer renderer = VoxelsRasterized;
+    /// whether the device was created with VoxelSplatter::require_atomic64(), VoxelsSplatted64 needs it
+    bool atomic64 = false;
 };
 
 struct GameMesh final : Game {
 private:
+    /// shared by the meshes of all chunks
+    QuadIndexBuffer quad_indices;
+    /// the color of each BlockId, looked up by the block id packed into every vertex
+    std::unique_ptr<imr::Buffer> block_colors_buffer;
+
+    MeshFormat mesh_format = MeshVertices;
+    /// set when mesh_format changed, so every mesh gets rebuilt in the new format
+    bool rebuild_meshes = false;
+    /// vertices in the meshes of the chunks drawn last frame, and how many of them were drawn
+    /// after skipping the directions facing away from the camera (printed with F4)
+    size_t frame_mesh_verts = 0, frame_drawn_verts = 0;
+    /// how many chunks were drawn at each level of detail last frame (printed with F4)
+    size_t frame_lod_chunks[MESH_LOD_COUNT] = {};
+
     struct {
         mat4 matrix;
         ivec3 chunk_position;
         float time;
+        VkDeviceAddress block_colors;
+        VkDeviceAddress faces;
     } push_constants;
 
+    uint8_t active_representation() const override { return RepresentationMesh; }
+    /// the level of detail to draw a chunk's mesh at
+    int chunk_lod(int cx, int cz) const;
+
 public:
-    GameMesh(imr::Device& device, GLFWwindow* window, imr::Swapchain& swapchain, World* world, Camera& camera);
+    GameMesh(imr::Device& device, GLFWwindow* window, imr::Swapchain& swapchain, World* world, Camera& camera, ViewSettings& settings);
+    void activate() override;
     void renderFrame() override;
 };
 
+/// draws the blocks around the player by marching a ray per pixel through a BrickMap of them (raymarch.frag),
+/// so no chunk needs a mesh or voxels
+struct GameBricks final : Game {
+private:
+    Sampler sampler{device};
+    TextureManager textureManager{device, *shaders.pipeline, sampler};
+    bool texturesEnabled = true;
+    /// the VoxelBlockProperties of every BlockId, like GameVoxels has
+    std::unique_ptr<imr::Buffer> block_table;
+    std::unique_ptr<BrickMap> brick_map;
+    /// set when the brick pool ran out, so that's only reported once
+    bool out_of_bricks = false;
+
+    /// raymarch.frag's push constants
+    struct {
+        mat4 inverse_matrix;
+        vec3 camera_position;
+        uint32_t textures;
+        vec2 screen_size;
+        VkDeviceAddress grid;
+        VkDeviceAddress bricks;
+        VkDeviceAddress block_table;
+        int32_t grid_size;
+        /// how far rays go, in blocks
+        float max_distance;
+    } push_constants;
+
+    uint8_t active_representation() const override { return 0; }
+
+public:
+    GameBricks(imr::Device& device, GLFWwindow* window, imr::Swapchain& swapchain, World* world, Camera& camera, ViewSettings& settings);
+    void activate() override;
+    void renderFrame() override;
+};
 
 #endif //GAME_H
\ No newline at end of file
@@ -0,0 +1,199 @@
+// Checks the GpuMesher against the CPU meshers, face for face, on chunks from a world. Needs no window,
+// so it also runs on a software implementation, e.g. VK_ICD_FILENAMES=.../lvp_icd.x86_64.json for lavapipe.
+// usage: gpu_mesh_check <world folder> [center chunk x] [center chunk z] [radius]
+
+#include "world.h"
+#include "padded_chunk.h"
+#include "gpu_mesher.h"
+#include "host_buffer.h"
+#include "imr/util.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <functional>
+#include <iostream>
+
+/// a host-visible copy of the first `size` bytes of `source`
+static std::unique_ptr<HostBuffer> read_back(imr::Device& device, imr::Buffer& source, size_t size) {
+    auto copy = std::make_unique<HostBuffer>(device, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+    device.executeCommandsSync([&](VkCommandBuffer cmdbuf) {
+        vkCmdCopyBuffer(cmdbuf, source.handle, copy->buffer, 1, tmpPtr((VkBufferCopy) { .srcOffset = 0, .dstOffset = 0, .size = size }));
+    });
+    return copy;
+}
+
+/// runs the chunks queued on `gpu` to the end: the count pass, then the emit pass once the counts are back
+static void finish(imr::Device& device, GpuMesher& gpu) {
+    for (int pass = 0; pass < 2; pass++) {
+        std::function<void()> retired;
+        device.executeCommandsSync([&](VkCommandBuffer cmdbuf) {
+            retired = gpu.record(cmdbuf);
+        });
+        retired();
+    }
+}
+
+/// the quads of a mesh as one record each, 4 words for MeshVertices and 1 for MeshFaces, sorted so the order doesn't matter
+static std::vector<std::array<uint32_t, 4>> sorted_quads(const uint8_t* data, size_t quads, MeshFormat format) {
+    std::vector<std::array<uint32_t, 4>> sorted(quads, { 0, 0, 0, 0 });
+    const size_t quad_bytes = mesh_quad_bytes(format);
+    for (size_t quad = 0; quad < quads; quad++)
+        memcpy(sorted[quad].data(), data + quad * quad_bytes, quad_bytes);
+    std::sort(sorted.begin(), sorted.end());
+    return sorted;
+}
+
+static FaceDirection quad_face(const std::array<uint32_t, 4>& quad, MeshFormat format) {
+    return format == MeshFaces ? ChunkMesh::Face { quad[0] }.face() : ChunkMesh::Vertex { quad[0] }.face();
+}
+
+static bool check_mesh(imr::Device& device, GpuMesher& gpu, const ChunkData& chunk, MeshFormat format, int cx, int cz) {
+    const char* name = format == MeshFaces ? "faces" : "vertices";
+    ChunkNeighbors n = {};
+    n.neighbours[1][1] = &chunk;
+    auto padded = std::make_unique<PaddedChunk>(n, BlockStone);
+    std::vector<uint8_t> cpu(padded->count_exposed_faces() * mesh_quad_bytes(format));
+    size_t cpu_verts = 0;
+    chunk_mesh(*padded, cpu.data(), &cpu_verts, format);
+
+    gpu.mesh(chunk, cx, cz, format);
+    finish(device, gpu);
+    auto built = gpu.take_meshes();
+    if (built.size() != 1 || gpu.queued(cx, cz, false)) {
+        std::cerr << "chunk " << cx << ", " << cz << " (" << name << "): " << built.size() << " meshes came back instead of 1" << std::endl;
+        return false;
+    }
+    auto& mesh = built[0].mesh;
+    if (mesh->core.num_verts != cpu_verts) {
+        std::cerr << "chunk " << cx << ", " << cz << " (" << name << "): GPU mesh has room for " << mesh->core.num_verts << " vertices, the CPU mesh has " << cpu_verts << std::endl;
+        return false;
+    }
+    if (cpu_verts == 0)
+        return true;
+
+    const size_t quads = cpu_verts / 4;
+    auto faces = read_back(device, *mesh->core.buf, quads * mesh_quad_bytes(format));
+    auto commands = read_back(device, *mesh->indirect, FaceCount * sizeof(VkDrawIndexedIndirectCommand));
+    if (sorted_quads(faces->data, quads, format) != sorted_quads(cpu.data(), quads, format)) {
+        std::cerr << "chunk " << cx << ", " << cz << " (" << name << "): GPU and CPU faces differ" << std::endl;
+        return false;
+    }
+
+    // every direction has to be one contiguous range with the right draw command
+    size_t first_quad = 0;
+    for (int direction = 0; direction < FaceCount; direction++) {
+        VkDrawIndexedIndirectCommand command;
+        memcpy(&command, commands->data + direction * sizeof(command), sizeof(command));
+        if (command.firstIndex != first_quad * 6 || command.indexCount % 6 != 0 || command.instanceCount != 1) {
+            std::cerr << "chunk " << cx << ", " << cz << " (" << name << "): bad draw command for direction " << direction << std::endl;
+            return false;
+        }
+        const size_t direction_quads = command.indexCount / 6;
+        auto range = sorted_quads(faces->data + first_quad * mesh_quad_bytes(format), direction_quads, format);
+        for (auto& quad : range) {
+            if (quad_face(quad, format) != direction) {
+                std::cerr << "chunk " << cx << ", " << cz << " (" << name << "): a face of direction " << quad_face(quad, format)
+                          << " is drawn with direction " << direction << std::endl;
+                return false;
+            }
+        }
+        first_quad += direction_quads;
+    }
+    if (first_quad != quads) {
+        std::cerr << "chunk " << cx << ", " << cz << " (" << name << "): the draw commands cover " << first_quad << " of " << quads << " faces" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+static bool check_voxels(imr::Device& device, GpuMesher& gpu, ChunkNeighbors& n, int cx, int cz) {
+    auto padded = std::make_unique<PaddedChunk>(n, BlockStone);
+    std::vector<uint8_t> cpu(padded->count_exposed_blocks() * sizeof(Voxel));
+    size_t cpu_voxels = 0;
+    chunk_voxels(*padded, cpu.data(), &cpu_voxels);
+
+    gpu.voxels(n, cx, cz);
+    finish(device, gpu);
+    auto built = gpu.take_voxels();
+    if (built.size() != 1 || gpu.queued(cx, cz, true)) {
+        std::cerr << "chunk " << cx << ", " << cz << ": " << built.size() << " voxel sets came back instead of 1" << std::endl;
+        return false;
+    }
+    auto& voxels = built[0].voxels;
+    if (voxels->num_voxels != cpu_voxels) {
+        std::cerr << "chunk " << cx << ", " << cz << ": " << voxels->num_voxels << " voxels counted on the GPU, " << cpu_voxels << " on the CPU" << std::endl;
+        return false;
+    }
+    if (cpu_voxels == 0)
+        return true;
+    auto command = read_back(device, *voxels->indirect, sizeof(VkDrawIndirectCommand));
+    VkDrawIndirectCommand draw;
+    memcpy(&draw, command->data, sizeof(draw));
+    if (draw.instanceCount != cpu_voxels || draw.vertexCount != 6) {
+        std::cerr << "chunk " << cx << ", " << cz << ": " << draw.instanceCount << " voxels on the GPU, " << cpu_voxels << " on the CPU" << std::endl;
+        return false;
+    }
+
+    auto gpu_voxels = read_back(device, *voxels->gpu_buffer, cpu_voxels * sizeof(Voxel));
+    auto sorted = [&](const uint8_t* data) {
+        std::vector<std::array<uint8_t, sizeof(Voxel)>> records(cpu_voxels);
+        for (size_t i = 0; i < cpu_voxels; i++)
+            memcpy(records[i].data(), data + i * sizeof(Voxel), sizeof(Voxel));
+        std::sort(records.begin(), records.end());
+        return records;
+    };
+    if (sorted(gpu_voxels->data) != sorted(cpu.data())) {
+        std::cerr << "chunk " << cx << ", " << cz << ": GPU and CPU voxels differ" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "usage: " << argv[0] << " <world folder> [center chunk x] [center chunk z] [radius]" << std::endl;
+        return 1;
+    }
+    const int center_x = argc > 2 ? std::stoi(argv[2]) : 0;
+    const int center_z = argc > 3 ? std::stoi(argv[3]) : 0;
+    const int radius = argc > 4 ? std::stoi(argv[4]) : 2;
+
+    imr::Context context;
+    imr::Device device(context);
+    GpuMesher gpu(device);
+
+    World world(argv[1]);
+    // one extra ring, so the voxels of every checked chunk see all of their neighbours
+    for (int cx = center_x - radius - 1; cx <= center_x + radius + 1; cx++)
+        for (int cz = center_z - radius - 1; cz <= center_z + radius + 1; cz++)
+            world.load_chunk(cx, cz);
+
+    size_t chunks = 0, failed = 0;
+    for (int cx = center_x - radius; cx <= center_x + radius; cx++) {
+        for (int cz = center_z - radius; cz <= center_z + radius; cz++) {
+            // chunks missing from the world are left out, missing neighbours count as solid on both sides
+            ChunkNeighbors n = {};
+            for (int dx = -1; dx < 2; dx++) {
+                for (int dz = -1; dz < 2; dz++) {
+                    if (Chunk* neighbour = world.get_loaded_chunk(cx + dx, cz + dz))
+                        n.neighbours[dx + 1][dz + 1] = &neighbour->data;
+                }
+            }
+            if (!n.neighbours[1][1]) {
+                std::cerr << "chunk " << cx << ", " << cz << " isn't in the world, skipped" << std::endl;
+                continue;
+            }
+            const ChunkData& chunk = *n.neighbours[1][1];
+
+            bool ok = check_mesh(device, gpu, chunk, MeshVertices, cx, cz);
+            ok = check_mesh(device, gpu, chunk, MeshFaces, cx, cz) && ok;
+            ok = check_voxels(device, gpu, n, cx, cz) && ok;
+            failed += !ok;
+            chunks++;
+        }
+    }
+
+    std::cout << chunks - failed << " of " << chunks << " chunks match" << std::endl;
+    return failed > 0;
+}
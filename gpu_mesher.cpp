@@ -0,0 +1,299 @@
+#include "gpu_mesher.h"
+
+#include "host_buffer.h"
+#include "imr/util.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <utility>
+
+/// mesh.comp's local_size_x
+constexpr uint32_t GROUP_SIZE = 256;
+constexpr uint32_t SECTION_BLOCKS = CUNK_CHUNK_SIZE * CUNK_CHUNK_SIZE * CUNK_CHUNK_SIZE;
+static_assert(SECTION_BLOCKS % GROUP_SIZE == 0);
+static_assert(sizeof(GpuMesher::Section) == SECTION_BLOCKS + SideCount * CUNK_CHUNK_SIZE * CUNK_CHUNK_SIZE, "mesh.comp's SECTION_BYTES");
+static_assert(offsetof(GpuMesher::UploadedChunk, sections) == CUNK_CHUNK_SECTIONS_COUNT * sizeof(int32_t), "mesh.comp reads the sections right after the slots");
+
+/// mesh.comp's Counters: the faces per direction (or the exposed blocks in the first one), then the cursors of each
+/// direction while emitting them
+constexpr size_t COUNTERS_SIZE = 2 * FaceCount * sizeof(uint32_t);
+/// how many queued chunks one record() starts counting at most, so a burst of new chunks is spread over a few frames
+constexpr size_t MAX_COUNTED_CHUNKS = 64;
+
+struct GpuMesher::Batch {
+    /// the packed chunks one after the other, see Job::blocks_offset
+    std::unique_ptr<imr::Buffer> blocks;
+    /// COUNTERS_SIZE per chunk, see Job::index
+    std::unique_ptr<imr::Buffer> counters;
+    /// the counters as they were after counting, readable once `counted` is set
+    std::unique_ptr<HostBuffer> counts;
+    /// set when the frame that counted them has retired
+    bool counted = false;
+};
+
+GpuMesher::GpuMesher(imr::Device& device) : device(device) {
+    module = std::make_unique<imr::ShaderModule>(device, "mesh.comp.spv");
+    entry_point = std::make_unique<imr::ShaderEntryPoint>(*module, VK_SHADER_STAGE_COMPUTE_BIT, "main");
+    pipeline = std::make_unique<imr::ComputePipeline>(device, *entry_point);
+}
+
+GpuMesher::~GpuMesher() = default;
+
+/// the block at x, z of section `section` of a neighbour, which is solid when it isn't loaded
+static uint8_t neighbour_block(const ChunkData* chunk, int section, int x, int y, int z) {
+    if (!chunk)
+        return BlockStone;
+    const ChunkSection* s = chunk->sections[section];
+    return s ? static_cast<uint8_t>(s->block_data[y][z][x]) : BlockAir;
+}
+
+uint32_t GpuMesher::pack(const ChunkNeighbors& neighbors, UploadedChunk& chunk) {
+    static_assert(BlockAir == 0);
+    const ChunkData* center = neighbors.neighbours[1][1];
+    constexpr int last = CUNK_CHUNK_SIZE - 1;
+    uint32_t slot = 0;
+    for (int section = 0; section < CUNK_CHUNK_SECTIONS_COUNT; section++) {
+        chunk.slots[section] = -1;
+        const ChunkSection* blocks = center->sections[section];
+        if (!blocks)
+            continue;
+        Section& s = chunk.sections[slot];
+        bool occupied = false;
+        for (int y = 0; y < CUNK_CHUNK_SIZE; y++) {
+            for (int z = 0; z < CUNK_CHUNK_SIZE; z++) {
+                for (int x = 0; x < CUNK_CHUNK_SIZE; x++) {
+                    s.blocks[y][z][x] = static_cast<uint8_t>(blocks->block_data[y][z][x]);
+                    occupied |= s.blocks[y][z][x] != BlockAir;
+                }
+            }
+        }
+        // sections that are all air take no slot, like PaddedChunk::empty_section
+        if (!occupied)
+            continue;
+        for (int y = 0; y < CUNK_CHUNK_SIZE; y++) {
+            for (int i = 0; i < CUNK_CHUNK_SIZE; i++) {
+                s.edges[SideMinusX][y][i] = neighbour_block(neighbors.neighbours[0][1], section, last, y, i);
+                s.edges[SidePlusX][y][i] = neighbour_block(neighbors.neighbours[2][1], section, 0, y, i);
+                s.edges[SideMinusZ][y][i] = neighbour_block(neighbors.neighbours[1][0], section, i, y, last);
+                s.edges[SidePlusZ][y][i] = neighbour_block(neighbors.neighbours[1][2], section, i, y, 0);
+            }
+        }
+        chunk.slots[section] = static_cast<int32_t>(slot++);
+    }
+    return slot;
+}
+
+size_t GpuMesher::packed_size(uint32_t sections) {
+    return offsetof(UploadedChunk, sections) + sections * sizeof(Section);
+}
+
+void GpuMesher::queue(const ChunkNeighbors& neighbors, Job job) {
+    job.sections = pack(neighbors, *staging);
+    // all air, there is nothing to do on the GPU
+    if (job.sections == 0) {
+        if (job.voxels)
+            built_voxels.push_back({ job.cx, job.cz, std::make_unique<ChunkVoxels>(job.neighbour_mask) });
+        else
+            built_meshes.push_back({ job.cx, job.cz, std::make_unique<ChunkMesh>(job.format) });
+        return;
+    }
+    const auto* packed = reinterpret_cast<const uint8_t*>(staging.get());
+    job.blocks.assign(packed, packed + packed_size(job.sections));
+    (job.voxels ? queued_voxels : queued_meshes).insert({ job.cx, job.cz });
+    jobs.push_back(std::move(job));
+}
+
+void GpuMesher::mesh(const ChunkData& chunk, int cx, int cz, MeshFormat format) {
+    // neighbours are treated as solid, like in the CPU meshed core
+    ChunkNeighbors n = {};
+    n.neighbours[1][1] = &chunk;
+    queue(n, { .cx = cx, .cz = cz, .voxels = false, .format = format, .neighbour_mask = 0 });
+}
+
+void GpuMesher::voxels(const ChunkNeighbors& neighbors, int cx, int cz) {
+    queue(neighbors, { .cx = cx, .cz = cz, .voxels = true, .format = MeshVertices, .neighbour_mask = loaded_neighbours_mask(neighbors) });
+}
+
+bool GpuMesher::queued(int cx, int cz, bool voxels) const {
+    return (voxels ? queued_voxels : queued_meshes).contains({ cx, cz });
+}
+
+std::vector<GpuMesher::BuiltMesh> GpuMesher::take_meshes() {
+    return std::exchange(built_meshes, {});
+}
+
+std::vector<GpuMesher::BuiltVoxels> GpuMesher::take_voxels() {
+    return std::exchange(built_voxels, {});
+}
+
+void GpuMesher::use_job(const Job& job) {
+    push_constants.blocks = job.batch->blocks->device_address() + job.blocks_offset;
+    push_constants.counters = job.batch->counters->device_address() + job.index * COUNTERS_SIZE;
+    push_constants.format = job.format;
+}
+
+void GpuMesher::dispatch(VkCommandBuffer cmdbuf, Mode mode, uint32_t groups) {
+    push_constants.mode = mode;
+    vkCmdPushConstants(cmdbuf, pipeline->layout(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
+    vkCmdDispatch(cmdbuf, groups, 1, 1);
+}
+
+void GpuMesher::barrier(VkCommandBuffer cmdbuf, VkPipelineStageFlags2 dst_stages, VkAccessFlags2 dst_access) {
+    device.dispatch.cmdPipelineBarrier2KHR(cmdbuf, tmpPtr((VkDependencyInfo) {
+        .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+        .dependencyFlags = 0,
+        .memoryBarrierCount = 1,
+        .pMemoryBarriers = tmpPtr((VkMemoryBarrier2) {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+            .srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+            .srcAccessMask = VK_ACCESS_2_SHADER_WRITE_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT,
+            .dstStageMask = dst_stages,
+            .dstAccessMask = dst_access,
+        })
+    }));
+}
+
+void GpuMesher::record_emit(VkCommandBuffer cmdbuf, std::vector<std::shared_ptr<Batch>>& in_use) {
+    auto counted = std::stable_partition(jobs.begin(), jobs.end(), [](const Job& job) {
+        return !job.batch || !job.batch->counted;
+    });
+    if (counted == jobs.end())
+        return;
+
+    // the outputs, sized with the counts, and the indirect commands of the voxels starting from 0 instances
+    struct Output {
+        VkDeviceAddress commands = 0, output = 0;
+    };
+    std::vector<Output> outputs(jobs.end() - counted);
+    bool any_faces = false, any_work = false;
+    for (auto job = counted; job != jobs.end(); job++) {
+        Output& out = outputs[job - counted];
+        uint32_t counts[FaceCount];
+        memcpy(counts, job->batch->counts->data + job->index * COUNTERS_SIZE, sizeof(counts));
+        (job->voxels ? queued_voxels : queued_meshes).erase({ job->cx, job->cz });
+
+        if (job->voxels) {
+            auto voxels = std::make_unique<ChunkVoxels>(job->neighbour_mask);
+            voxels->num_voxels = counts[0];
+            if (voxels->num_voxels > 0) {
+                voxels->buffer_size = voxels->num_voxels * sizeof(Voxel);
+                voxels->gpu_buffer = std::make_unique<imr::Buffer>(device, voxels->buffer_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+                VkDrawIndirectCommand command = { .vertexCount = 6, .instanceCount = 0, .firstVertex = 0, .firstInstance = 0 };
+                voxels->indirect = std::make_unique<imr::Buffer>(device, sizeof(command), VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+                vkCmdUpdateBuffer(cmdbuf, voxels->indirect->handle, 0, sizeof(command), &command);
+                voxels->buffer_size += sizeof(command);
+                out = { voxels->indirect->device_address(), voxels->gpu_buffer->device_address() };
+                any_work = true;
+            }
+            built_voxels.push_back({ job->cx, job->cz, std::move(voxels) });
+            continue;
+        }
+
+        auto mesh = std::make_unique<ChunkMesh>(job->format);
+        size_t faces = 0;
+        for (uint32_t count : counts)
+            faces += count;
+        if (faces > 0) {
+            mesh->core.num_verts = faces * 4;
+            mesh->buffer_size = faces * mesh_quad_bytes(job->format);
+            VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+            if (job->format == MeshVertices)
+                usage |= VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+            mesh->core.buf = std::make_unique<imr::Buffer>(device, mesh->buffer_size, usage);
+            mesh->indirect = std::make_unique<imr::Buffer>(device, FaceCount * sizeof(VkDrawIndexedIndirectCommand), VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+            mesh->buffer_size += FaceCount * sizeof(VkDrawIndexedIndirectCommand);
+            out = { mesh->indirect->device_address(), mesh->core.buf->device_address() };
+            any_faces = any_work = true;
+        }
+        built_meshes.push_back({ job->cx, job->cz, std::move(mesh) });
+    }
+
+    if (any_work) {
+        vkCmdBindPipeline(cmdbuf, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline->pipeline());
+        barrier(cmdbuf, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT);
+        if (any_faces) {
+            for (auto job = counted; job != jobs.end(); job++) {
+                const Output& out = outputs[job - counted];
+                if (job->voxels || !out.output)
+                    continue;
+                use_job(*job);
+                push_constants.commands = out.commands;
+                push_constants.output = out.output;
+                dispatch(cmdbuf, ModePlaceFaces, 1);
+            }
+            barrier(cmdbuf, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT);
+        }
+        for (auto job = counted; job != jobs.end(); job++) {
+            const Output& out = outputs[job - counted];
+            if (!out.output)
+                continue;
+            use_job(*job);
+            push_constants.commands = out.commands;
+            push_constants.output = out.output;
+            dispatch(cmdbuf, job->voxels ? ModeEmitVoxels : ModeEmitFaces, job->sections * SECTION_BLOCKS / GROUP_SIZE);
+        }
+        barrier(cmdbuf, VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT | VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+                VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_TRANSFER_READ_BIT);
+    }
+
+    // the emit passes still read the blocks and counters of their batches
+    for (auto job = counted; job != jobs.end(); job++) {
+        if (std::find(in_use.begin(), in_use.end(), job->batch) == in_use.end())
+            in_use.push_back(job->batch);
+    }
+    jobs.erase(counted, jobs.end());
+}
+
+std::shared_ptr<GpuMesher::Batch> GpuMesher::record_count(VkCommandBuffer cmdbuf, std::shared_ptr<void>& staging_buffer) {
+    std::vector<Job*> fresh;
+    size_t blocks_size = 0;
+    for (Job& job : jobs) {
+        if (job.batch || fresh.size() == MAX_COUNTED_CHUNKS)
+            continue;
+        job.blocks_offset = blocks_size;
+        job.index = fresh.size();
+        blocks_size += job.blocks.size();
+        fresh.push_back(&job);
+    }
+    if (fresh.empty())
+        return nullptr;
+
+    auto batch = std::make_shared<Batch>();
+    const size_t counters_size = fresh.size() * COUNTERS_SIZE;
+    batch->blocks = std::make_unique<imr::Buffer>(device, blocks_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
+    batch->counters = std::make_unique<imr::Buffer>(device, counters_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
+    batch->counts = std::make_unique<HostBuffer>(device, counters_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+    auto staged = std::make_shared<HostBuffer>(device, blocks_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+    for (Job* job : fresh) {
+        memcpy(staged->data + job->blocks_offset, job->blocks.data(), job->blocks.size());
+        std::vector<uint8_t>().swap(job->blocks);
+        job->batch = batch;
+    }
+    staging_buffer = staged;
+
+    vkCmdCopyBuffer(cmdbuf, staged->buffer, batch->blocks->handle, 1, tmpPtr((VkBufferCopy) { .srcOffset = 0, .dstOffset = 0, .size = blocks_size }));
+    vkCmdFillBuffer(cmdbuf, batch->counters->handle, 0, counters_size, 0);
+    barrier(cmdbuf, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT);
+    vkCmdBindPipeline(cmdbuf, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline->pipeline());
+    for (Job* job : fresh) {
+        use_job(*job);
+        dispatch(cmdbuf, job->voxels ? ModeCountVoxels : ModeCountFaces, job->sections * SECTION_BLOCKS / GROUP_SIZE);
+    }
+    barrier(cmdbuf, VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT);
+    vkCmdCopyBuffer(cmdbuf, batch->counters->handle, batch->counts->buffer, 1, tmpPtr((VkBufferCopy) { .srcOffset = 0, .dstOffset = 0, .size = counters_size }));
+    barrier(cmdbuf, VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_READ_BIT);
+    return batch;
+}
+
+std::function<void()> GpuMesher::record(VkCommandBuffer cmdbuf) {
+    // emitting first, the chunks counted below have to wait for this command buffer anyway
+    std::vector<std::shared_ptr<Batch>> in_use;
+    record_emit(cmdbuf, in_use);
+    std::shared_ptr<void> staged;
+    std::shared_ptr<Batch> counting = record_count(cmdbuf, staged);
+    return [in_use = std::move(in_use), staged = std::move(staged), counting = std::move(counting)] {
+        if (counting)
+            counting->counted = true;
+    };
+}
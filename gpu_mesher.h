@@ -0,0 +1,131 @@
+#ifndef SIGCRAFT_GPU_MESHER_H
+#define SIGCRAFT_GPU_MESHER_H
+
+#include "chunk_mesh.h"
+#include "voxel.h"
+#include "world.h"
+
+#include <functional>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * Meshes chunks in a compute shader (shaders/mesh.comp) instead of on the CPU.
+ * The CPU only copies the blocks of the non-empty sections plus the edges of the neighbours into a byte per block;
+ * one invocation per block then writes a face for every side that borders air, with the same results as
+ * chunk_mesh_section() and chunk_voxels_section(), just in another order.
+ * Nothing waits for the GPU: chunks get queued while drawing, and record() puts their work into the frame's command
+ * buffer before rendering starts. The first frame counts the faces or exposed blocks of the chunks on the GPU and
+ * copies the counts back; once that frame has retired, the next record() sizes the outputs exactly from them and
+ * emits the chunks, which are then handed out by take_meshes() and take_voxels() a few frames after they were queued.
+ * Every direction of a mesh gets a range of the buffer and a VkDrawIndexedIndirectCommand on the GPU.
+ * Voxels are appended with an atomic counter that is the instance count of a VkDrawIndirectCommand.
+ * Faces aren't merged, there is no greedy variant on the GPU yet.
+ */
+struct GpuMesher {
+    explicit GpuMesher(imr::Device& device);
+    GpuMesher(const GpuMesher&) = delete;
+    ~GpuMesher();
+
+    /// queues the core of a level 0 ChunkMesh for chunk cx, cz; borders are meshed on the CPU as usual.
+    /// The mesh has an `indirect` buffer.
+    void mesh(const ChunkData& chunk, int cx, int cz, MeshFormat format);
+    /// queues one Voxel per exposed block like chunk_voxels() for the chunk cx, cz in the center of `neighbors`,
+    /// missing neighbours are treated as solid. The voxels have an `indirect` buffer.
+    void voxels(const ChunkNeighbors& neighbors, int cx, int cz);
+    /// whether chunk cx, cz has a mesh or voxels queued that haven't been emitted yet
+    bool queued(int cx, int cz, bool voxels) const;
+
+    /// records the work of the queued chunks into `cmdbuf`, outside of a render pass. Returns what has to run once
+    /// the GPU is done with the command buffer, e.g. as a cleanup action of the frame.
+    std::function<void()> record(VkCommandBuffer cmdbuf);
+
+    struct BuiltMesh {
+        int cx, cz;
+        std::unique_ptr<ChunkMesh> mesh;
+    };
+    struct BuiltVoxels {
+        int cx, cz;
+        std::unique_ptr<ChunkVoxels> voxels;
+    };
+    /// the meshes and voxels emitted so far, which can be drawn after the record() that emitted them
+    std::vector<BuiltMesh> take_meshes();
+    std::vector<BuiltVoxels> take_voxels();
+
+    /// the blocks as they are uploaded: a byte per block for each section that isn't all air, see mesh.comp
+    struct Section {
+        uint8_t blocks[CUNK_CHUNK_SIZE][CUNK_CHUNK_SIZE][CUNK_CHUNK_SIZE];
+        /// the neighbouring blocks across each ChunkSide, indexed [y][x or z]
+        uint8_t edges[SideCount][CUNK_CHUNK_SIZE][CUNK_CHUNK_SIZE];
+    };
+    struct UploadedChunk {
+        /// where each section is in `sections`, -1 for sections that are all air
+        int32_t slots[CUNK_CHUNK_SECTIONS_COUNT];
+        Section sections[CUNK_CHUNK_SECTIONS_COUNT];
+    };
+
+    /// copies the chunk in the center of `neighbors` into `chunk`, missing neighbours are solid.
+    /// Returns how many sections are used, only the first packed_size() bytes of `chunk` get uploaded.
+    static uint32_t pack(const ChunkNeighbors& neighbors, UploadedChunk& chunk);
+    static size_t packed_size(uint32_t sections);
+
+    /// mesh.comp's MODE_ constants
+    enum Mode : uint32_t {
+        ModeCountFaces,
+        ModePlaceFaces,
+        ModeEmitFaces,
+        ModeEmitVoxels,
+        ModeCountVoxels,
+    };
+
+private:
+    /// the chunks counted by one record(), see gpu_mesher.cpp
+    struct Batch;
+
+    struct Job {
+        int cx, cz;
+        bool voxels;
+        MeshFormat format;
+        uint8_t neighbour_mask;
+        uint32_t sections;
+        /// the packed UploadedChunk, until it's copied to the GPU
+        std::vector<uint8_t> blocks;
+        /// where the chunk is in the batch it was counted in, once it was recorded
+        std::shared_ptr<Batch> batch;
+        size_t blocks_offset = 0;
+        uint32_t index = 0;
+    };
+
+    struct {
+        VkDeviceAddress blocks;
+        VkDeviceAddress counters;
+        VkDeviceAddress commands;
+        VkDeviceAddress output;
+        uint32_t mode;
+        uint32_t format;
+    } push_constants;
+
+    imr::Device& device;
+    std::unique_ptr<imr::ShaderModule> module;
+    std::unique_ptr<imr::ShaderEntryPoint> entry_point;
+    std::unique_ptr<imr::ComputePipeline> pipeline;
+    std::unique_ptr<UploadedChunk> staging = std::make_unique<UploadedChunk>();
+
+    std::vector<Job> jobs;
+    std::unordered_set<Int2> queued_meshes, queued_voxels;
+    std::vector<BuiltMesh> built_meshes;
+    std::vector<BuiltVoxels> built_voxels;
+
+    void queue(const ChunkNeighbors& neighbors, Job job);
+    /// sizes the outputs of the jobs whose counts are back and records their emit passes
+    void record_emit(VkCommandBuffer cmdbuf, std::vector<std::shared_ptr<Batch>>& in_use);
+    /// copies the blocks of the jobs that were just queued to the GPU and records their count pass
+    std::shared_ptr<Batch> record_count(VkCommandBuffer cmdbuf, std::shared_ptr<void>& staging_buffer);
+    void use_job(const Job& job);
+    void dispatch(VkCommandBuffer cmdbuf, Mode mode, uint32_t groups);
+    /// makes the writes of the previous commands visible to the commands after it
+    void barrier(VkCommandBuffer cmdbuf, VkPipelineStageFlags2 dst_stages, VkAccessFlags2 dst_access);
+};
+
+#endif
@@ -0,0 +1,57 @@
+#include "host_buffer.h"
+
+#include "imr/util.h"
+
+#include <stdexcept>
+#include <string>
+
+static void check(VkResult result, const char* what) {
+    if (result != VK_SUCCESS)
+        throw std::runtime_error(std::string("HostBuffer: ") + what + " failed with VkResult " + std::to_string(static_cast<int>(result)));
+}
+
+HostBuffer::HostBuffer(imr::Device& device, size_t size, VkBufferUsageFlags usage) : device(device), size(size) {
+    try {
+        check(vkCreateBuffer(device.device, tmpPtr((VkBufferCreateInfo) {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+            .size = size,
+            .usage = usage,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        }), nullptr, &buffer), "vkCreateBuffer");
+        VkMemoryRequirements requirements;
+        vkGetBufferMemoryRequirements(device.device, buffer, &requirements);
+        VkPhysicalDeviceMemoryProperties properties;
+        vkGetPhysicalDeviceMemoryProperties(device.physical_device, &properties);
+        constexpr VkMemoryPropertyFlags wanted = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        uint32_t type = 0;
+        while (type < properties.memoryTypeCount && (!(requirements.memoryTypeBits & (1u << type)) || (properties.memoryTypes[type].propertyFlags & wanted) != wanted))
+            type++;
+        if (type == properties.memoryTypeCount)
+            throw std::runtime_error("HostBuffer: no host-visible, coherent memory type for the buffer");
+        check(vkAllocateMemory(device.device, tmpPtr((VkMemoryAllocateInfo) {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+            .allocationSize = requirements.size,
+            .memoryTypeIndex = type,
+        }), nullptr, &memory), "vkAllocateMemory");
+        check(vkBindBufferMemory(device.device, buffer, memory, 0), "vkBindBufferMemory");
+        void* mapped;
+        check(vkMapMemory(device.device, memory, 0, size, 0, &mapped), "vkMapMemory");
+        data = static_cast<uint8_t*>(mapped);
+    } catch (...) {
+        release();
+        throw;
+    }
+}
+
+HostBuffer::~HostBuffer() {
+    release();
+}
+
+void HostBuffer::release() {
+    if (data)
+        vkUnmapMemory(device.device, memory);
+    if (buffer)
+        vkDestroyBuffer(device.device, buffer, nullptr);
+    if (memory)
+        vkFreeMemory(device.device, memory, nullptr);
+}
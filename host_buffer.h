@@ -0,0 +1,28 @@
+#ifndef SIGCRAFT_HOST_BUFFER_H
+#define SIGCRAFT_HOST_BUFFER_H
+
+#include "imr/imr.h"
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * A host-visible, coherent buffer that stays mapped, for copies between the CPU and device-local buffers.
+ * Throws std::runtime_error if the buffer can't be created, allocated or mapped.
+ */
+struct HostBuffer {
+    imr::Device& device;
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    uint8_t* data = nullptr;
+    size_t size;
+
+    HostBuffer(imr::Device& device, size_t size, VkBufferUsageFlags usage);
+    HostBuffer(const HostBuffer&) = delete;
+    ~HostBuffer();
+
+private:
+    void release();
+};
+
+#endif
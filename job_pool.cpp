@@ -0,0 +1,73 @@
+#include "job_pool.h"
+
+#include <algorithm>
+
+static thread_local bool is_pool_worker = false;
+
+JobPool::JobPool(unsigned num_workers) {
+    for (unsigned i = 0; i < num_workers; i++)
+        workers.emplace_back([this] { work(); });
+}
+
+JobPool::~JobPool() {
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers)
+        worker.join();
+}
+
+JobPool& JobPool::shared() {
+    static JobPool pool(std::max(std::thread::hardware_concurrency(), 1u) - 1);
+    return pool;
+}
+
+void JobPool::parallel_for(size_t count, const std::function<void(size_t)>& f) {
+    if (workers.empty() || count < 2 || is_pool_worker) {
+        for (size_t i = 0; i < count; i++)
+            f(i);
+        return;
+    }
+
+    std::lock_guard submit(submit_mutex);
+    {
+        std::lock_guard lock(mutex);
+        job = &f;
+        job_count = count;
+        next = 0;
+        finished = 0;
+        generation++;
+    }
+    wake.notify_all();
+    run_job();
+
+    // every worker has to be through with it before `f` goes out of scope or the next loop reuses the state
+    std::unique_lock lock(mutex);
+    done.wait(lock, [&] { return finished == workers.size(); });
+    job = nullptr;
+}
+
+void JobPool::run_job() {
+    for (size_t i = next++; i < job_count; i = next++)
+        (*job)(i);
+}
+
+void JobPool::work() {
+    is_pool_worker = true;
+    uint64_t seen = 0;
+    std::unique_lock lock(mutex);
+    while (true) {
+        wake.wait(lock, [&] { return stopping || generation != seen; });
+        if (stopping)
+            return;
+        seen = generation;
+
+        lock.unlock();
+        run_job();
+        lock.lock();
+        if (++finished == workers.size())
+            done.notify_one();
+    }
+}
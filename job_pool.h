@@ -0,0 +1,49 @@
+#ifndef SIGCRAFT_JOB_POOL_H
+#define SIGCRAFT_JOB_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * A fixed set of worker threads that loops get split between.
+ * One loop runs at a time; the calling thread works on it too and parallel_for() only returns once it's done.
+ * Loops started from inside a job just run on the thread that started them.
+ */
+class JobPool {
+public:
+    explicit JobPool(unsigned workers);
+    ~JobPool();
+
+    /// calls f(i) for every i in [0, count), in no particular order
+    void parallel_for(size_t count, const std::function<void(size_t)>& f);
+
+    /// shared by the meshers, with a worker for every hardware thread but the calling one
+    static JobPool& shared();
+
+private:
+    void work();
+    void run_job();
+
+    std::vector<std::thread> workers;
+    /// serializes parallel_for() calls from different threads
+    std::mutex submit_mutex;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    uint64_t generation = 0;
+    bool stopping = false;
+    /// how many workers are through with the current loop
+    size_t finished = 0;
+
+    const std::function<void(size_t)>* job = nullptr;
+    size_t job_count = 0;
+    std::atomic<size_t> next = 0;
+};
+
+#endif
@@ -5,50 +5,134 @@
 
 #include "nasl/nasl.h"
 
+#include <algorithm>
+
 #include "camera.h"
 #include "game.h"
 
 using namespace nasl;
 
+/// how fast --flythrough flies, in blocks per second: slow enough that the chunks ahead get loaded in time
+constexpr float FLYTHROUGH_SPEED = 20.0f;
+
+/// the frame times of a --flythrough, so the render modes can be compared on the same path
+static void print_frame_times(std::vector<float> frame_ms) {
+    std::sort(frame_ms.begin(), frame_ms.end());
+    double total = 0.0;
+    for (float ms : frame_ms)
+        total += ms;
+    auto percentile = [&](double p) {
+        return frame_ms[std::min(frame_ms.size() - 1, static_cast<size_t>(p * frame_ms.size()))];
+    };
+    std::cout << "Flythrough: " << frame_ms.size() << " frames, " << total / frame_ms.size() << " ms on average, median "
+              << percentile(0.5) << " ms, 95th percentile " << percentile(0.95) << " ms, 99th percentile " << percentile(0.99) << " ms" << std::endl;
+}
+
+/// the device, with the 64 bit atomics of VoxelsSplatted64 if the GPU has them. That is only known once a GPU got picked,
+/// so a device on one that has them is created again, asking for them.
+static std::unique_ptr<imr::Device> create_device(imr::Context& context, bool& atomic64) {
+    auto device = std::make_unique<imr::Device>(context);
+    atomic64 = VoxelSplatter::supports_atomic64(*device);
+    if (!atomic64)
+        return device;
+    device.reset();
+    return std::make_unique<imr::Device>(context, [](vkb::PhysicalDeviceSelector& selector) {
+        VoxelSplatter::require_atomic64(selector);
+    });
+}
+
 int main(int argc, char** argv) {
     if (argc < 2) return 0;
 
+    size_t cache_budget_mib = 512;
+    ViewSettings view_settings;
+    bool greedyVoxels = false;
+    VoxelRenderer voxel_renderer = VoxelsRasterized;
+    float flythrough_seconds = 0.0f;
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--cache-budget" && i + 1 < argc)
+            cache_budget_mib = std::stoul(argv[++i]);
+        else if (arg == "--greedy")
+            greedyVoxels = true;
+        else if (arg == "--splat")
+            voxel_renderer = VoxelsSplatted;
+        else if (arg == "--splat64")
+            voxel_renderer = VoxelsSplatted64;
+        else if (arg == "--flythrough" && i + 1 < argc)
+            flythrough_seconds = std::stof(argv[++i]);
+        else if (arg == "--render-distance" && i + 1 < argc) {
+            view_settings.render_distance = std::clamp(std::stoi(argv[++i]), MIN_RENDER_DISTANCE, MAX_RENDER_DISTANCE);
+            view_settings.auto_render_distance = false;
+        }
+    }
+
     glfwInit();
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
     auto window = glfwCreateWindow(1024, 1024, "Example", nullptr, nullptr);
 
     imr::Context context;
-    imr::Device device(context);
+    bool atomic64;
+    auto device_holder = create_device(context, atomic64);
+    imr::Device& device = *device_holder;
     imr::Swapchain swapchain(device, window);
     imr::FpsCounter fps_counter;
-    auto world = World(argv[1]);
+    auto world = World(argv[1], cache_budget_mib * 1024 * 1024);
     Camera camera = {{30, 141, -12}, {0, 0}, 90};
-    bool voxels = true;
-    bool greedyVoxels = false;
-    std::unique_ptr<Game> game = std::make_unique<GameVoxels>(device, window, swapchain, &world, camera, greedyVoxels);
+    // modes stay alive once created, so switching keeps their pipelines and the chunks' GPU data
+    auto voxel_game = std::make_unique<GameVoxels>(device, window, swapchain, &world, camera, view_settings, greedyVoxels);
+    std::unique_ptr<GameMesh> mesh_game;
+    std::unique_ptr<GameBricks> brick_game;
+    voxel_game->renderer = voxel_renderer;
+    voxel_game->atomic64 = atomic64;
+    Game* game = voxel_game.get();
+
+    const vec3 flythrough_start = camera.position;
+    const vec3 flythrough_direction = camera_get_forward_vec(&camera);
+    const uint64_t flythrough_begin = imr_get_time_nano();
+    uint64_t frame_begin = flythrough_begin;
+    std::vector<float> frame_ms;
 
     while (!glfwWindowShouldClose(window)) {
         fps_counter.tick();
         fps_counter.updateGlfwWindowTitle(window);
 
+        if (flythrough_seconds > 0.0f) {
+            const uint64_t now = imr_get_time_nano();
+            const float elapsed = (now - flythrough_begin) / 1e9f;
+            if (now != flythrough_begin)
+                frame_ms.push_back((now - frame_begin) / 1e6f);
+            frame_begin = now;
+            if (elapsed >= flythrough_seconds)
+                break;
+            camera.position = vec3_add(flythrough_start, vec3_scale(flythrough_direction, FLYTHROUGH_SPEED * elapsed));
+        }
+
+        // F10 goes from voxels to meshes to bricks and back to voxels
         if (game->toggleMode) {
-            swapchain.drain();
-            if (voxels) {
-                greedyVoxels = static_cast<GameVoxels*>(&*game)->greedyVoxels;
-                delete game.release();
-                game = std::make_unique<GameMesh>(device, window, swapchain, &world, camera);
-                voxels = false;
+            game->toggleMode = false;
+            if (game == voxel_game.get()) {
+                if (!mesh_game)
+                    mesh_game = std::make_unique<GameMesh>(device, window, swapchain, &world, camera, view_settings);
+                game = mesh_game.get();
                 std::cout << "Switched to mesh mode" << std::endl;
+            } else if (game == mesh_game.get()) {
+                if (!brick_game)
+                    brick_game = std::make_unique<GameBricks>(device, window, swapchain, &world, camera, view_settings);
+                game = brick_game.get();
+                std::cout << "Switched to brick mode" << std::endl;
             } else {
-                delete game.release();
-                game = std::make_unique<GameVoxels>(device, window, swapchain, &world, camera, greedyVoxels);
-                voxels = true;
+                game = voxel_game.get();
                 std::cout << "Switched to voxel mode" << std::endl;
             }
+            game->activate();
         }
         game->renderFrame();
     }
 
     swapchain.drain();
+    world.print_cache_stats();
+    if (!frame_ms.empty())
+        print_frame_times(frame_ms);
     return 0;
 }
@@ -0,0 +1,491 @@
+// Offline benchmark for the CPU meshers: loads a square of chunks from a world and times meshing them.
+// usage: mesh_bench <world folder> [center chunk x] [center chunk z] [radius]
+
+#include "world.h"
+#include "padded_chunk.h"
+#include "voxel_dag.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <optional>
+#include <span>
+#include <thread>
+#include <unordered_map>
+
+using bench_clock = std::chrono::steady_clock;
+
+static double elapsed_us(bench_clock::time_point start) {
+    return std::chrono::duration<double, std::micro>(bench_clock::now() - start).count();
+}
+
+/// the read pattern of the meshers before PaddedChunk: one access_safe per block plus six per solid block
+static size_t count_faces_access_safe(ChunkNeighbors& n) {
+    size_t faces = 0;
+    const ChunkData* chunk = n.neighbours[1][1];
+    for (int y = 0; y < CUNK_CHUNK_MAX_HEIGHT; y++)
+        for (int z = 0; z < CUNK_CHUNK_SIZE; z++)
+            for (int x = 0; x < CUNK_CHUNK_SIZE; x++) {
+                if (access_safe(chunk, n, x, y, z) == BlockAir)
+                    continue;
+                faces += access_safe(chunk, n, x, y + 1, z) == BlockAir;
+                faces += access_safe(chunk, n, x, y - 1, z) == BlockAir;
+                faces += access_safe(chunk, n, x + 1, y, z) == BlockAir;
+                faces += access_safe(chunk, n, x - 1, y, z) == BlockAir;
+                faces += access_safe(chunk, n, x, y, z + 1) == BlockAir;
+                faces += access_safe(chunk, n, x, y, z - 1) == BlockAir;
+            }
+    return faces;
+}
+
+static size_t count_faces_padded(const PaddedChunk& chunk) {
+    size_t faces = 0;
+    for (int y = 0; y < CUNK_CHUNK_MAX_HEIGHT; y++) {
+        if (chunk.empty_section[y / CUNK_CHUNK_SIZE])
+            continue;
+        for (int z = 0; z < CUNK_CHUNK_SIZE; z++)
+            for (int x = 0; x < CUNK_CHUNK_SIZE; x++) {
+                if (chunk.get(x, y, z) == BlockAir)
+                    continue;
+                faces += chunk.get(x, y + 1, z) == BlockAir;
+                faces += chunk.get(x, y - 1, z) == BlockAir;
+                faces += chunk.get(x + 1, y, z) == BlockAir;
+                faces += chunk.get(x - 1, y, z) == BlockAir;
+                faces += chunk.get(x, y, z + 1) == BlockAir;
+                faces += chunk.get(x, y, z - 1) == BlockAir;
+            }
+    }
+    return faces;
+}
+
+/// the number of unit faces covered by a mesh, so merged quads can be checked against the per-face mesh
+static size_t count_mesh_faces(const uint8_t* g, size_t num_verts) {
+    size_t faces = 0;
+    const auto* vertices = reinterpret_cast<const ChunkMesh::Vertex*>(g);
+    for (size_t quad = 0; quad < num_verts / 4; quad++) {
+        int min[3] = { INT16_MAX, INT16_MAX, INT16_MAX }, max[3] = { INT16_MIN, INT16_MIN, INT16_MIN };
+        for (int i = 0; i < 4; i++) {
+            const auto& v = vertices[quad * 4 + i];
+            const int position[3] = { static_cast<int>(v.x()), static_cast<int>(v.y()), static_cast<int>(v.z()) };
+            for (int axis = 0; axis < 3; axis++) {
+                min[axis] = std::min(min[axis], position[axis]);
+                max[axis] = std::max(max[axis], position[axis]);
+            }
+        }
+        size_t area = 1;
+        for (int axis = 0; axis < 3; axis++)
+            area *= std::max(max[axis] - min[axis], 1);
+        faces += area;
+    }
+    return faces;
+}
+
+/// every unit face covered by a mesh, as the corner of the face nearest the origin, its direction and block, sorted.
+/// Two meshes cover the same faces if they have the same unit faces, however they merged them into quads.
+static std::vector<uint64_t> mesh_unit_faces(const uint8_t* g, size_t num_verts) {
+    std::vector<uint64_t> faces;
+    const auto* vertices = reinterpret_cast<const ChunkMesh::Vertex*>(g);
+    for (size_t quad = 0; quad < num_verts / 4; quad++) {
+        int min[3] = { INT16_MAX, INT16_MAX, INT16_MAX }, max[3] = { INT16_MIN, INT16_MIN, INT16_MIN };
+        for (int i = 0; i < 4; i++) {
+            const auto& v = vertices[quad * 4 + i];
+            const int position[3] = { static_cast<int>(v.x()), static_cast<int>(v.y()), static_cast<int>(v.z()) };
+            for (int axis = 0; axis < 3; axis++) {
+                min[axis] = std::min(min[axis], position[axis]);
+                max[axis] = std::max(max[axis], position[axis]);
+            }
+        }
+        // the axis the quad is flat along has a single coordinate
+        for (int axis = 0; axis < 3; axis++)
+            max[axis] = std::max(max[axis], min[axis] + 1);
+        const uint64_t kind = static_cast<uint64_t>(vertices[quad * 4].face()) << 32 | static_cast<uint64_t>(vertices[quad * 4].block()) << 40;
+        for (int y = min[1]; y < max[1]; y++)
+            for (int z = min[2]; z < max[2]; z++)
+                for (int x = min[0]; x < max[0]; x++)
+                    faces.push_back(kind | static_cast<uint64_t>(y) << 16 | z << 8 | x);
+    }
+    std::sort(faces.begin(), faces.end());
+    return faces;
+}
+
+/// the number of blocks inside a set of GreedyVoxel boxes, which has to be the number of exposed blocks they were made of
+static size_t count_box_blocks(const uint8_t* g, size_t num_boxes) {
+    size_t blocks = 0;
+    for (size_t i = 0; i < num_boxes; i++) {
+        GreedyVoxel box;
+        memcpy(&box, g + i * sizeof(GreedyVoxel), sizeof(box));
+        blocks += box.size_x() * box.size_y() * box.size_z();
+    }
+    return blocks;
+}
+
+/// the axis of the smallest of `t`, like raymarch.frag's exitAxis()
+static int exit_axis(const float t[3]) {
+    return t[0] < t[1] ? (t[0] < t[2] ? 0 : 2) : (t[1] < t[2] ? 1 : 2);
+}
+
+/// the reference for VoxelDag::raycast(): a DDA over every block of `solid(x, y, z)` from `origin`, in cells where block x
+/// covers [x, x + 1). Returns where the ray enters the first solid block within `max_distance`, and which it is.
+template<typename Solid>
+static std::optional<float> march_blocks(Solid&& solid, const float origin[3], const float direction[3], float max_distance, int hit[3]) {
+    int cell[3], step[3];
+    float t_max[3], t_delta[3];
+    for (int a = 0; a < 3; a++) {
+        cell[a] = static_cast<int>(floorf(origin[a]));
+        step[a] = direction[a] > 0.0f ? 1 : direction[a] < 0.0f ? -1 : 0;
+        t_max[a] = step[a] == 0 ? INFINITY : ((cell[a] + std::max(step[a], 0)) - origin[a]) / direction[a];
+        t_delta[a] = step[a] == 0 ? INFINITY : fabsf(1.0f / direction[a]);
+    }
+    float t = 0.0f;
+    while (t <= max_distance) {
+        if (solid(cell[0], cell[1], cell[2])) {
+            std::copy_n(cell, 3, hit);
+            return t;
+        }
+        if ((cell[1] < 0 && step[1] <= 0) || (cell[1] >= CUNK_CHUNK_MAX_HEIGHT && step[1] >= 0))
+            break;
+        const int axis = exit_axis(t_max);
+        t = t_max[axis];
+        cell[axis] += step[axis];
+        t_max[axis] += t_delta[axis];
+    }
+    return std::nullopt;
+}
+
+/// where a ray enters block `block`, for telling rays that pass exactly through an edge or corner apart from misses
+static float block_entry(const int block[3], const float origin[3], const float direction[3]) {
+    float t = 0.0f;
+    for (int a = 0; a < 3; a++) {
+        if (direction[a] == 0.0f)
+            continue;
+        const float near = (block[a] + (direction[a] < 0.0f) - origin[a]) / direction[a];
+        t = std::max(t, near);
+    }
+    return t;
+}
+
+/// the direction of the rays down onto every column of a chunk that mesh_bench times VoxelDag::raycast() with
+static const vec3 DAG_RAY = { 0.05f, -1.0f, 0.03f };
+
+/// compares VoxelDag::get() with the blocks of `chunk` for every block, and VoxelDag::raycast() with march_blocks()
+/// for the DAG_RAY of every column; false if anything differs
+static bool check_dag(const VoxelDag& dag, const DagChunk& roots, const Chunk& loaded) {
+    const ChunkData& chunk = loaded.data;
+    for (int y = 0; y < CUNK_CHUNK_MAX_HEIGHT; y++) {
+        for (int z = 0; z < CUNK_CHUNK_SIZE; z++) {
+            for (int x = 0; x < CUNK_CHUNK_SIZE; x++) {
+                const BlockId expected = static_cast<BlockId>(chunk_get_block_data(&chunk, x, y, z));
+                if (dag.get(roots, x, y, z) != expected) {
+                    std::cerr << "VoxelDag::get() has " << dag.get(roots, x, y, z) << " at " << x << ", " << y << ", " << z
+                              << " of chunk " << loaded.cx << ", " << loaded.cz << ", the chunk " << expected << std::endl;
+                    return false;
+                }
+            }
+        }
+    }
+
+    auto solid = [&](int x, int y, int z) {
+        if (x < 0 || x >= CUNK_CHUNK_SIZE || y < 0 || y >= CUNK_CHUNK_MAX_HEIGHT || z < 0 || z >= CUNK_CHUNK_SIZE)
+            return false;
+        return chunk_get_block_data(&chunk, x, y, z) != BlockAir;
+    };
+    const float direction[3] = { DAG_RAY.x, DAG_RAY.y, DAG_RAY.z };
+    for (int x = 0; x < CUNK_CHUNK_SIZE; x++) {
+        for (int z = 0; z < CUNK_CHUNK_SIZE; z++) {
+            const float origin[3] = { x + 0.5f, CUNK_CHUNK_MAX_HEIGHT - 0.5f, z + 0.5f };
+            const std::optional<DagHit> hit = dag.raycast(roots, { origin[0], origin[1], origin[2] }, DAG_RAY, CUNK_CHUNK_MAX_HEIGHT);
+            int reference[3];
+            const std::optional<float> distance = march_blocks(solid, origin, direction, CUNK_CHUNK_MAX_HEIGHT, reference);
+            bool same = hit.has_value() == distance.has_value();
+            if (same && hit) {
+                const int block[3] = { hit->x, hit->y, hit->z };
+                // the same block, or one the ray enters at the same point, through an edge the other march went around
+                same = fabsf(hit->distance - *distance) < 1e-3f && solid(hit->x, hit->y, hit->z)
+                    && hit->block == static_cast<BlockId>(chunk_get_block_data(&chunk, hit->x, hit->y, hit->z))
+                    && (std::equal(block, block + 3, reference) || fabsf(block_entry(block, origin, direction) - *distance) < 1e-3f);
+            }
+            if (!same) {
+                std::cerr << "VoxelDag::raycast() down from column " << x << ", " << z << " of chunk " << loaded.cx << ", " << loaded.cz << " ";
+                if (hit)
+                    std::cerr << "hits " << hit->x << ", " << hit->y << ", " << hit->z << " at " << hit->distance;
+                else
+                    std::cerr << "misses";
+                std::cerr << ", a per-block march ";
+                if (distance)
+                    std::cerr << "hits " << reference[0] << ", " << reference[1] << ", " << reference[2] << " at " << *distance << std::endl;
+                else
+                    std::cerr << "misses" << std::endl;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "usage: " << argv[0] << " <world folder> [center chunk x] [center chunk z] [radius]" << std::endl;
+        return 1;
+    }
+    const int center_x = argc > 2 ? std::stoi(argv[2]) : 0;
+    const int center_z = argc > 3 ? std::stoi(argv[3]) : 0;
+    const int radius = argc > 4 ? std::stoi(argv[4]) : 4;
+
+    World world(argv[1]);
+    // load one extra ring, so every benchmarked chunk has all of its neighbours
+    for (int cx = center_x - radius - 1; cx <= center_x + radius + 1; cx++)
+        for (int cz = center_z - radius - 1; cz <= center_z + radius + 1; cz++)
+            world.load_chunk(cx, cz);
+
+    // where main.cpp puts the camera, but above the center chunk, for how many vertices GameMesh skips as facing away
+    const vec3 eye = { center_x * CUNK_CHUNK_SIZE + 8.0f, 141.0f, center_z * CUNK_CHUNK_SIZE + 8.0f };
+
+    size_t chunks = 0, faces = 0, verts = 0, greedy_verts = 0, facing_verts = 0, voxels = 0, flat_greedy_voxels = 0, greedy_voxels = 0;
+    size_t lod_verts[MESH_LOD_COUNT] = {};
+    double lod_us[MESH_LOD_COUNT] = {};
+    size_t lod_voxels[VOXEL_LOD_COUNT] = {};
+    double lod_voxels_us[VOXEL_LOD_COUNT] = {};
+    // the greedy voxels of every chunk, to merge them into batches afterwards
+    std::unordered_map<Int2, std::vector<GreedyVoxel>> chunk_boxes;
+    double access_safe_us = 0, padded_build_us = 0, padded_scan_us = 0, count_us = 0, mesh_us = 0, greedy_mesh_us = 0, parallel_mesh_us = 0, voxels_us = 0, flat_greedy_us = 0, greedy_us = 0;
+
+    for (int cx = center_x - radius; cx <= center_x + radius; cx++) {
+        for (int cz = center_z - radius; cz <= center_z + radius; cz++) {
+            ChunkNeighbors n = {};
+            for (int dx = -1; dx < 2; dx++)
+                for (int dz = -1; dz < 2; dz++)
+                    n.neighbours[dx + 1][dz + 1] = &world.get_loaded_chunk(cx + dx, cz + dz)->data;
+
+            auto start = bench_clock::now();
+            const size_t reference_faces = count_faces_access_safe(n);
+            access_safe_us += elapsed_us(start);
+
+            start = bench_clock::now();
+            auto padded = std::make_unique<PaddedChunk>(n);
+            padded_build_us += elapsed_us(start);
+
+            start = bench_clock::now();
+            const size_t padded_faces = count_faces_padded(*padded);
+            padded_scan_us += elapsed_us(start);
+
+            if (padded_faces != reference_faces) {
+                std::cerr << "face count mismatch in chunk " << cx << ", " << cz << ": "
+                          << padded_faces << " (padded) vs " << reference_faces << " (access_safe)" << std::endl;
+                return 1;
+            }
+            faces += padded_faces;
+
+            // the count pass the meshers' output gets sized with
+            start = bench_clock::now();
+            const size_t counted_faces = padded->count_exposed_faces();
+            const size_t counted_blocks = padded->count_exposed_blocks();
+            count_us += elapsed_us(start);
+            if (counted_faces != padded_faces) {
+                std::cerr << "count_exposed_faces() is off in chunk " << cx << ", " << cz << ": "
+                          << counted_faces << " vs " << padded_faces << std::endl;
+                return 1;
+            }
+
+            uint8_t* buffer = mesher_scratch(std::max(counted_faces * mesh_quad_bytes(MeshVertices), counted_blocks * sizeof(GreedyVoxel)));
+            size_t count = 0;
+            start = bench_clock::now();
+            chunk_mesh(*padded, buffer, &count);
+            mesh_us += elapsed_us(start);
+            verts += count;
+            const std::vector<uint64_t> unit_faces = mesh_unit_faces(buffer, count);
+
+            count = 0;
+            start = bench_clock::now();
+            greedy_chunk_mesh(*padded, buffer, &count);
+            greedy_mesh_us += elapsed_us(start);
+            greedy_verts += count;
+
+            // the way ChunkMesh builds it: per section on the JobPool
+            size_t section_bytes[CUNK_CHUNK_SECTIONS_COUNT + 1];
+            start = bench_clock::now();
+            uint8_t* sections = mesh_sections(*padded, [&](int section) {
+                return padded->count_exposed_faces(section) * mesh_quad_bytes(MeshVertices);
+            }, [&](int section, uint8_t* out) {
+                size_t section_verts;
+                greedy_chunk_mesh_section(*padded, section, out, &section_verts);
+                return section_verts / 4 * mesh_quad_bytes(MeshVertices);
+            }, section_bytes);
+            parallel_mesh_us += elapsed_us(start);
+            const size_t section_verts = section_bytes[CUNK_CHUNK_SECTIONS_COUNT] / mesh_quad_bytes(MeshVertices) * 4;
+            if (section_verts != count) {
+                std::cerr << "per-section meshing of chunk " << cx << ", " << cz << " made " << section_verts
+                          << " vertices instead of " << count << std::endl;
+                return 1;
+            }
+            if (count_mesh_faces(sections, section_verts) != padded_faces) {
+                std::cerr << "greedy mesh of chunk " << cx << ", " << cz << " covers " << count_mesh_faces(sections, section_verts)
+                          << " faces instead of " << padded_faces << std::endl;
+                return 1;
+            }
+            // not just as many, the same faces as chunk_mesh(), with the same blocks
+            if (mesh_unit_faces(sections, section_verts) != unit_faces) {
+                std::cerr << "greedy mesh of chunk " << cx << ", " << cz << " covers other faces than chunk_mesh()" << std::endl;
+                return 1;
+            }
+            const uint8_t facing = facing_directions(eye, cx, cz);
+            const auto* vertices = reinterpret_cast<const ChunkMesh::Vertex*>(sections);
+            for (size_t vertex = 0; vertex < section_verts; vertex += 4)
+                facing_verts += (facing >> vertices[vertex].face() & 1) * 4;
+            // the same memory, but it may have moved
+            buffer = mesher_scratch(0);
+
+            count = 0;
+            start = bench_clock::now();
+            chunk_voxels(*padded, buffer, &count);
+            voxels_us += elapsed_us(start);
+            voxels += count;
+            if (count != counted_blocks) {
+                std::cerr << "count_exposed_blocks() is off in chunk " << cx << ", " << cz << ": "
+                          << counted_blocks << " vs " << count << std::endl;
+                return 1;
+            }
+
+            count = 0;
+            start = bench_clock::now();
+            greedy_chunk_voxels(*padded, buffer, &count, false);
+            flat_greedy_us += elapsed_us(start);
+            flat_greedy_voxels += count;
+            const size_t flat_volume = count_box_blocks(buffer, count);
+
+            count = 0;
+            start = bench_clock::now();
+            greedy_chunk_voxels(*padded, buffer, &count);
+            greedy_us += elapsed_us(start);
+            greedy_voxels += count;
+            const auto* boxes = reinterpret_cast<const GreedyVoxel*>(buffer);
+            chunk_boxes[{ cx, cz }].assign(boxes, boxes + count);
+            const size_t volume = count_box_blocks(buffer, count);
+            if (volume != counted_blocks || flat_volume != counted_blocks) {
+                std::cerr << "greedy voxels of chunk " << cx << ", " << cz << " cover " << volume << " (merged along y) and "
+                          << flat_volume << " (per slice) blocks, instead of " << counted_blocks << std::endl;
+                return 1;
+            }
+
+            for (int lod = 1; lod < MESH_LOD_COUNT; lod++) {
+                size_t first_vert[FaceCount][CUNK_CHUNK_SECTIONS_COUNT + 1];
+                buffer = mesher_scratch(lod_mesh_max_faces(lod) * mesh_quad_bytes(MeshVertices));
+                start = bench_clock::now();
+                lod_chunk_mesh(*n.neighbours[1][1], lod, buffer, &count, first_vert);
+                lod_us[lod] += elapsed_us(start);
+                lod_verts[lod] += count;
+            }
+            for (int lod = 1; lod < VOXEL_LOD_COUNT; lod++) {
+                buffer = mesher_scratch(lod_voxels_max(lod) * sizeof(Voxel));
+                start = bench_clock::now();
+                lod_chunk_voxels(*n.neighbours[1][1], lod, buffer, &count);
+                lod_voxels_us[lod] += elapsed_us(start);
+                lod_voxels[lod] += count;
+            }
+
+            chunks++;
+        }
+    }
+
+    // the 4x4 and 8x8 chunk batches that fit into the square
+    constexpr int batch_sizes[] = { 4, MAX_BATCH_CHUNKS };
+    size_t batches[2] = {}, batch_source_boxes[2] = {}, batch_boxes[2] = {};
+    double batch_us[2] = {};
+    for (int i = 0; i < 2; i++) {
+        const int size = batch_sizes[i];
+        for (int bx = center_x - radius; bx + size <= center_x + radius + 1; bx += size) {
+            for (int bz = center_z - radius; bz + size <= center_z + radius + 1; bz += size) {
+                std::vector<std::span<const GreedyVoxel>> members;
+                for (int dx = 0; dx < size; dx++) {
+                    for (int dz = 0; dz < size; dz++) {
+                        members.emplace_back(chunk_boxes[{ bx + dx, bz + dz }]);
+                        batch_source_boxes[i] += members.back().size();
+                    }
+                }
+                const auto start = bench_clock::now();
+                const std::vector<GreedyVoxel> batch = batch_greedy_voxels(members, size);
+                batch_us[i] += elapsed_us(start);
+                batch_boxes[i] += batch.size();
+                batches[i]++;
+            }
+        }
+    }
+
+    // every chunk of the square in one DAG, and rays down onto every column of it; DAG_RAY is what check_dag() shoots
+    VoxelDag dag;
+    std::vector<std::pair<const Chunk*, DagChunk>> dag_chunks;
+    auto start = bench_clock::now();
+    for (int cx = center_x - radius; cx <= center_x + radius; cx++) {
+        for (int cz = center_z - radius; cz <= center_z + radius; cz++) {
+            if (const Chunk* chunk = world.get_loaded_chunk(cx, cz))
+                dag_chunks.emplace_back(chunk, dag.add(chunk->data));
+        }
+    }
+    const double dag_us = elapsed_us(start);
+    for (auto& [chunk, roots] : dag_chunks) {
+        if (!check_dag(dag, roots, *chunk))
+            return 1;
+    }
+    ChunkStorageBytes storage;
+    size_t rays = 0, ray_hits = 0;
+    start = bench_clock::now();
+    for (auto& [chunk, roots] : dag_chunks) {
+        for (int x = 0; x < CUNK_CHUNK_SIZE; x++) {
+            for (int z = 0; z < CUNK_CHUNK_SIZE; z++) {
+                const vec3 origin = { x + 0.5f, CUNK_CHUNK_MAX_HEIGHT - 0.5f, z + 0.5f };
+                ray_hits += dag.raycast(roots, origin, DAG_RAY, CUNK_CHUNK_MAX_HEIGHT).has_value();
+                rays++;
+            }
+        }
+    }
+    const double ray_us = elapsed_us(start);
+    for (auto& [chunk, roots] : dag_chunks) {
+        const ChunkStorageBytes bytes = chunk_storage_bytes(chunk->data, dag, roots);
+        storage.raw += bytes.raw;
+        storage.palette += bytes.palette;
+        storage.dag += bytes.dag;
+    }
+
+    std::cout << chunks << " chunks, " << faces << " exposed faces" << std::endl;
+    std::cout << "per chunk:" << std::endl;
+    std::cout << "  access_safe face scan:   " << access_safe_us / chunks << " us" << std::endl;
+    std::cout << "  PaddedChunk build:       " << padded_build_us / chunks << " us" << std::endl;
+    std::cout << "  PaddedChunk face scan:   " << padded_scan_us / chunks << " us" << std::endl;
+    std::cout << "  count pass (bitmasks):   " << count_us / chunks << " us" << std::endl;
+    std::cout << "  chunk_mesh:              " << mesh_us / chunks << " us, " << verts / chunks << " vertices" << std::endl;
+    std::cout << "  greedy_chunk_mesh:       " << greedy_mesh_us / chunks << " us, " << greedy_verts / chunks << " vertices ("
+              << 100.0 * greedy_verts / std::max<size_t>(verts, 1) << "%)" << std::endl;
+    std::cout << "  greedy, per section:     " << parallel_mesh_us / chunks << " us on " << std::thread::hardware_concurrency() << " threads" << std::endl;
+    std::cout << "  facing the camera:       " << facing_verts / chunks << " greedy vertices ("
+              << 100.0 * facing_verts / std::max<size_t>(greedy_verts, 1) << "%) get drawn from " << eye.x << ", " << eye.y << ", " << eye.z << std::endl;
+    std::cout << "  mesh upload size:        " << verts * sizeof(ChunkMesh::Vertex) / chunks << " bytes as vertices, "
+              << greedy_verts * sizeof(ChunkMesh::Vertex) / chunks << " greedy, "
+              << greedy_verts / 4 * sizeof(ChunkMesh::Face) / chunks << " as greedy faces" << std::endl;
+    for (int lod = 1; lod < MESH_LOD_COUNT; lod++)
+        std::cout << "  lod_chunk_mesh, " << (1 << lod) << "x:     " << lod_us[lod] / chunks << " us, " << lod_verts[lod] / chunks << " vertices ("
+                  << 100.0 * lod_verts[lod] / std::max<size_t>(greedy_verts, 1) << "% of greedy)" << std::endl;
+    std::cout << "  chunk_voxels:            " << voxels_us / chunks << " us, " << voxels / chunks << " voxels" << std::endl;
+    std::cout << "  voxel upload size:       " << voxels * sizeof(Voxel) / chunks << " bytes, "
+              << greedy_voxels * sizeof(GreedyVoxel) / chunks << " greedy" << std::endl;
+    std::cout << "  greedy voxels per slice: " << flat_greedy_us / chunks << " us, " << flat_greedy_voxels / chunks << " boxes" << std::endl;
+    std::cout << "  greedy_chunk_voxels:     " << greedy_us / chunks << " us, " << greedy_voxels / chunks << " boxes ("
+              << 100.0 * greedy_voxels / std::max<size_t>(flat_greedy_voxels, 1) << "% of per slice)" << std::endl;
+    for (int lod = 1; lod < VOXEL_LOD_COUNT; lod++)
+        std::cout << "  lod_chunk_voxels, " << (1 << lod) << "x:   " << lod_voxels_us[lod] / chunks << " us, " << lod_voxels[lod] / chunks << " voxels ("
+                  << 100.0 * lod_voxels[lod] / std::max<size_t>(voxels, 1) << "%)" << std::endl;
+    for (int i = 0; i < 2; i++) {
+        if (batches[i] == 0)
+            continue;
+        std::cout << "per " << batch_sizes[i] << "x" << batch_sizes[i] << " batch (" << batches[i] << " of them):" << std::endl;
+        std::cout << "  batch_greedy_voxels:     " << batch_us[i] / batches[i] << " us, " << batch_boxes[i] / batches[i] << " boxes ("
+                  << 100.0 * batch_boxes[i] / std::max<size_t>(batch_source_boxes[i], 1) << "% of the chunks' own), 1 draw instead of "
+                  << batch_sizes[i] * batch_sizes[i] << std::endl;
+    }
+    std::cout << "voxel DAG of all " << chunks << " chunks (" << dag.nodes.size() << " nodes):" << std::endl;
+    std::cout << "  VoxelDag::add:           " << dag_us / chunks << " us per chunk" << std::endl;
+    std::cout << "  raycast:                 " << ray_us * 1000.0 / std::max<size_t>(rays, 1) << " ns per ray, " << ray_hits << " of " << rays << " hit" << std::endl;
+    std::cout << "  bytes per chunk:         " << storage.raw / chunks << " raw, " << storage.palette / chunks << " palette, "
+              << storage.dag / chunks << " in a DAG of its own, " << (dag.node_bytes() + chunks * sizeof(DagChunk)) / chunks << " shared ("
+              << dag.index_bytes() / chunks << " more while building)" << std::endl;
+    return 0;
+}
@@ -0,0 +1,295 @@
+#include "mesh_cache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static uint64_t mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+uint64_t hash_combine(uint64_t seed, uint64_t value) {
+    return mix(seed ^ (value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2)));
+}
+
+static uint64_t hash_bytes(uint64_t seed, const void* data, size_t size) {
+    const auto* bytes = static_cast<const uint8_t*>(data);
+    uint64_t h = seed;
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, bytes + i, sizeof(word));
+        h = (h ^ word) * 0x100000001b3ull;
+        h ^= h >> 29;
+    }
+    for (; i < size; i++)
+        h = (h ^ bytes[i]) * 0x100000001b3ull;
+    return mix(h ^ size);
+}
+
+uint64_t hash_chunk(const ChunkData& chunk) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (int section = 0; section < CUNK_CHUNK_SECTIONS_COUNT; section++) {
+        // missing sections are air, but still have to hash differently from a section that is there
+        const ChunkSection* s = chunk.sections[section];
+        h = s ? hash_bytes(h, s->block_data, sizeof(s->block_data)) : hash_combine(h, section);
+    }
+    return h;
+}
+
+uint64_t hash_chunk_edge(const ChunkData& chunk, ChunkSide side) {
+    uint64_t h = hash_combine(0xcbf29ce484222325ull, side);
+    for (int section = 0; section < CUNK_CHUNK_SECTIONS_COUNT; section++) {
+        const ChunkSection* s = chunk.sections[section];
+        if (!s) {
+            h = hash_combine(h, section);
+            continue;
+        }
+        BlockData edge[CUNK_CHUNK_SIZE][CUNK_CHUNK_SIZE];
+        for (int y = 0; y < CUNK_CHUNK_SIZE; y++) {
+            for (int i = 0; i < CUNK_CHUNK_SIZE; i++) {
+                switch (side) {
+                    case SideMinusX: edge[y][i] = s->block_data[y][i][0]; break;
+                    case SidePlusX:  edge[y][i] = s->block_data[y][i][CUNK_CHUNK_SIZE - 1]; break;
+                    case SideMinusZ: edge[y][i] = s->block_data[y][0][i]; break;
+                    default:         edge[y][i] = s->block_data[y][CUNK_CHUNK_SIZE - 1][i]; break;
+                }
+            }
+        }
+        h = hash_bytes(h, edge, sizeof(edge));
+    }
+    return h;
+}
+
+uint64_t neighbour_edge_key(const ChunkData& neighbour, ChunkSide side) {
+    return hash_chunk_edge(neighbour, static_cast<ChunkSide>(side ^ 1));
+}
+
+void upload_readonly(imr::Buffer& buffer, const uint8_t* data, size_t size) {
+    // uploadDataSync() only reads from it
+    buffer.uploadDataSync(0, size, const_cast<uint8_t*>(data));
+}
+
+/// written in front of every entry, so truncated or foreign files are never used
+struct EntryHeader {
+    static constexpr uint32_t MAGIC = 0x434d4753; // "SGMC"
+    uint32_t magic;
+    uint32_t header_size;
+    uint64_t key;
+    uint64_t size;
+};
+
+MeshCache::Mapping::Mapping(void* mapped, size_t mapped_size) : mapped(mapped), mapped_size(mapped_size) {
+    data = static_cast<const uint8_t*>(mapped) + sizeof(EntryHeader);
+    size = mapped_size - sizeof(EntryHeader);
+}
+
+MeshCache::Mapping::~Mapping() {
+    munmap(mapped, mapped_size);
+}
+
+MeshCache::MeshCache(std::string dir, size_t budget) : directory(std::move(dir)), budget(budget) {
+    if (directory.empty()) {
+        std::cerr << "Mesh cache disabled, neither XDG_CACHE_HOME nor HOME is set" << std::endl;
+        return;
+    }
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    if (error) {
+        std::cerr << "Mesh cache disabled, can't create " << directory << ": " << error.message() << std::endl;
+        directory.clear();
+        return;
+    }
+    writer = std::thread([this] { write_entries(); });
+}
+
+MeshCache::~MeshCache() {
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    if (writer.joinable())
+        writer.join();
+}
+
+std::string MeshCache::user_directory(const std::string& world_folder) {
+    std::string base;
+    if (const char* xdg = getenv("XDG_CACHE_HOME"); xdg && *xdg)
+        base = xdg;
+    else if (const char* home = getenv("HOME"); home && *home)
+        base = std::string(home) + "/.cache";
+    else
+        return "";
+
+    // the same world opened through another relative path still finds its cache
+    std::error_code error;
+    std::string world = std::filesystem::weakly_canonical(world_folder, error).string();
+    if (error)
+        world = world_folder;
+    char name[17];
+    snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(hash_bytes(0, world.data(), world.size())));
+    return base + "/sigcraft/" + name;
+}
+
+std::string MeshCache::path(uint64_t key) const {
+    char name[17];
+    snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(key));
+    // spread over 256 subdirectories, a big world has a lot of chunks
+    return directory + "/" + std::string(name, 2) + "/" + name;
+}
+
+std::unique_ptr<MeshCache::Mapping> MeshCache::load(uint64_t key) {
+    std::lock_guard lock(mutex);
+    const int fd = directory.empty() ? -1 : open(path(key).c_str(), O_RDONLY);
+    if (fd < 0) {
+        stats.misses++;
+        return nullptr;
+    }
+    struct stat st;
+    void* mapped = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(EntryHeader))
+        mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        stats.misses++;
+        return nullptr;
+    }
+
+    auto mapping = std::make_unique<Mapping>(mapped, st.st_size);
+    EntryHeader header;
+    memcpy(&header, mapped, sizeof(header));
+    if (header.magic != EntryHeader::MAGIC || header.header_size != sizeof(EntryHeader) || header.key != key || header.size != mapping->size) {
+        stats.misses++;
+        return nullptr;
+    }
+    stats.hits++;
+    // a hit counts as a use, eviction goes by modification time
+    pending.push_back({ key, {} });
+    wake.notify_one();
+    return mapping;
+}
+
+void MeshCache::store(uint64_t key, std::initializer_list<std::span<const uint8_t>> parts) {
+    if (directory.empty())
+        return;
+    EntryHeader header = { EntryHeader::MAGIC, sizeof(EntryHeader), key, 0 };
+    for (auto& part : parts)
+        header.size += part.size();
+
+    std::lock_guard lock(mutex);
+    if (pending_bytes + sizeof(header) + header.size > MESH_CACHE_MAX_PENDING) {
+        stats.dropped++;
+        return;
+    }
+    Write write = { key, std::vector<uint8_t>(sizeof(header)) };
+    write.bytes.reserve(sizeof(header) + header.size);
+    memcpy(write.bytes.data(), &header, sizeof(header));
+    for (auto& part : parts)
+        write.bytes.insert(write.bytes.end(), part.begin(), part.end());
+    pending_bytes += write.bytes.size();
+    pending.push_back(std::move(write));
+    wake.notify_one();
+}
+
+void MeshCache::write_entries() {
+    std::error_code error;
+    for (auto& entry : std::filesystem::recursive_directory_iterator(directory, error)) {
+        if (entry.is_regular_file(error))
+            disk_bytes += entry.file_size(error);
+    }
+
+    std::unique_lock lock(mutex);
+    while (true) {
+        wake.wait(lock, [&] { return stopping || !pending.empty(); });
+        if (pending.empty())
+            return;
+        Write write = std::move(pending.front());
+        pending.pop_front();
+
+        lock.unlock();
+        const size_t written = write_entry(write);
+        size_t evicted = 0;
+        if (disk_bytes > budget) {
+            const size_t before = disk_bytes;
+            evict();
+            evicted = before - disk_bytes;
+        }
+        lock.lock();
+        pending_bytes -= write.bytes.size();
+        stats.stored_bytes += written;
+        stats.evicted_bytes += evicted;
+    }
+}
+
+size_t MeshCache::write_entry(const Write& write) {
+    const std::string final_path = path(write.key);
+    if (write.bytes.empty()) {
+        utimensat(AT_FDCWD, final_path.c_str(), nullptr, 0);
+        return 0;
+    }
+
+    // written under a temporary name and renamed, so a crash never leaves a partial entry behind
+    const std::string temporary_path = final_path + ".tmp";
+    std::error_code error;
+    std::filesystem::create_directories(std::filesystem::path(final_path).parent_path(), error);
+    FILE* f = fopen(temporary_path.c_str(), "wb");
+    if (!f)
+        return 0;
+    bool written = fwrite(write.bytes.data(), write.bytes.size(), 1, f) == 1;
+    written = fclose(f) == 0 && written;
+    if (!written || rename(temporary_path.c_str(), final_path.c_str()) != 0) {
+        remove(temporary_path.c_str());
+        return 0;
+    }
+    disk_bytes += write.bytes.size();
+    return write.bytes.size();
+}
+
+void MeshCache::evict() {
+    struct Entry {
+        std::filesystem::file_time_type used;
+        std::filesystem::path path;
+        size_t size;
+    };
+    std::vector<Entry> entries;
+    std::error_code error;
+    size_t total = 0;
+    for (auto& entry : std::filesystem::recursive_directory_iterator(directory, error)) {
+        if (!entry.is_regular_file(error))
+            continue;
+        const size_t size = entry.file_size(error);
+        entries.push_back({ entry.last_write_time(error), entry.path(), size });
+        total += size;
+    }
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.used < b.used; });
+
+    // down to three quarters, so the directory isn't scanned again for every entry written
+    for (const Entry& entry : entries) {
+        if (total <= budget / 4 * 3)
+            break;
+        if (std::filesystem::remove(entry.path, error))
+            total -= entry.size;
+    }
+    disk_bytes = total;
+}
+
+void MeshCache::print_stats() const {
+    std::lock_guard lock(mutex);
+    std::cout << "Mesh cache: " << stats.hits << " hits, " << stats.misses << " misses, "
+              << stats.stored_bytes / 1024 << " KiB stored this session (" << stats.dropped << " stores dropped, "
+              << stats.evicted_bytes / 1024 << " KiB evicted) in " << directory << std::endl;
+}
@@ -0,0 +1,116 @@
+#ifndef SIGCRAFT_MESH_CACHE_H
+#define SIGCRAFT_MESH_CACHE_H
+
+#include "chunk_mesh.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include "enklume/block_data.h"
+}
+
+/// part of every cache key, bump it whenever the output of a mesher changes so old entries stop matching
+constexpr uint64_t MESHER_VERSION = 3;
+/// how many bytes of entries a world's cache keeps on disk before the least recently used ones are deleted
+constexpr size_t MESH_CACHE_BUDGET = 1024 * 1024 * 1024;
+/// how many bytes of entries may wait to be written at once, stores beyond that are dropped
+constexpr size_t MESH_CACHE_MAX_PENDING = 64 * 1024 * 1024;
+
+/// a hash of all the blocks of a chunk
+uint64_t hash_chunk(const ChunkData& chunk);
+/// a hash of the blocks along one outer edge of a chunk, the only ones a neighbour's mesh depends on
+uint64_t hash_chunk_edge(const ChunkData& chunk, ChunkSide side);
+/// hash_chunk_edge() of the edge of `neighbour` that faces the chunk it is the `side` neighbour of, its opposite side
+uint64_t neighbour_edge_key(const ChunkData& neighbour, ChunkSide side);
+uint64_t hash_combine(uint64_t seed, uint64_t value);
+
+/// uploads `size` bytes from `data` into `buffer`. `data` is only read from, so it may be a MeshCache::Mapping.
+void upload_readonly(imr::Buffer& buffer, const uint8_t* data, size_t size);
+
+struct MeshCacheStats {
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t stored_bytes = 0;
+    /// stores dropped because MESH_CACHE_MAX_PENDING bytes were still waiting to be written
+    size_t dropped = 0;
+    size_t evicted_bytes = 0;
+};
+
+/**
+ * Mesher output kept on disk across sessions, one file per key in `directory`.
+ * Keys are built from hash_chunk() and hash_chunk_edge() of everything the output depends on, plus MESHER_VERSION,
+ * so entries never need to be invalidated: a changed chunk simply has another key. Hits are memory-mapped and
+ * uploaded straight from the mapping. I/O errors are treated as misses, the cache is only ever an optimisation.
+ * Entries are written by a thread of the cache's own, so storing doesn't cost the frame any file I/O. Once the
+ * directory holds more than `budget` bytes, the entries that were least recently stored or hit are deleted.
+ */
+struct MeshCache {
+    /// a cache entry mapped read-only into memory, unmapped again when this is destroyed
+    struct Mapping {
+        const uint8_t* data;
+        size_t size;
+
+        Mapping(void* mapped, size_t mapped_size);
+        Mapping(const Mapping&) = delete;
+        ~Mapping();
+
+    private:
+        void* mapped;
+        size_t mapped_size;
+    };
+
+    std::string directory;
+    size_t budget;
+
+    /// the cache is disabled if `directory` is empty
+    explicit MeshCache(std::string directory, size_t budget = MESH_CACHE_BUDGET);
+    MeshCache(const MeshCache&) = delete;
+    /// writes what is still waiting to be stored
+    ~MeshCache();
+
+    /// where the cache of the world in `world_folder` goes: $XDG_CACHE_HOME/sigcraft (or ~/.cache/sigcraft), in a
+    /// directory named after a hash of the folder's path. Empty if neither variable is set.
+    static std::string user_directory(const std::string& world_folder);
+
+    /// the entry stored under `key`, or nullptr if there is none
+    std::unique_ptr<Mapping> load(uint64_t key);
+    /// queues the concatenation of `parts` to be stored under `key`, copying it
+    void store(uint64_t key, std::initializer_list<std::span<const uint8_t>> parts);
+    void print_stats() const;
+
+private:
+    /// an entry to write, or a hit whose modification time to update if `bytes` is empty
+    struct Write {
+        uint64_t key;
+        std::vector<uint8_t> bytes;
+    };
+
+    MeshCacheStats stats;
+    /// guards `stats`, `pending`, `pending_bytes` and `stopping`
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<Write> pending;
+    size_t pending_bytes = 0;
+    bool stopping = false;
+    /// bytes of entries in `directory`, only used by `writer`
+    size_t disk_bytes = 0;
+    std::thread writer;
+
+    std::string path(uint64_t key) const;
+    void write_entries();
+    /// returns the size of the file written
+    size_t write_entry(const Write& write);
+    /// deletes the entries that were least recently written or hit until the directory is well within its budget
+    void evict();
+};
+
+#endif
@@ -0,0 +1,214 @@
+#include "padded_chunk.h"
+
+#include "job_pool.h"
+
+#include <bit>
+#include <cassert>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+PaddedChunk::PaddedChunk(const ChunkNeighbors& neighbours, BlockId missing) {
+    fill(neighbours, missing);
+}
+
+PaddedChunk& PaddedChunk::scratch(const ChunkNeighbors& neighbours, BlockId missing) {
+    // on the heap, it's too big for thread-local storage or a worker thread's stack
+    thread_local std::unique_ptr<PaddedChunk> chunk = std::make_unique<PaddedChunk>();
+    chunk->fill(neighbours, missing);
+    return *chunk;
+}
+
+void PaddedChunk::fill(const ChunkNeighbors& neighbours, BlockId missing) {
+    static_assert(BlockAir == 0);
+    memset(blocks, 0, sizeof(blocks));
+
+    for (int i = 0; i < 3; i++) {
+        for (int k = 0; k < 3; k++) {
+            // only the row/column touching the center chunk is copied from a neighbour
+            const int x_begin = i == 0 ? CUNK_CHUNK_SIZE - 1 : 0;
+            const int x_end = i == 2 ? 1 : CUNK_CHUNK_SIZE;
+            const int z_begin = k == 0 ? CUNK_CHUNK_SIZE - 1 : 0;
+            const int z_end = k == 2 ? 1 : CUNK_CHUNK_SIZE;
+            const int x_offset = (i - 1) * CUNK_CHUNK_SIZE + 1;
+            const int z_offset = (k - 1) * CUNK_CHUNK_SIZE + 1;
+
+            const ChunkData* chunk = neighbours.neighbours[i][k];
+            if (!chunk) {
+                if (missing == BlockAir || (i == 1 && k == 1))
+                    continue;
+                for (int y = 1; y < HEIGHT - 1; y++)
+                    for (int z = z_begin; z < z_end; z++)
+                        for (int x = x_begin; x < x_end; x++)
+                            blocks[y][z + z_offset][x + x_offset] = missing;
+                continue;
+            }
+
+            for (int s = 0; s < CUNK_CHUNK_SECTIONS_COUNT; s++) {
+                const ChunkSection* section = chunk->sections[s];
+                if (!section)
+                    continue;
+                for (int y = 0; y < CUNK_CHUNK_SIZE; y++) {
+                    auto& layer = blocks[s * CUNK_CHUNK_SIZE + y + 1];
+                    for (int z = z_begin; z < z_end; z++) {
+                        for (int x = x_begin; x < x_end; x++) {
+                            layer[z + z_offset][x + x_offset] = static_cast<uint8_t>(section->block_data[y][z][x]);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    const ChunkData* center = neighbours.neighbours[1][1];
+    for (int s = 0; s < CUNK_CHUNK_SECTIONS_COUNT; s++) {
+        empty_section[s] = true;
+        const ChunkSection* section = center ? center->sections[s] : nullptr;
+        if (!section)
+            continue;
+        for (int y = 0; y < CUNK_CHUNK_SIZE && empty_section[s]; y++) {
+            for (int z = 0; z < CUNK_CHUNK_SIZE && empty_section[s]; z++) {
+                for (int x = 0; x < CUNK_CHUNK_SIZE; x++) {
+                    if (section->block_data[y][z][x] != BlockAir) {
+                        empty_section[s] = false;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+}
+
+/// solid[x + 1] has bit z + 1 set for every block in layer y that isn't air, for x and z in [-1, CUNK_CHUNK_SIZE]
+static void solid_layer(const PaddedChunk& chunk, int y, uint32_t solid[PaddedChunk::SIZE]) {
+    const auto& layer = chunk.blocks[y + 1];
+    for (int x = 0; x < PaddedChunk::SIZE; x++) {
+        uint32_t mask = 0;
+        for (int z = 0; z < PaddedChunk::SIZE; z++)
+            mask |= static_cast<uint32_t>(layer[z][x] != BlockAir) << z;
+        solid[x] = mask;
+    }
+}
+
+/// calls f(solid, above, below, minus_x, plus_x, minus_z, plus_z) with the solid bitmask of every row of
+/// CUNK_CHUNK_SIZE blocks along z in layers [y_begin, y_end) of the center chunk, and those of its six neighbouring rows
+template<typename F>
+static void for_each_solid_row(const PaddedChunk& chunk, int y_begin, int y_end, F f) {
+    constexpr uint32_t center = ((1u << CUNK_CHUNK_SIZE) - 1) << 1;
+    uint32_t layers[3][PaddedChunk::SIZE];
+    uint32_t* below = layers[0];
+    uint32_t* current = layers[1];
+    uint32_t* above = layers[2];
+    int current_y = y_begin - 2;
+    for (int y = y_begin; y < y_end; y++) {
+        if (chunk.empty_section[y / CUNK_CHUNK_SIZE])
+            continue;
+        if (current_y == y - 1) {
+            std::swap(below, current);
+            std::swap(current, above);
+            solid_layer(chunk, y + 1, above);
+        } else {
+            solid_layer(chunk, y - 1, below);
+            solid_layer(chunk, y, current);
+            solid_layer(chunk, y + 1, above);
+        }
+        current_y = y;
+
+        for (int x = 0; x < CUNK_CHUNK_SIZE; x++) {
+            const uint32_t row = current[x + 1];
+            f(row & center, above[x + 1], below[x + 1], current[x], current[x + 2], row << 1, row >> 1);
+        }
+    }
+}
+
+static size_t count_exposed_faces(const PaddedChunk& chunk, int y_begin, int y_end) {
+    size_t faces = 0;
+    for_each_solid_row(chunk, y_begin, y_end, [&](uint32_t solid, uint32_t above, uint32_t below, uint32_t minus_x, uint32_t plus_x, uint32_t minus_z, uint32_t plus_z) {
+        faces += std::popcount(solid & ~above) + std::popcount(solid & ~below)
+               + std::popcount(solid & ~minus_x) + std::popcount(solid & ~plus_x)
+               + std::popcount(solid & ~minus_z) + std::popcount(solid & ~plus_z);
+    });
+    return faces;
+}
+
+static size_t count_exposed_blocks(const PaddedChunk& chunk, int y_begin, int y_end) {
+    size_t blocks = 0;
+    for_each_solid_row(chunk, y_begin, y_end, [&](uint32_t solid, uint32_t above, uint32_t below, uint32_t minus_x, uint32_t plus_x, uint32_t minus_z, uint32_t plus_z) {
+        blocks += std::popcount(solid & ~(above & below & minus_x & plus_x & minus_z & plus_z));
+    });
+    return blocks;
+}
+
+size_t PaddedChunk::count_exposed_faces() const {
+    return ::count_exposed_faces(*this, 0, CUNK_CHUNK_MAX_HEIGHT);
+}
+
+size_t PaddedChunk::count_exposed_faces(int section) const {
+    return ::count_exposed_faces(*this, section * CUNK_CHUNK_SIZE, (section + 1) * CUNK_CHUNK_SIZE);
+}
+
+size_t PaddedChunk::count_exposed_blocks() const {
+    return ::count_exposed_blocks(*this, 0, CUNK_CHUNK_MAX_HEIGHT);
+}
+
+size_t PaddedChunk::count_exposed_blocks(int section) const {
+    return ::count_exposed_blocks(*this, section * CUNK_CHUNK_SIZE, (section + 1) * CUNK_CHUNK_SIZE);
+}
+
+void PaddedChunk::exposed_faces(int section, uint16_t exposed[FaceCount][CUNK_CHUNK_SIZE][CUNK_CHUNK_SIZE]) const {
+    if (empty_section[section]) {
+        memset(exposed, 0, FaceCount * CUNK_CHUNK_SIZE * CUNK_CHUNK_SIZE * sizeof(uint16_t));
+        return;
+    }
+    int row = 0;
+    for_each_solid_row(*this, section * CUNK_CHUNK_SIZE, (section + 1) * CUNK_CHUNK_SIZE, [&](uint32_t solid, uint32_t above, uint32_t below, uint32_t minus_x, uint32_t plus_x, uint32_t minus_z, uint32_t plus_z) {
+        const int y = row / CUNK_CHUNK_SIZE, x = row % CUNK_CHUNK_SIZE;
+        exposed[FaceMinusX][y][x] = static_cast<uint16_t>((solid & ~minus_x) >> 1);
+        exposed[FacePlusX][y][x] = static_cast<uint16_t>((solid & ~plus_x) >> 1);
+        exposed[FaceMinusZ][y][x] = static_cast<uint16_t>((solid & ~minus_z) >> 1);
+        exposed[FacePlusZ][y][x] = static_cast<uint16_t>((solid & ~plus_z) >> 1);
+        exposed[FaceMinusY][y][x] = static_cast<uint16_t>((solid & ~below) >> 1);
+        exposed[FacePlusY][y][x] = static_cast<uint16_t>((solid & ~above) >> 1);
+        row++;
+    });
+}
+
+uint8_t* mesher_scratch(size_t bytes) {
+    thread_local std::vector<uint8_t> scratch;
+    if (scratch.size() < bytes)
+        scratch.resize(bytes);
+    return scratch.data();
+}
+
+uint8_t* mesh_sections(
+    const PaddedChunk& chunk,
+    const std::function<size_t(int section)>& bound,
+    const std::function<size_t(int section, uint8_t* out)>& mesh,
+    size_t section_starts[CUNK_CHUNK_SECTIONS_COUNT + 1]
+) {
+    size_t bounds[CUNK_CHUNK_SECTIONS_COUNT];
+    JobPool::shared().parallel_for(CUNK_CHUNK_SECTIONS_COUNT, [&](size_t section) {
+        bounds[section] = chunk.empty_section[section] ? 0 : bound(section);
+    });
+
+    size_t offsets[CUNK_CHUNK_SECTIONS_COUNT + 1];
+    offsets[0] = 0;
+    for (int section = 0; section < CUNK_CHUNK_SECTIONS_COUNT; section++)
+        offsets[section + 1] = offsets[section] + bounds[section];
+
+    uint8_t* out = mesher_scratch(offsets[CUNK_CHUNK_SECTIONS_COUNT]);
+    size_t sizes[CUNK_CHUNK_SECTIONS_COUNT];
+    JobPool::shared().parallel_for(CUNK_CHUNK_SECTIONS_COUNT, [&](size_t section) {
+        sizes[section] = bounds[section] == 0 ? 0 : mesh(section, out + offsets[section]);
+        assert(sizes[section] <= bounds[section]);
+    });
+
+    // the bounds aren't tight for merging meshers, close the gaps
+    section_starts[0] = 0;
+    for (int section = 0; section < CUNK_CHUNK_SECTIONS_COUNT; section++) {
+        if (section_starts[section] != offsets[section])
+            memmove(out + section_starts[section], out + offsets[section], sizes[section]);
+        section_starts[section + 1] = section_starts[section] + sizes[section];
+    }
+    return out;
+}
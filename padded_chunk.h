@@ -0,0 +1,75 @@
+#ifndef SIGCRAFT_PADDED_CHUNK_H
+#define SIGCRAFT_PADDED_CHUNK_H
+
+#include "chunk_mesh.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+extern "C" {
+#include "enklume/block_data.h"
+}
+
+/**
+ * A copy of a chunk plus a one block border taken from its neighbours.
+ * Meshers read every block they need with a plain array index instead of going through access_safe,
+ * which has to pick the neighbour, bounds-check y and walk the section pointers for every single read.
+ * Everything below/above the world reads as air, missing neighbours read as `missing`: air by default,
+ * or a solid block for meshers that have to be conservative about what they can't see yet.
+ */
+struct PaddedChunk {
+    static constexpr int SIZE = CUNK_CHUNK_SIZE + 2;
+    static constexpr int HEIGHT = CUNK_CHUNK_MAX_HEIGHT + 2;
+    static_assert(BlockCount <= 256, "PaddedChunk stores block ids in a byte");
+
+    /// block ids, indexed [y + 1][z + 1][x + 1] like ChunkSection::block_data
+    uint8_t blocks[HEIGHT][SIZE][SIZE];
+    /// sections of the center chunk that are entirely air, and so emit no geometry
+    bool empty_section[CUNK_CHUNK_SECTIONS_COUNT];
+
+    PaddedChunk() = default;
+    explicit PaddedChunk(const ChunkNeighbors& neighbours, BlockId missing = BlockAir);
+
+    /// overwrites this with the chunk in the center of `neighbours`, see the constructor
+    void fill(const ChunkNeighbors& neighbours, BlockId missing = BlockAir);
+    /// a PaddedChunk owned by the calling thread, allocated once and refilled every time this is called
+    static PaddedChunk& scratch(const ChunkNeighbors& neighbours, BlockId missing = BlockAir);
+
+    /// how many faces of the center chunk border air, which is also an upper bound for greedily merged quads
+    size_t count_exposed_faces() const;
+    size_t count_exposed_faces(int section) const;
+    /// how many blocks of the center chunk have at least one face bordering air
+    size_t count_exposed_blocks() const;
+    size_t count_exposed_blocks(int section) const;
+    /// exposed[direction][y][x] has bit z set when the face in that FaceDirection of the block of the section
+    /// at (x, section * CUNK_CHUNK_SIZE + y, z) borders air
+    void exposed_faces(int section, uint16_t exposed[FaceCount][CUNK_CHUNK_SIZE][CUNK_CHUNK_SIZE]) const;
+
+    /// x and z in [-1, CUNK_CHUNK_SIZE], y in [-1, CUNK_CHUNK_MAX_HEIGHT]
+    BlockId get(int x, int y, int z) const {
+        return static_cast<BlockId>(blocks[y + 1][z + 1][x + 1]);
+    }
+};
+
+/**
+ * Memory owned by the calling thread for the CPU meshers to write their output into before it's uploaded.
+ * It grows to the largest size asked for and is then reused, so meshing a chunk doesn't allocate.
+ * The pointer stays valid until the next call on the same thread.
+ */
+uint8_t* mesher_scratch(size_t bytes);
+
+/**
+ * Meshes the sections of `chunk` in parallel on the shared JobPool. Every non-empty section first gets an upper bound
+ * on its output in bytes, the prefix sums of those are where each section writes its `mesh` output to.
+ * The sections are then moved together, section_starts[s] is the byte offset of section s in the returned memory
+ * and section_starts[CUNK_CHUNK_SECTIONS_COUNT] the total size. The memory is the calling thread's mesher_scratch().
+ */
+uint8_t* mesh_sections(
+    const PaddedChunk& chunk,
+    const std::function<size_t(int section)>& bound,
+    const std::function<size_t(int section, uint8_t* out)>& mesh,
+    size_t section_starts[CUNK_CHUNK_SECTIONS_COUNT + 1]
+);
+
+#endif
@@ -74,11 +74,11 @@ struct VoxelShaders : Shaders {
 };
 
 struct MeshShaders : Shaders {
-    MeshShaders(imr::Device& d, imr::Swapchain& swapchain)
+    MeshShaders(imr::Device& d, imr::Swapchain& swapchain, MeshFormat format = MeshVertices)
         : Shaders(
             d,
             swapchain,
-            { "basic.vert.spv", "basic.frag.spv" },
+            { format == MeshFaces ? "face.vert.spv" : "basic.vert.spv", "basic.frag.spv" },
             std::array<VkVertexInputBindingDescription,1>{{
                 {
                     .binding = 0,
@@ -86,28 +86,17 @@ struct MeshShaders : Shaders {
                     .inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
                 },
             }}.data(),
-            1,
-            std::array<VkVertexInputAttributeDescription,3>{{
+            // faces are read from a storage buffer instead
+            format == MeshFaces ? 0 : 1,
+            std::array<VkVertexInputAttributeDescription,1>{{
                 {
                     .location = 0,
                     .binding = 0,
-                    .format = VK_FORMAT_R16G16B16_SINT,
-                    .offset = 0,
-                },
-                {
-                    .location = 1,
-                    .binding = 0,
-                    .format = VK_FORMAT_R8G8B8_SNORM,
-                    .offset = offsetof(ChunkMesh::Vertex, nnx),
-                },
-                {
-                    .location = 2,
-                    .binding = 0,
-                    .format = VK_FORMAT_R8G8B8_UNORM,
-                    .offset = offsetof(ChunkMesh::Vertex, br),
+                    .format = VK_FORMAT_R32_UINT,
+                    .offset = offsetof(ChunkMesh::Vertex, packed),
                 },
             }}.data(),
-            3
+            format == MeshFaces ? 0 : 1
         )
     {}
 
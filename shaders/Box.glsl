@@ -1,6 +1,8 @@
 #ifndef Box_glsl
 #define Box_glsl
 
+#include "camera_planes.h"
+
 mat3 quat2mat(vec4 q) {
     q *= 1.41421356; //sqrt(2)
     return mat3(1.0 - q.y*q.y - q.z*q.z,  q.x*q.y + q.w*q.z,         q.x*q.z - q.w*q.y,
@@ -23,4 +25,131 @@ struct Ray {
 float safeInverse(float x) { return (x == 0.0) ? 1e12 : (1.0 / x); }
 vec3 safeInverse(vec3 v) { return vec3(safeInverse(v.x), safeInverse(v.y), safeInverse(v.z)); }
 
+float maxComponent(vec3 v) { return max (max(v.x, v.y), v.z); }
+
+// vec3 box.radius:       independent half-length along the X, Y, and Z axes
+// mat3 box.rotation:     box-to-world rotation (orthonormal 3x3 matrix) transformation
+// bool rayCanStartInBox: if true, assume the origin is never in a box. GLSL optimizes this at compile time
+// bool oriented:         if false, ignore box.rotation
+bool ourIntersectBoxCommon(Box box, Ray ray, out float distance, out vec3 normal, const bool rayCanStartInBox, const in bool oriented, in vec3 _invRayDirection) {
+
+    // Move to the box's reference frame. This is unavoidable and un-optimizable.
+    ray.origin = box.rotation * (ray.origin - box.center);
+    if (oriented) {
+        ray.direction = box.rotation * ray.direction;
+    }
+
+    // This "rayCanStartInBox" branch is evaluated at compile time because `const` in GLSL
+    // means compile-time constant. The multiplication by 1.0 will likewise be compiled out
+    // when rayCanStartInBox = false.
+    float winding;
+    if (rayCanStartInBox) {
+        // Winding direction: -1 if the ray starts inside of the box (i.e., and is leaving), +1 if it is starting outside of the box
+        winding = (maxComponent(abs(ray.origin) * box.invRadius) < 1.0) ? -1.0 : 1.0;
+    } else {
+        winding = 1.0;
+    }
+
+    // We'll use the negated sign of the ray direction in several places, so precompute it.
+    // The sign() instruction is fast...but surprisingly not so fast that storing the result
+    // temporarily isn't an advantage.
+    vec3 sgn = -sign(ray.direction);
+
+    // Ray-plane intersection. For each pair of planes, choose the one that is front-facing
+    // to the ray and compute the distance to it.
+    vec3 distanceToPlane = box.radius * winding * sgn - ray.origin;
+    if (oriented) {
+        distanceToPlane /= ray.direction;
+    } else {
+        distanceToPlane *= _invRayDirection;
+    }
+
+    // Perform all three ray-box tests and cast to 0 or 1 on each axis.
+    // Use a macro to eliminate the redundant code (no efficiency boost from doing so, of course!)
+    // Could be written with
+    #define TEST(U, VW)\
+         /* Is there a hit on this axis in front of the origin? Use multiplication instead of && for a small speedup */\
+         (distanceToPlane.U >= 0.0) && \
+         /* Is that hit within the face of the box? */\
+         all(lessThan(abs(ray.origin.VW + ray.direction.VW * distanceToPlane.U), box.radius.VW))
+
+    bvec3 test = bvec3(TEST(x, yz), TEST(y, zx), TEST(z, xy));
+
+    // CMOV chain that guarantees exactly one element of sgn is preserved and that the value has the right sign
+    sgn = test.x ? vec3(sgn.x, 0.0, 0.0) : (test.y ? vec3(0.0, sgn.y, 0.0) : vec3(0.0, 0.0, test.z ? sgn.z : 0.0));
+    #undef TEST
+
+    // At most one element of sgn is non-zero now. That element carries the negative sign of the
+    // ray direction as well. Notice that we were able to drop storage of the test vector from registers,
+    // because it will never be used again.
+
+    // Mask the distance by the non-zero axis
+    // Dot product is faster than this CMOV chain, but doesn't work when distanceToPlane contains nans or infs.
+    //
+    distance = (sgn.x != 0.0) ? distanceToPlane.x : ((sgn.y != 0.0) ? distanceToPlane.y : distanceToPlane.z);
+
+    // Normal must face back along the ray. If you need
+    // to know whether we're entering or leaving the box,
+    // then just look at the value of winding. If you need
+    // texture coordinates, then use box.invDirection * hitPoint.
+
+    if (oriented) {
+        normal = box.rotation * sgn;
+    } else {
+        normal = sgn;
+    }
+
+    return (sgn.x != 0) || (sgn.y != 0) || (sgn.z != 0);
+}
+
+// the color of `box` where a ray hits it at `intersectionPoint`: the block texture layers of `textureIndex`, or
+// `color` lit from a fixed direction
+vec4 shadeBoxHit(Box box, vec3 intersectionPoint, vec3 normal, vec3 color, uint textureIndex, bool texturesEnabled, sampler2DArray textures) {
+    vec4 colorOut;
+    if (texturesEnabled) {
+        vec3 localIntersectionPoint = box.rotation * (intersectionPoint - box.center); // rotate around (0, 0, 0)
+        vec3 localPos = (localIntersectionPoint / box.radius) * 0.5 + 0.5; // normalize from [-radius, radius] to [0, 1]
+
+        vec3 absLocalIntersection = abs(localIntersectionPoint);
+        vec3 normalizedAbs = absLocalIntersection / box.radius;
+
+        vec2 uv;
+        int faceIndex = 0;
+
+        // determine relevant axis
+        if (normalizedAbs.x >= normalizedAbs.y && normalizedAbs.x >= normalizedAbs.z) {
+            // side faces
+            vec2 faceSize = vec2(box.radius.z * 2, box.radius.y * 2);
+            uv = vec2(localPos.z, localPos.y) * max(faceSize, 1);
+        } else if (normalizedAbs.y >= normalizedAbs.z) {
+            // top-bottom faces
+            vec2 faceSize = box.radius.xz * 2;
+            uv = localPos.xz *  max(faceSize, 1);
+            // differentiate top and bottom
+            faceIndex = (localIntersectionPoint.y > 0.0) ? 1 : 2;
+        } else {
+            // front-back faces
+            vec2 faceSize = box.radius.xy * 2;
+            uv = vec2(localPos.x, localPos.y) * max(faceSize, 1);
+        }
+
+        int layer = int(textureIndex) * 3 + faceIndex;
+        colorOut = texture(textures, vec3(uv, layer));
+
+        // flat shading
+        if (faceIndex == 0) colorOut = colorOut * 0.6;
+        if (faceIndex == 2) colorOut = colorOut * 0.4;
+
+    } else {
+        colorOut = vec4(color * 0.8 + 0.2 * dot(normal, normalize(vec3(1.0, 0.5, 0.1))), 1.0);
+    }
+
+    return colorOut;
+}
+
+// the depth of a hit `distance` away from the camera, with the near and far plane of camera_get_view_mat4()
+float hitDepth(float distance) {
+    return clamp((distance - CAMERA_NEAR) / (CAMERA_FAR - CAMERA_NEAR), 0.0, 1.0);
+}
+
 #endif
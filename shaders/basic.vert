@@ -9,25 +9,44 @@ out vec3 color;
 layout(location = 1)
 out vec3 normal;
 
+// ChunkMesh::Vertex: x 5 bits, y 9 bits, z 5 bits, face direction 3 bits, block id 8 bits
 layout(location = 0)
-in ivec3 vertexIn;
+in uint vertexIn;
 
-layout(location = 1)
-in vec3 normalIn;
+layout(scalar, buffer_reference) readonly buffer BlockColors {
+    vec3 colors[];
+};
 
-layout(location = 2)
-in vec3 colorIn;
+// only used by face.vert, declared here to share the push constant layout
+layout(scalar, buffer_reference) readonly buffer Faces {
+    uint faces[];
+};
 
 layout(scalar, push_constant) uniform T {
     mat4 matrix;
     ivec3 chunk_position;
     float time;
+    BlockColors block_colors;
+    Faces faces;
 } push_constants;
 
+// indexed by FaceDirection
+const vec3 face_normals[6] = vec3[](
+    vec3(-1.0,  0.0,  0.0),
+    vec3( 1.0,  0.0,  0.0),
+    vec3( 0.0,  0.0, -1.0),
+    vec3( 0.0,  0.0,  1.0),
+    vec3( 0.0, -1.0,  0.0),
+    vec3( 0.0,  1.0,  0.0)
+);
+
 void main() {
+    ivec3 position = ivec3(vertexIn & 0x1Fu, (vertexIn >> 5) & 0x1FFu, (vertexIn >> 14) & 0x1Fu);
+    uint face = (vertexIn >> 19) & 0x7u;
+    uint block = (vertexIn >> 22) & 0xFFu;
+
     mat4 matrix = push_constants.matrix;
-    gl_Position = matrix * vec4(vec3(vertexIn + push_constants.chunk_position * 16), 1.0);
-    int primid = gl_VertexIndex / 6;
-    color = colorIn;
-    normal = normalIn;
-}
\ No newline at end of file
+    gl_Position = matrix * vec4(vec3(position + push_constants.chunk_position * 16), 1.0);
+    color = push_constants.block_colors.colors[block];
+    normal = face_normals[face];
+}
@@ -0,0 +1,10 @@
+#ifndef camera_planes_h
+#define camera_planes_h
+
+// The near and far plane of camera_get_view_mat4() in camera.cpp, included by it and by Box.glsl's hitDepth(),
+// so the depth the ray traced shaders write matches that of the rasterized geometry.
+// The far plane is far enough for the edge of a 64 chunk render distance.
+#define CAMERA_NEAR 0.1f
+#define CAMERA_FAR 1600.0f
+
+#endif
@@ -0,0 +1,73 @@
+#version 450
+#extension GL_EXT_shader_image_load_formatted : require
+#extension GL_EXT_scalar_block_layout : require
+#extension GL_EXT_buffer_reference : require
+
+layout(location = 0)
+out vec3 color;
+
+layout(location = 1)
+out vec3 normal;
+
+layout(scalar, buffer_reference) readonly buffer BlockColors {
+    vec3 colors[];
+};
+
+// ChunkMesh::Face: x 4 bits, y 9 bits, z 4 bits, face direction 3 bits, two sizes 4 bits each, block id 4 bits
+layout(scalar, buffer_reference) readonly buffer Faces {
+    uint faces[];
+};
+
+layout(scalar, push_constant) uniform T {
+    mat4 matrix;
+    ivec3 chunk_position;
+    float time;
+    BlockColors block_colors;
+    Faces faces;
+} push_constants;
+
+// indexed by FaceDirection
+const vec3 face_normals[6] = vec3[](
+    vec3(-1.0,  0.0,  0.0),
+    vec3( 1.0,  0.0,  0.0),
+    vec3( 0.0,  0.0, -1.0),
+    vec3( 0.0,  0.0,  1.0),
+    vec3( 0.0, -1.0,  0.0),
+    vec3( 0.0,  1.0,  0.0)
+);
+
+// the corners of each face of a unit block, in the same order as the face macros in chunk_mesh.cpp
+const ivec3 face_corners[6][4] = ivec3[6][4](
+    ivec3[4](ivec3(0, 0, 0), ivec3(0, 1, 0), ivec3(0, 1, 1), ivec3(0, 0, 1)),
+    ivec3[4](ivec3(1, 0, 0), ivec3(1, 0, 1), ivec3(1, 1, 1), ivec3(1, 1, 0)),
+    ivec3[4](ivec3(0, 0, 0), ivec3(1, 0, 0), ivec3(1, 1, 0), ivec3(0, 1, 0)),
+    ivec3[4](ivec3(0, 0, 1), ivec3(0, 1, 1), ivec3(1, 1, 1), ivec3(1, 0, 1)),
+    ivec3[4](ivec3(0, 0, 0), ivec3(0, 0, 1), ivec3(1, 0, 1), ivec3(1, 0, 0)),
+    ivec3[4](ivec3(0, 1, 0), ivec3(1, 1, 0), ivec3(1, 1, 1), ivec3(0, 1, 1))
+);
+
+void main() {
+    // drawn with the shared quad index buffer, so gl_VertexIndex is 4 * face + corner
+    uint face_record = push_constants.faces.faces[uint(gl_VertexIndex) >> 2];
+    uint corner = uint(gl_VertexIndex) & 3u;
+
+    ivec3 origin = ivec3(face_record & 0xFu, (face_record >> 4) & 0x1FFu, (face_record >> 13) & 0xFu);
+    uint face = (face_record >> 17) & 0x7u;
+    int size_a = int((face_record >> 20) & 0xFu) + 1;
+    int size_b = int((face_record >> 24) & 0xFu) + 1;
+    uint block = face_record >> 28;
+
+    ivec3 size;
+    if (face < 2)
+        size = ivec3(1, size_a, size_b);
+    else if (face < 4)
+        size = ivec3(size_a, size_b, 1);
+    else
+        size = ivec3(size_a, 1, size_b);
+    ivec3 position = origin + face_corners[face][corner] * size;
+
+    mat4 matrix = push_constants.matrix;
+    gl_Position = matrix * vec4(vec3(position + push_constants.chunk_position * 16), 1.0);
+    color = push_constants.block_colors.colors[block];
+    normal = face_normals[face];
+}
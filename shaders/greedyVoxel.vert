@@ -1,6 +1,7 @@
 #version 450
 #extension GL_EXT_scalar_block_layout : require
 #extension GL_EXT_buffer_reference : require
+#extension GL_GOOGLE_include_directive : require
 
 struct Box {
     vec3 center;
@@ -9,22 +10,32 @@ struct Box {
     mat3 rotation;
 };
 
-struct GreedyVoxel { ivec3 start; ivec3 end; vec3 color; uint textureIndex; };
+// GreedyVoxel::pack(): the lowest corner and the faces with blocks that border air like a Voxel,
+// then the block id in bits 0-7 and the size minus one along x, y and z in 8-11, 12-15 and 16-19.
+// Boxes of a batch of chunks have the upper bits of x and z in 23-25 and 26-28 of the first word,
+// those of their size along x and z in 20-22 and 23-25 of the second.
+struct GreedyVoxel { uint start; uint block_size; };
+struct BlockProperties { vec3 color; uint textureIndex; };
 
 layout(scalar, buffer_reference) readonly buffer VoxelBuffer {
     GreedyVoxel voxels[];
 };
+layout(scalar, buffer_reference) readonly buffer BlockTable {
+    BlockProperties blocks[];
+};
 layout(scalar, push_constant) uniform T {
     mat4 proj_view_mat;            // 64
     mat4 inverse_proj_view_matrix; // 64
-    vec3 camera_position;          // 16 (4 padding)
-    VoxelBuffer voxel_buffer;      // 8
+    vec3 camera_position;          // 12
+    float time;                    // 4, seconds since the game started
+    BlockTable block_table;        // 8
     vec2 screen_size;              // 8
     bool texturesEnabled;          // 4
-    mat4 rotation;                 // 64
-    float radius;                  // 4
-    float height_adjust;           // 4
-} push_constants;                  // 236 (confirmed by renderdoc)
+    // the rest changes with every chunk
+    float spawn_time;              // 4, when the chunk's loading animation started
+    VoxelBuffer voxel_buffer;      // 8
+    ivec2 chunk_position;          // 8
+} push_constants;                  // 184
 
 layout(location = 0) out Box box;
 layout(location = 6) out vec3 color;
@@ -75,141 +86,45 @@ void quadricProj(in vec3 osPosition, in float sphereRadius, in mat4 objectToScre
 }
 
 
-// Signed distance field to represent the planes (clip space)
-// f(p) <= 0 is inside for each plane
-float distRight(vec4 p) { return  p.x - p.w; }  // x <= w
-float distLeft(vec4 p) { return -p.x - p.w; }   // x >= -w
-float distTop(vec4 p) { return  p.y - p.w; }    // y <= w
-float distBottom(vec4 p) { return -p.y - p.w; } // y >= -w
-float distNear(vec4 p) { return -p.z - p.w; }   // z >= -w
+#include "voxel_projection.glsl"
 
-bool insideAllPlanes(vec4 p) {
-    // Epsilon for numerical robustness, otherwise flickering occurs
-    // Relative epsilon (scales with |w|), constant epsilon actually does not work
-    float eps = 1e-6 * max(abs(p.w), 1.0);
-
-    if ( distLeft(p) > eps) return false;
-    if ( distRight(p) > eps) return false;
-    if ( distBottom(p) > eps) return false;
-    if ( distTop(p) > eps) return false;
-    if ( distNear(p) > eps) return false;
-    return true;
-}
+void main() {
+    const float CLIPPING_THRESHOLD = 200.0;
 
-// See https://www.cs.ucr.edu/~shinar/courses/cs130-winter-2021/content/clipping.pdf
-// and the above distance functions as explanation for this
-// Edge: a--b, dA = dist(a), dB = dist(b)
-vec4 intersectPlane(vec4 a, vec4 b, float dA, float dB) {
-    float t = dA / (dA - dB);
-    return mix(a, b, clamp(t, 0.0, 1.0));
-}
+    float progress = loadingProgress(push_constants.time, push_constants.spawn_time);
+    mat4 rotation = loadingRotation(progress);
 
-// Plane distance function array (function pointers not allowed; use switch)
-float planeDist(int pid, vec4 p) {
-    if (pid == 0) return distLeft(p);
-    if (pid == 1) return distRight(p);
-    if (pid == 2) return distBottom(p);
-    if (pid == 3) return distTop(p);
-    if (pid == 4) return distNear(p);
-    return -1; // unreachable
-}
+    GreedyVoxel voxel = push_constants.voxel_buffer.voxels[gl_InstanceIndex];
+    vec2 corner = fullscreenVerts[gl_VertexIndex];
 
-// Compute AABB of the voxel clipped by the frustum
-void computeClippedAABB(
-    vec3 wsCenter,
-    vec3 radius,
-    mat4 projView,
-out vec2 ndcMin,
-out vec2 ndcMax
-) {
-    // Corner points in clip space
-    vec4 C[8];
-    {
-        vec3 mn = wsCenter - radius;
-        vec3 mx = wsCenter + radius;
-        C[0] = projView * vec4(mn.x, mn.y, mn.z, 1.0);
-        C[1] = projView * vec4(mn.x, mn.y, mx.z, 1.0);
-        C[2] = projView * vec4(mn.x, mx.y, mn.z, 1.0);
-        C[3] = projView * vec4(mn.x, mx.y, mx.z, 1.0);
-        C[4] = projView * vec4(mx.x, mn.y, mn.z, 1.0);
-        C[5] = projView * vec4(mx.x, mn.y, mx.z, 1.0);
-        C[6] = projView * vec4(mx.x, mx.y, mn.z, 1.0);
-        C[7] = projView * vec4(mx.x, mx.y, mx.z, 1.0);
-    }
-    // 12 edges by corner indices
-    const ivec2 BOX_EDGES[12] = ivec2[12](
-    ivec2(0,1), ivec2(0,2), ivec2(0,4),
-    ivec2(1,3), ivec2(1,5),
-    ivec2(2,3), ivec2(2,6),
-    ivec2(3,7),
-    ivec2(4,5), ivec2(4,6),
-    ivec2(5,7),
-    ivec2(6,7)
+    ivec3 chunkOrigin = ivec3(push_constants.chunk_position.x, 0, push_constants.chunk_position.y) * 16;
+    uvec3 local = uvec3(
+        (voxel.start & 0xFu) | ((voxel.start >> 23) & 0x7u) << 4,
+        (voxel.start >> 4) & 0x1FFu,
+        ((voxel.start >> 13) & 0xFu) | ((voxel.start >> 26) & 0x7u) << 4
     );
-
-    // upper bound on candidates: 8 corners + (12 edges * 5 planes) => at most 68;
-    const int MAX_CAND = 72;
-    vec4 cand[MAX_CAND];
-    int  count = 0;
-
-    // add corners that are inside all planes
-    for (int i = 0; i < 8; ++i) {
-        if (insideAllPlanes(C[i])) {
-            cand[count++] = C[i];
-        }
-    }
-
-    // add edge/plane intersections
-    const int PLANES = 5; // left, right, bottom, top, near
-    for (int edge = 0; edge < 12; edge++) {
-        vec4 A = C[BOX_EDGES[edge].x];
-        vec4 B = C[BOX_EDGES[edge].y];
-
-        for (int plane = 0; plane < PLANES; plane++) {
-            float dA = planeDist(plane, A);
-            float dB = planeDist(plane, B);
-
-            const float eps = 1e-7;
-            // const bool oppositeSides = (dA < -eps && dB > eps) || (dA > eps && dB < -eps);
-            if (dA * dB < 0) {
-                vec4 its = intersectPlane(A, B, dA, dB);
-                if (insideAllPlanes(its)) {
-                    cand[count++] = its;
-                }
-            }
-        }
-    }
-
-    // if completely clipped, return empty aabb
-    if (count == 0) {
-        ndcMin = vec2(1e9);
-        ndcMax = vec2(-1e9);
+    uvec3 size = uvec3(
+        ((voxel.block_size >> 8) & 0xFu) | ((voxel.block_size >> 20) & 0x7u) << 4,
+        (voxel.block_size >> 12) & 0xFu,
+        ((voxel.block_size >> 16) & 0xFu) | ((voxel.block_size >> 23) & 0x7u) << 4
+    ) + 1u;
+    ivec3 start = chunkOrigin + ivec3(local);
+    ivec3 end = start + ivec3(size);
+    uint exposedFaces = (voxel.start >> 17) & 0x3Fu;
+    BlockProperties properties = push_constants.block_table.blocks[voxel.block_size & 0xFFu];
+
+    // the box is only drawn when one of its sides with blocks bordering air faces the camera.
+    // While the loading animation plays the boxes are smaller and rotated, so there are gaps to see through.
+    uint facing = facingFaces(vec3(start), vec3(end), push_constants.camera_position);
+    if (progress >= 1.0 && facing != 0u && (facing & exposedFaces) == 0u) {
+        gl_Position = vec4(-1.0, -1.0, -1.0, -1.0);
         return;
     }
 
-    vec2 mn = vec2(1e9);
-    vec2 mx = vec2(-1e9);
-    for (int i = 0; i < count; i++) {
-        vec2 p = cand[i].xy / cand[i].w; // perspective divide to NDC
-        mn = min(mn, p);
-        mx = max(mx, p);
-    }
-
-    ndcMin = mn;
-    ndcMax = mx;
-}
-
-
-void main() {
-    const float CLIPPING_THRESHOLD = 200.0;
-
-    GreedyVoxel voxel = push_constants.voxel_buffer.voxels[gl_InstanceIndex];
-    vec2 corner = fullscreenVerts[gl_VertexIndex];
-
-    vec3 center = (vec3(voxel.start) + vec3(voxel.end)) / 2;
+    vec3 center = (vec3(start) + vec3(end)) / 2 + vec3(0.0, (1.0 - progress) * LOADING_HEIGHT, 0.0);
     vec4 position = push_constants.proj_view_mat * vec4(center, 1.0);
     float pointSize;
-    vec3 halfSize = abs((vec3(voxel.start) - vec3(voxel.end)) / 2);
+    vec3 halfSize = abs((vec3(start) - vec3(end)) / 2) * loadingScale(progress);
     float sphereRadius = length(halfSize);
     quadricProj(center, sphereRadius, push_constants.proj_view_mat, push_constants.screen_size * 0.5, position, pointSize);
 
@@ -225,7 +140,7 @@ void main() {
     // check if we need to compute the AABB greedily
     if (pointSize * 2.0 > CLIPPING_THRESHOLD) {
         vec2 ndcMin, ndcMax;
-        computeClippedAABB(center, halfSize, push_constants.proj_view_mat, ndcMin, ndcMax);
+        computeClippedAABB(center, halfSize, push_constants.proj_view_mat, rotation, ndcMin, ndcMax);
 
         // If completely clipped, return early
         // This should only be the case, if we do chunk-only/no frustum culling, so some voxels might not be visible
@@ -243,13 +158,13 @@ void main() {
         position.xy = ndcXY * position.w;
     }
 
-    box = Box(center, halfSize, invHalf, mat3(1.0));
-    color = voxel.color;
+    box = Box(center, halfSize, invHalf, transpose(mat3(rotation)));
+    color = properties.color;
     cameraPosition = push_constants.camera_position;
     inverseProjViewMatrix = push_constants.inverse_proj_view_matrix;
     screenSize = push_constants.screen_size;
     quad = (corner * 0.5) + 0.5;
-    voxelTextureIndex = voxel.textureIndex;
+    voxelTextureIndex = properties.textureIndex;
     texturesEnabled = int(push_constants.texturesEnabled);
 
     float stochasticCoverage = pointSize * pointSize;
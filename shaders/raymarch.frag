@@ -0,0 +1,136 @@
+#version 450
+#extension GL_EXT_scalar_block_layout : require
+#extension GL_EXT_buffer_reference : require
+#extension GL_GOOGLE_include_directive : require
+
+#include "Box.glsl"
+
+// Draws the blocks of a BrickMap by marching a ray per pixel through it, a DDA over the sections first, and over the
+// blocks of the sections that have a brick. Blocks are centered on their position, like in the other modes.
+
+const int CHUNK_SIZE = 16;
+const int SECTIONS = 24;
+// the most steps either level takes per pixel, so a ray that grazes the terrain can't take forever
+const int MAX_SECTION_STEPS = 512;
+const int MAX_BLOCK_STEPS = 3 * CHUNK_SIZE;
+
+// BrickMap::Column
+struct Column {
+    ivec2 chunk;
+    int bricks[SECTIONS];
+};
+struct BlockProperties { vec3 color; uint textureIndex; };
+
+layout(scalar, buffer_reference) readonly buffer Grid {
+    Column columns[];
+};
+// Brick: a byte per block, indexed [y][z][x]
+layout(scalar, buffer_reference) readonly buffer Bricks {
+    uint words[];
+};
+layout(scalar, buffer_reference) readonly buffer BlockTable {
+    BlockProperties blocks[];
+};
+layout(scalar, push_constant) uniform T {
+    mat4 inverse_proj_view_matrix; // 64
+    vec3 camera_position;          // 12
+    bool textures_enabled;         // 4
+    vec2 screen_size;              // 8
+    Grid grid;                     // 8
+    Bricks bricks;                 // 8
+    BlockTable block_table;        // 8
+    int grid_size;                 // 4, columns per axis
+    float max_distance;            // 4, how far rays go
+} push_constants;                  // 120
+
+layout(location = 0) out vec4 colorOut;
+
+layout(set = 0, binding = 0) uniform sampler2DArray textures;
+
+// the brick of section `section` of the chunk at `chunk`, -1 if it's air or not in the grid
+int brickAt(ivec2 chunk, int section) {
+    if (section < 0 || section >= SECTIONS)
+        return -1;
+    int size = push_constants.grid_size;
+    ivec2 cell = ((chunk % size) + size) % size;
+    Column column = push_constants.grid.columns[cell.x * size + cell.y];
+    if (column.chunk != chunk)
+        return -1;
+    return column.bricks[section];
+}
+
+uint blockAt(int brick, ivec3 local) {
+    uint offset = uint(brick) * 4096u + uint(local.y * 256 + local.z * 16 + local.x);
+    return (push_constants.bricks.words[offset >> 2] >> ((offset & 3u) * 8u)) & 0xFFu;
+}
+
+// which axis the ray leaves the current cell through, 0-2
+int exitAxis(vec3 tMax) {
+    return tMax.x < tMax.y ? (tMax.x < tMax.z ? 0 : 2) : (tMax.y < tMax.z ? 1 : 2);
+}
+
+void main() {
+    // the ray through this pixel, like voxel.frag builds it
+    vec3 ndc = vec3(gl_FragCoord.xy / push_constants.screen_size, 1.0) * 2.0 - 1.0;
+    vec4 clip = push_constants.inverse_proj_view_matrix * vec4(ndc, 1.0);
+    vec3 rayDirection = normalize(clip.xyz / clip.w - push_constants.camera_position);
+
+    // in the space of cells, where block x covers [x, x + 1)
+    vec3 origin = push_constants.camera_position + 0.5;
+    vec3 direction = rayDirection;
+    vec3 invDirection = safeInverse(direction);
+
+    // the sections, stepping from one to the next along the axis whose boundary the ray reaches first
+    ivec3 stepDir = ivec3(sign(direction));
+    ivec3 cell = ivec3(floor(origin / float(CHUNK_SIZE)));
+    vec3 tMax = mix((vec3(cell + max(stepDir, 0)) * float(CHUNK_SIZE) - origin) * invDirection, vec3(1e30), equal(stepDir, ivec3(0)));
+    vec3 tDelta = abs(float(CHUNK_SIZE) * invDirection);
+    float t = 0.0;
+    for (int sectionStep = 0; sectionStep < MAX_SECTION_STEPS && t < push_constants.max_distance; sectionStep++) {
+        // above or below the world and going further away
+        if ((cell.y < 0 && stepDir.y <= 0) || (cell.y >= SECTIONS && stepDir.y >= 0))
+            break;
+        int brick = brickAt(cell.xz, cell.y);
+        int sectionAxis = exitAxis(tMax);
+        float tSectionExit = tMax[sectionAxis];
+
+        if (brick >= 0) {
+            // the blocks of the section, from where the ray entered it
+            ivec3 sectionOrigin = cell * CHUNK_SIZE;
+            vec3 entry = origin + direction * t;
+            ivec3 block = clamp(ivec3(floor(entry)), sectionOrigin, sectionOrigin + CHUNK_SIZE - 1);
+            vec3 tBlock = mix((vec3(block + max(stepDir, 0)) - origin) * invDirection, vec3(1e30), equal(stepDir, ivec3(0)));
+            vec3 tBlockDelta = abs(invDirection);
+            for (int blockStep = 0; blockStep < MAX_BLOCK_STEPS; blockStep++) {
+                uint id = blockAt(brick, block - sectionOrigin);
+                if (id != 0u) {
+                    // shade it like voxel.frag shades a voxel's box
+                    BlockProperties properties = push_constants.block_table.blocks[id];
+                    Box box = Box(vec3(block), vec3(0.5), vec3(2.0), mat3(1.0));
+                    Ray ray = Ray(push_constants.camera_position, rayDirection);
+                    float distance;
+                    vec3 normal;
+                    if (!ourIntersectBoxCommon(box, ray, distance, normal, true, false, invDirection)) {
+                        // only grazing its edge, where the march entered it will do
+                        distance = t;
+                        normal = vec3(0.0, 1.0, 0.0);
+                    }
+                    vec3 intersectionPoint = ray.origin + ray.direction * distance;
+                    colorOut = shadeBoxHit(box, intersectionPoint, normal, properties.color, properties.textureIndex, push_constants.textures_enabled, textures);
+                    gl_FragDepth = hitDepth(distance);
+                    return;
+                }
+                int axis = exitAxis(tBlock);
+                if (tBlock[axis] >= tSectionExit)
+                    break;
+                block[axis] += stepDir[axis];
+                tBlock[axis] += tBlockDelta[axis];
+            }
+        }
+
+        t = tSectionExit;
+        cell[sectionAxis] += stepDir[sectionAxis];
+        tMax[sectionAxis] += tDelta[sectionAxis];
+    }
+    discard;
+}
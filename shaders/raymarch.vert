@@ -0,0 +1,12 @@
+#version 450
+
+// one triangle covering the screen, raymarch.frag or splat_resolve.frag do the rest
+const vec2 fullscreenVerts[3] = vec2[](
+    vec2(-1.0, -1.0),
+    vec2( 3.0, -1.0),
+    vec2(-1.0,  3.0)
+);
+
+void main() {
+    gl_Position = vec4(fullscreenVerts[gl_VertexIndex], 0.0, 1.0);
+}
@@ -0,0 +1,67 @@
+#ifndef splat_glsl
+#define splat_glsl
+
+// What splat.comp and splat_resolve.frag share: VoxelSplatter's buffers, and the boxes of the voxels as voxel.vert
+// and greedyVoxel.vert draw them. Needs Box.glsl and voxel_projection.glsl.
+
+// the id a voxel is splatted with: the index of its SplatDraw in the upper 15 bits, its own in the lower 17
+const uint VOXEL_INDEX_BITS = 17u;
+// both words of a pixel nothing was splatted into
+const uint EMPTY = 0xFFFFFFFFu;
+
+// GreedyVoxel::pack(); a Voxel is the same bits, just without the ones of batches
+struct GreedyVoxel { uint start; uint block_size; };
+
+layout(scalar, buffer_reference) readonly buffer VoxelBuffer {
+    GreedyVoxel voxels[];
+};
+layout(scalar, buffer_reference) readonly buffer Words {
+    uint words[];
+};
+
+// VoxelSplatter::SplatDraw
+struct SplatDraw {
+    VoxelBuffer voxels;
+    Words indirect;          // a VkDrawIndirectCommand with the number of voxels as its instance count, if counted
+    ivec2 chunk_position;
+    float spawn_time;
+    uint voxel_count;
+    uint counted;
+    uint padding;
+};
+
+layout(scalar, buffer_reference) readonly buffer Draws {
+    SplatDraw draws[];
+};
+
+// the ray through the center of `pixel`, like voxel.frag builds it
+Ray pixelRay(ivec2 pixel, vec2 screenSize, mat4 inverseProjView, vec3 cameraPosition) {
+    vec3 ndc = vec3((vec2(pixel) + 0.5) / screenSize, 1.0) * 2.0 - 1.0;
+    vec4 clip = inverseProjView * vec4(ndc, 1.0);
+    return Ray(cameraPosition, normalize(clip.xyz / clip.w - cameraPosition));
+}
+
+// the box `voxel` is drawn as `progress` into the loading animation of its chunk, with the bounds it has once that is
+// done in `mn` and `mx`. Greedy voxels cover [start, start + size), the others are centered on their position.
+Box voxelBox(GreedyVoxel voxel, ivec2 chunkPosition, float progress, bool greedy, out vec3 mn, out vec3 mx) {
+    ivec3 chunkOrigin = ivec3(chunkPosition.x, 0, chunkPosition.y) * 16;
+    uvec3 local = uvec3(
+        (voxel.start & 0xFu) | ((voxel.start >> 23) & 0x7u) << 4,
+        (voxel.start >> 4) & 0x1FFu,
+        ((voxel.start >> 13) & 0xFu) | ((voxel.start >> 26) & 0x7u) << 4
+    );
+    vec3 size = vec3(uvec3(
+        ((voxel.block_size >> 8) & 0xFu) | ((voxel.block_size >> 20) & 0x7u) << 4,
+        (voxel.block_size >> 12) & 0xFu,
+        ((voxel.block_size >> 16) & 0xFu) | ((voxel.block_size >> 23) & 0x7u) << 4
+    ) + 1u);
+    mn = vec3(chunkOrigin + ivec3(local)) - (greedy ? 0.0 : 0.5);
+    mx = mn + size;
+
+    mat4 rotation = loadingRotation(progress);
+    vec3 halfSize = size * 0.5 * loadingScale(progress);
+    vec3 center = (mn + mx) * 0.5 + vec3(0.0, (1.0 - progress) * LOADING_HEIGHT, 0.0);
+    return Box(center, halfSize, 1.0 / halfSize, transpose(mat3(rotation)));
+}
+
+#endif
@@ -0,0 +1,62 @@
+#version 450
+#extension GL_EXT_scalar_block_layout : require
+#extension GL_EXT_buffer_reference : require
+#extension GL_GOOGLE_include_directive : require
+
+#include "Box.glsl"
+#include "voxel_projection.glsl"
+#include "splat.glsl"
+
+// Shades every pixel once, with the voxel splat.comp found nearest for it, like voxel.frag would have.
+
+struct BlockProperties { vec3 color; uint textureIndex; };
+
+// per pixel the id of the nearest voxel, then its distance's bits
+layout(scalar, buffer_reference) readonly buffer Visibility {
+    uint words[];
+};
+layout(scalar, buffer_reference) readonly buffer BlockTable {
+    BlockProperties blocks[];
+};
+layout(scalar, push_constant) uniform T {
+    mat4 inverse_proj_view_matrix; // 64
+    vec3 camera_position;          // 12
+    float time;                    // 4
+    vec2 screen_size;              // 8
+    bool greedy;                   // 4
+    bool textures_enabled;         // 4
+    Visibility visibility;         // 8
+    Draws draws;                   // 8
+    BlockTable block_table;        // 8
+} push_constants;                  // 120
+
+layout(location = 0) out vec4 colorOut;
+
+layout(set = 0, binding = 0) uniform sampler2DArray textures;
+
+void main() {
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    uint at = uint(pixel.y) * uint(push_constants.screen_size.x) + uint(pixel.x);
+    uint id = push_constants.visibility.words[at * 2u];
+    if (id == EMPTY)
+        discard;
+
+    SplatDraw draw = push_constants.draws.draws[id >> VOXEL_INDEX_BITS];
+    GreedyVoxel voxel = draw.voxels.voxels[id & ((1u << VOXEL_INDEX_BITS) - 1u)];
+    float progress = loadingProgress(push_constants.time, draw.spawn_time);
+    vec3 mn, mx;
+    Box box = voxelBox(voxel, draw.chunk_position, progress, push_constants.greedy, mn, mx);
+    BlockProperties properties = push_constants.block_table.blocks[voxel.block_size & 0xFFu];
+
+    Ray ray = pixelRay(pixel, push_constants.screen_size, push_constants.inverse_proj_view_matrix, push_constants.camera_position);
+    float distance;
+    vec3 normal;
+    // the same intersection splat.comp found, this time for the normal as well
+    if (!ourIntersectBoxCommon(box, ray, distance, normal, true, true, 1.0 / ray.direction)) {
+        distance = uintBitsToFloat(push_constants.visibility.words[at * 2u + 1u]);
+        normal = vec3(0.0, 1.0, 0.0);
+    }
+    vec3 intersectionPoint = ray.origin + ray.direction * distance;
+    colorOut = shadeBoxHit(box, intersectionPoint, normal, properties.color, properties.textureIndex, push_constants.textures_enabled, textures);
+    gl_FragDepth = hitDepth(distance);
+}
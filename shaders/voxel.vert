@@ -1,6 +1,7 @@
 #version 450
 #extension GL_EXT_scalar_block_layout : require
 #extension GL_EXT_buffer_reference : require
+#extension GL_GOOGLE_include_directive : require
 
 struct Box {
     vec3 center;
@@ -9,22 +10,30 @@ struct Box {
     mat3 rotation;
 };
 
-struct Voxel { ivec3 position; vec3 color; uint textureIndex; };
+// Voxel::pack(): bits 0-3 x, 4-12 y, 13-16 z within the chunk, 17-22 the faces that border air; then the block id in
+// bits 0-7 and, for the cells of lod_chunk_voxels(), the size of the cube minus one in bits 8-11
+struct Voxel { uint position; uint block; };
+struct BlockProperties { vec3 color; uint textureIndex; };
 
 layout(scalar, buffer_reference) readonly buffer VoxelBuffer {
     Voxel voxels[];
 };
+layout(scalar, buffer_reference) readonly buffer BlockTable {
+    BlockProperties blocks[];
+};
 layout(scalar, push_constant) uniform T {
     mat4 proj_view_mat;            // 64
     mat4 inverse_proj_view_matrix; // 64
-    vec3 camera_position;          // 16 (4 padding)
-    VoxelBuffer voxel_buffer;      // 8
+    vec3 camera_position;          // 12
+    float time;                    // 4, seconds since the game started
+    BlockTable block_table;        // 8
     vec2 screen_size;              // 8
     bool texturesEnabled;          // 4
-    mat4 rotation;                 // 64
-    float radius;                  // 4
-    float height_adjust;           // 4
-} push_constants;                  // 236 (confirmed by renderdoc)
+    // the rest changes with every chunk
+    float spawn_time;              // 4, when the chunk's loading animation started
+    VoxelBuffer voxel_buffer;      // 8
+    ivec2 chunk_position;          // 8
+} push_constants;                  // 184
 
 layout(location = 0) out Box box;
 layout(location = 6) out vec3 color;
@@ -51,10 +60,9 @@ const vec2 fullscreenVerts[6] = vec2[](
     vec2(-1.0,  1.0)
 );
 
-void quadricProj(in vec3 osPosition, in mat4 objectToScreenMatrix, in vec2 halfScreenSize, inout vec4 position, inout float pointSize) {
+void quadricProj(in vec3 osPosition, in float voxelSize, in mat4 objectToScreenMatrix, in vec2 halfScreenSize, inout vec4 position, inout float pointSize) {
     const vec4 quadricMat = vec4(1.0, 1.0, 1.0, -1.0); // x^2 + y^2 + z^2 - r^2 = 0
-    // float sphereRadius = voxelSize * 1.732051; // uncomment if size becomes variable
-    float sphereRadius = 0.86602540378; // 1.732051;
+    float sphereRadius = voxelSize * 0.86602540378;
     vec4 sphereCenter = vec4(osPosition.xyz, 1.0);
     mat4 modelViewProj = transpose(objectToScreenMatrix);
 
@@ -77,148 +85,40 @@ void quadricProj(in vec3 osPosition, in mat4 objectToScreenMatrix, in vec2 halfS
 }
 
 
-// Signed distance field to represent the planes (clip space)
-// f(p) <= 0 is inside for each plane
-float distRight(vec4 p) { return  p.x - p.w; }  // x <= w
-float distLeft(vec4 p) { return -p.x - p.w; }   // x >= -w
-float distTop(vec4 p) { return  p.y - p.w; }    // y <= w
-float distBottom(vec4 p) { return -p.y - p.w; } // y >= -w
-float distNear(vec4 p) { return -p.z - p.w; }   // z >= -w
-
-bool insideAllPlanes(vec4 p) {
-    // Epsilon for numerical robustness, otherwise flickering occurs
-    // Relative epsilon (scales with |w|), constant epsilon actually does not work
-    float eps = 1e-6 * max(abs(p.w), 1.0);
-
-    if ( distLeft(p) > eps) return false;
-    if ( distRight(p) > eps) return false;
-    if ( distBottom(p) > eps) return false;
-    if ( distTop(p) > eps) return false;
-    if ( distNear(p) > eps) return false;
-    return true;
-}
-
-// See https://www.cs.ucr.edu/~shinar/courses/cs130-winter-2021/content/clipping.pdf
-// and the above distance functions as explanation for this
-// Edge: a--b, dA = dist(a), dB = dist(b)
-vec4 intersectPlane(vec4 a, vec4 b, float dA, float dB) {
-    float t = dA / (dA - dB);
-    return mix(a, b, clamp(t, 0.0, 1.0));
-}
-
-// Plane distance functions map
-float planeDist(int pid, vec4 p) {
-    if (pid == 0) return distLeft(p);
-    if (pid == 1) return distRight(p);
-    if (pid == 2) return distBottom(p);
-    if (pid == 3) return distTop(p);
-    if (pid == 4) return distNear(p);
-    return -1; // unreachable
-}
-
-// Compute AABB of the voxel clipped by the frustum
-void computeClippedAABB(
-    vec3 wsCenter,
-    vec3 radius,
-    mat4 projView,
-    mat4 rotation,
-    out vec2 ndcMin,
-    out vec2 ndcMax
-) {
-    // Corner points in clip space
-    vec4 C[8];
-    {
-        vec3 mn = 0 - radius;
-        vec3 mx = 0 + radius;
-        mat4 translation = mat4(1.0);
-        translation[3].xyz = wsCenter;
-        mat4 modelView = projView * translation * rotation;
-        C[0] = modelView * vec4(mn.x, mn.y, mn.z, 1.0);
-        C[1] = modelView * vec4(mn.x, mn.y, mx.z, 1.0);
-        C[2] = modelView * vec4(mn.x, mx.y, mn.z, 1.0);
-        C[3] = modelView * vec4(mn.x, mx.y, mx.z, 1.0);
-        C[4] = modelView * vec4(mx.x, mn.y, mn.z, 1.0);
-        C[5] = modelView * vec4(mx.x, mn.y, mx.z, 1.0);
-        C[6] = modelView * vec4(mx.x, mx.y, mn.z, 1.0);
-        C[7] = modelView * vec4(mx.x, mx.y, mx.z, 1.0);
-    }
-    // 12 edges by corner indices
-    const ivec2 BOX_EDGES[12] = ivec2[12](
-        ivec2(0,1), ivec2(0,2), ivec2(0,4),
-        ivec2(1,3), ivec2(1,5),
-        ivec2(2,3), ivec2(2,6),
-        ivec2(3,7),
-        ivec2(4,5), ivec2(4,6),
-        ivec2(5,7),
-        ivec2(6,7)
-    );
-
-    // upper bound on candidates: 8 corners + (12 edges * 5 planes) => at most 68;
-    const int MAX_CAND = 72;
-    vec4 cand[MAX_CAND];
-    int  count = 0;
-
-    // add corners that are inside all planes
-    for (int i = 0; i < 8; ++i) {
-        if (insideAllPlanes(C[i])) {
-            cand[count++] = C[i];
-        }
-    }
-
-    // add edge/plane intersections
-    const int PLANES = 5; // left, right, bottom, top, near
-    for (int edge = 0; edge < 12; edge++) {
-        vec4 A = C[BOX_EDGES[edge].x];
-        vec4 B = C[BOX_EDGES[edge].y];
-
-        for (int plane = 0; plane < PLANES; plane++) {
-            float dA = planeDist(plane, A);
-            float dB = planeDist(plane, B);
-
-            const float eps = 1e-7;
-            // const bool oppositeSides = (dA < -eps && dB > eps) || (dA > eps && dB < -eps);
-            if (dA * dB < 0) {
-                vec4 its = intersectPlane(A, B, dA, dB);
-                if (insideAllPlanes(its)) {
-                    cand[count++] = its;
-                }
-            }
-        }
-    }
-
-    // if completely clipped, return empty aabb
-    if (count == 0) {
-        ndcMin = vec2(1e9);
-        ndcMax = vec2(-1e9);
-        return;
-    }
-
-    vec2 mn = vec2(1e9);
-    vec2 mx = vec2(-1e9);
-    for (int i = 0; i < count; i++) {
-        vec2 p = cand[i].xy / cand[i].w; // perspective divide to NDC
-        mn = min(mn, p);
-        mx = max(mx, p);
-    }
-
-    ndcMin = mn;
-    ndcMax = mx;
-}
-
+#include "voxel_projection.glsl"
 
 void main() {
     const float CLIPPING_THRESHOLD = 200.0;
 
-    float radius = push_constants.radius;
-    float invRadius = 1.0f / radius;
-
     Voxel voxel = push_constants.voxel_buffer.voxels[gl_InstanceIndex];
     vec2 corner = fullscreenVerts[gl_VertexIndex];
+    // 1 for blocks, 2^lod for the cells of a coarser level of detail
+    float size = float(((voxel.block >> 8) & 0xFu) + 1u);
+
+    float progress = loadingProgress(push_constants.time, push_constants.spawn_time);
+    mat4 rotation = loadingRotation(progress);
+    float radius = loadingScale(progress) * 0.5 * size;
+    float invRadius = 1.0f / radius;
+
+    ivec3 chunkOrigin = ivec3(push_constants.chunk_position.x, 0, push_constants.chunk_position.y) * 16;
+    ivec3 blockPosition = chunkOrigin + ivec3(voxel.position & 0xFu, (voxel.position >> 4) & 0x1FFu, (voxel.position >> 13) & 0xFu);
+    // blocks are centered on their position, cells on the middle of the blocks they cover
+    vec3 center = vec3(blockPosition) + (size - 1.0) * 0.5;
+    uint exposedFaces = (voxel.position >> 17) & 0x3Fu;
+    BlockProperties properties = push_constants.block_table.blocks[voxel.block & 0xFFu];
+
+    // only the faces that border air can be seen, the others are behind the neighbouring block.
+    // While the loading animation plays the voxels are smaller and rotated, so there are gaps to see through.
+    uint facing = facingFaces(center - 0.5 * size, center + 0.5 * size, push_constants.camera_position);
+    if (progress >= 1.0 && facing != 0u && (facing & exposedFaces) == 0u) {
+        gl_Position = vec4(-1.0, -1.0, -1.0, -1.0);
+        return;
+    }
 
-    vec4 wsPosition = vec4(vec3(voxel.position) + vec3(0.0, push_constants.height_adjust, 0.0), 1.0);
+    vec4 wsPosition = vec4(center + vec3(0.0, (1.0 - progress) * LOADING_HEIGHT, 0.0), 1.0);
     vec4 position = push_constants.proj_view_mat * wsPosition;
     float pointSize;
-    quadricProj(wsPosition.xyz, push_constants.proj_view_mat, push_constants.screen_size * 0.5, position, pointSize);
+    quadricProj(wsPosition.xyz, size, push_constants.proj_view_mat, push_constants.screen_size * 0.5, position, pointSize);
 
     vec2 screenOffset = corner * (pointSize / push_constants.screen_size);
     position.xy += screenOffset * position.w;
@@ -226,7 +126,7 @@ void main() {
     // check if we need to compute the AABB greedily
     if (pointSize * 2.0 > CLIPPING_THRESHOLD) {
         vec2 ndcMin, ndcMax;
-        computeClippedAABB(wsPosition.xyz, vec3(radius), push_constants.proj_view_mat, push_constants.rotation, ndcMin, ndcMax);
+        computeClippedAABB(wsPosition.xyz, vec3(radius), push_constants.proj_view_mat, rotation, ndcMin, ndcMax);
 
         // If completely clipped, return early
         // This should only be the case, if we do chunk-only/no frustum culling, so some voxels might not be visible
@@ -244,13 +144,13 @@ void main() {
         position.xy = ndcXY * position.w;
     }
 
-    color = voxel.color;
+    color = properties.color;
     cameraPosition = push_constants.camera_position;
     inverseProjViewMatrix = push_constants.inverse_proj_view_matrix;
     screenSize = push_constants.screen_size;
-    box = Box(wsPosition.xyz, vec3(radius), vec3(invRadius), mat3(push_constants.rotation));
+    box = Box(wsPosition.xyz, vec3(radius), vec3(invRadius), transpose(mat3(rotation)));
     quad = (corner * 0.5) + 0.5;
-    voxelTextureIndex = voxel.textureIndex;
+    voxelTextureIndex = properties.textureIndex;
     texturesEnabled = int(push_constants.texturesEnabled);
 
     float stochasticCoverage = pointSize * pointSize;
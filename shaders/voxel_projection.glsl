@@ -0,0 +1,173 @@
+#ifndef voxel_projection_glsl
+#define voxel_projection_glsl
+
+// Where the boxes of the voxel shaders end up on screen, shared by voxel.vert, greedyVoxel.vert and splat.comp
+
+// Signed distance field to represent the planes (clip space)
+// f(p) <= 0 is inside for each plane
+float distRight(vec4 p) { return  p.x - p.w; }  // x <= w
+float distLeft(vec4 p) { return -p.x - p.w; }   // x >= -w
+float distTop(vec4 p) { return  p.y - p.w; }    // y <= w
+float distBottom(vec4 p) { return -p.y - p.w; } // y >= -w
+float distNear(vec4 p) { return -p.z - p.w; }   // z >= -w
+
+bool insideAllPlanes(vec4 p) {
+    // Epsilon for numerical robustness, otherwise flickering occurs
+    // Relative epsilon (scales with |w|), constant epsilon actually does not work
+    float eps = 1e-6 * max(abs(p.w), 1.0);
+
+    if ( distLeft(p) > eps) return false;
+    if ( distRight(p) > eps) return false;
+    if ( distBottom(p) > eps) return false;
+    if ( distTop(p) > eps) return false;
+    if ( distNear(p) > eps) return false;
+    return true;
+}
+
+// See https://www.cs.ucr.edu/~shinar/courses/cs130-winter-2021/content/clipping.pdf
+// and the above distance functions as explanation for this
+// Edge: a--b, dA = dist(a), dB = dist(b)
+vec4 intersectPlane(vec4 a, vec4 b, float dA, float dB) {
+    float t = dA / (dA - dB);
+    return mix(a, b, clamp(t, 0.0, 1.0));
+}
+
+// Plane distance functions map
+float planeDist(int pid, vec4 p) {
+    if (pid == 0) return distLeft(p);
+    if (pid == 1) return distRight(p);
+    if (pid == 2) return distBottom(p);
+    if (pid == 3) return distTop(p);
+    if (pid == 4) return distNear(p);
+    return -1; // unreachable
+}
+
+// Compute AABB of the voxel clipped by the frustum
+void computeClippedAABB(
+    vec3 wsCenter,
+    vec3 radius,
+    mat4 projView,
+    mat4 rotation,
+    out vec2 ndcMin,
+    out vec2 ndcMax
+) {
+    // Corner points in clip space
+    vec4 C[8];
+    {
+        vec3 mn = 0 - radius;
+        vec3 mx = 0 + radius;
+        mat4 translation = mat4(1.0);
+        translation[3].xyz = wsCenter;
+        mat4 modelView = projView * translation * rotation;
+        C[0] = modelView * vec4(mn.x, mn.y, mn.z, 1.0);
+        C[1] = modelView * vec4(mn.x, mn.y, mx.z, 1.0);
+        C[2] = modelView * vec4(mn.x, mx.y, mn.z, 1.0);
+        C[3] = modelView * vec4(mn.x, mx.y, mx.z, 1.0);
+        C[4] = modelView * vec4(mx.x, mn.y, mn.z, 1.0);
+        C[5] = modelView * vec4(mx.x, mn.y, mx.z, 1.0);
+        C[6] = modelView * vec4(mx.x, mx.y, mn.z, 1.0);
+        C[7] = modelView * vec4(mx.x, mx.y, mx.z, 1.0);
+    }
+    // 12 edges by corner indices
+    const ivec2 BOX_EDGES[12] = ivec2[12](
+        ivec2(0,1), ivec2(0,2), ivec2(0,4),
+        ivec2(1,3), ivec2(1,5),
+        ivec2(2,3), ivec2(2,6),
+        ivec2(3,7),
+        ivec2(4,5), ivec2(4,6),
+        ivec2(5,7),
+        ivec2(6,7)
+    );
+
+    // upper bound on candidates: 8 corners + (12 edges * 5 planes) => at most 68;
+    const int MAX_CAND = 72;
+    vec4 cand[MAX_CAND];
+    int  count = 0;
+
+    // add corners that are inside all planes
+    for (int i = 0; i < 8; ++i) {
+        if (insideAllPlanes(C[i])) {
+            cand[count++] = C[i];
+        }
+    }
+
+    // add edge/plane intersections
+    const int PLANES = 5; // left, right, bottom, top, near
+    for (int edge = 0; edge < 12; edge++) {
+        vec4 A = C[BOX_EDGES[edge].x];
+        vec4 B = C[BOX_EDGES[edge].y];
+
+        for (int plane = 0; plane < PLANES; plane++) {
+            float dA = planeDist(plane, A);
+            float dB = planeDist(plane, B);
+
+            const float eps = 1e-7;
+            // const bool oppositeSides = (dA < -eps && dB > eps) || (dA > eps && dB < -eps);
+            if (dA * dB < 0) {
+                vec4 its = intersectPlane(A, B, dA, dB);
+                if (insideAllPlanes(its)) {
+                    cand[count++] = its;
+                }
+            }
+        }
+    }
+
+    // if completely clipped, return empty aabb
+    if (count == 0) {
+        ndcMin = vec2(1e9);
+        ndcMax = vec2(-1e9);
+        return;
+    }
+
+    vec2 mn = vec2(1e9);
+    vec2 mx = vec2(-1e9);
+    for (int i = 0; i < count; i++) {
+        vec2 p = cand[i].xy / cand[i].w; // perspective divide to NDC
+        mn = min(mn, p);
+        mx = max(mx, p);
+    }
+
+    ndcMin = mn;
+    ndcMax = mx;
+}
+
+
+// bit per FaceDirection (-x, +x, -z, +z, -y, +y) for the sides of the box [mn, mx] that the eye is in front of
+uint facingFaces(vec3 mn, vec3 mx, vec3 eye) {
+    return uint(eye.x < mn.x) | uint(eye.x > mx.x) << 1 |
+           uint(eye.z < mn.z) << 2 | uint(eye.z > mx.z) << 3 |
+           uint(eye.y < mn.y) << 4 | uint(eye.y > mx.y) << 5;
+}
+
+// the loading animation of a chunk, from its spawn_time on: the blocks spin once around y while they grow from
+// LOADING_START_SCALE to full size and come down from LOADING_HEIGHT blocks above.
+// LOADING_ANIMATION_SECONDS in voxel.h has to match LOADING_SECONDS.
+const float LOADING_SECONDS = 2.0;
+const float LOADING_HEIGHT = 20.0;
+// voxels start from the radius of 0.35 blocks they always started from, so no box is empty with an infinite inverse radius
+const float LOADING_START_SCALE = 0.7;
+
+// 0 when the chunk was just built at `spawnTime`, 1 once its blocks are in place at `time`
+float loadingProgress(float time, float spawnTime) {
+    return clamp((time - spawnTime) / LOADING_SECONDS, 0.0, 1.0);
+}
+
+// how big the boxes are at `progress`, relative to their full size
+float loadingScale(float progress) {
+    return mix(LOADING_START_SCALE, 1.0, progress);
+}
+
+// the spin at `progress`, from the box into the world
+mat4 loadingRotation(float progress) {
+    float angle = progress * 6.28318530718;
+    float c = cos(angle);
+    float s = sin(angle);
+    return mat4(
+        c,   0.0, -s,  0.0,
+        0.0, 1.0, 0.0, 0.0,
+        s,   0.0, c,   0.0,
+        0.0, 0.0, 0.0, 1.0
+    );
+}
+
+#endif
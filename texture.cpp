@@ -1,6 +1,8 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "texture.hpp"
 
+#include <algorithm>
+
 const std::string TEXTURE_DIR = "../assets/textures/";
 const std::string BLOCKS = "blocks/";
 const std::string LIQUID = "liquid/";
@@ -61,6 +63,13 @@ TextureManager::TextureManager(imr::Device &device, imr::GraphicsPipeline& pipel
 
     uploadTextureData(blockData, m_blockTextures, device, pipeline, sampler);
     // uploadTextureData(liquidData, m_liquidTextures, device, pipeline, sampler);
+
+    // blocks without textures of their own show the unknown texture
+    assert(std::ranges::find(m_blockOrder, BlockUnknown) != m_blockOrder.end() && "The unknown texture must exist");
+    for (int id = 0; id < BlockCount; id++) {
+        if (std::ranges::find(m_blockOrder, id) == m_blockOrder.end())
+            m_blockTable[id].texture_index = m_blockTable[BlockUnknown].texture_index;
+    }
 }
 
 void TextureManager::uploadTextureData(
@@ -117,7 +126,7 @@ void TextureManager::uploadTextureData(
     };
 
     for (const auto& id : m_blockOrder) {
-        uint32_t idx = m_idToIndex[id];
+        uint32_t idx = m_blockTable[id].texture_index;
         auto &[side, top, bottom] = texData.raw.at(id);
 
         assert(side && "Side texture must exist");
@@ -235,8 +244,8 @@ TextureManager::TextureData TextureManager::loadTextureData(
             nfo("{} has {} channels", name, c);
         }
 
-        if (!m_idToIndex.contains(id)) {
-            m_idToIndex[id] = index;
+        if (std::ranges::find(order, id) == order.end()) {
+            m_blockTable[id].texture_index = index;
             order.push_back(id);
             nfo("Mapped {} to idx {}", name, index);
             index++;
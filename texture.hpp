@@ -8,6 +8,7 @@
 #include <filesystem>
 #include "slog.hpp"
 #include <enklume/block_data.h>
+#include "block_properties.h"
 
 constexpr size_t TEXTURE_ARRAY_MAX = 1024;
 constexpr size_t TEXTURES_PER_BLOCK = 3;
@@ -54,8 +55,8 @@ public:
     std::unique_ptr<TextureArray> m_blockTextures{};
     std::unique_ptr<TextureArray> m_liquidTextures{};
 
-    // Maps each block to its texture index.
-    std::unordered_map<BlockId, uint32_t> m_idToIndex{};
+    // The properties of every block, with the texture index of each filled in.
+    BlockTable m_blockTable{};
 
 private:
     // used to maintain ordering to ensure correct gpu upload
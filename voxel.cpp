@@ -1,6 +1,9 @@
 #include "voxel.h"
+#include "mesh_cache.h"
 
+#include <algorithm>
 #include <iostream>
+#include <tuple>
 
 extern "C" {
 #include "enklume/block_data.h"
@@ -8,67 +11,95 @@ extern "C" {
 
 inline int toWorldY(const int section, const int y) { return y + section * CUNK_CHUNK_SIZE; }
 
-void chunk_voxels(
-    const ChunkData* chunk,
-    const ivec2& chunkPos,
-    ChunkNeighbors& neighbours,
-    std::vector<uint8_t>& voxel_buffer,
-    size_t* num_voxels,
-    const std::unordered_map<BlockId, uint32_t>& idToIdx
+void chunk_voxels_section(
+    const PaddedChunk& chunk,
+    const int section,
+    uint8_t* voxel_buffer,
+    size_t* num_voxels
 ) {
-    for (int section = 0; section < CUNK_CHUNK_SECTIONS_COUNT; section++) {
-        for (int x = 0; x < CUNK_CHUNK_SIZE; x++) {
-            for (int y = 0; y < CUNK_CHUNK_SIZE; y++) {
-                for (int z = 0; z < CUNK_CHUNK_SIZE; z++) {
-                    int world_y = y + section * CUNK_CHUNK_SIZE;
-                    const BlockData block_data = access_safe(chunk, neighbours, x, world_y, z);
-                    struct n_idx {
-                        int x, y, z;
-                    };
-                    const std::array<n_idx, 6> n_idxs{{
-                        {x, world_y + 1, z},
-                        {x, world_y - 1, z},
-                        {x + 1, world_y, z},
-                        {x - 1, world_y, z},
-                        {x, world_y, z + 1},
-                        {x, world_y, z - 1}
-                    }};
-
-                    bool occluded = true;
-                    for (const auto &[x, y, z] : n_idxs) {
-                        if (access_safe(chunk, neighbours, x, y, z) == BlockAir) {
-                            occluded = false;
-                            break;
-                        }
-                    }
-
-                    if (block_data != BlockAir && !occluded) {
-                        Voxel v;
-                        v.position.x = x + chunkPos.x * CUNK_CHUNK_SIZE;
-                        v.position.y = world_y;
-                        v.position.z = z + chunkPos.y * CUNK_CHUNK_SIZE; // y is our z here
-                        v.color.x = block_colors[block_data].r;
-                        v.color.y = block_colors[block_data].g;
-                        v.color.z = block_colors[block_data].b;
-                        v.textureIndex = idToIdx.contains(static_cast<BlockId>(block_data)) ? idToIdx.at(static_cast<BlockId>(block_data)) : idToIdx.at(BlockUnknown);
-                        v.copy_to(voxel_buffer);
-
-                        *num_voxels += 1;
-                    }
+    if (chunk.empty_section[section])
+        return;
+    for (int x = 0; x < CUNK_CHUNK_SIZE; x++) {
+        for (int y = 0; y < CUNK_CHUNK_SIZE; y++) {
+            for (int z = 0; z < CUNK_CHUNK_SIZE; z++) {
+                int world_y = y + section * CUNK_CHUNK_SIZE;
+                const BlockData block_data = chunk.get(x, world_y, z);
+                if (block_data == BlockAir)
+                    continue;
+
+                if (const uint8_t faces = exposedFaces(chunk, x, world_y, z)) {
+                    Voxel::pack(x, world_y, z, faces, block_data).copy_to(voxel_buffer);
+                    *num_voxels += 1;
                 }
             }
         }
     }
 }
 
-void greedyMeshSlice(
-    BitMask& mask,
-    const ivec2& chunkPos,
+void chunk_voxels(
+    const PaddedChunk& chunk,
+    uint8_t* voxel_buffer,
+    size_t* num_voxels
+) {
+    for (int section = 0; section < CUNK_CHUNK_SECTIONS_COUNT; section++) {
+        const size_t before = *num_voxels;
+        chunk_voxels_section(chunk, section, voxel_buffer, num_voxels);
+        voxel_buffer += (*num_voxels - before) * sizeof(Voxel);
+    }
+}
+
+std::array<VoxelBlockProperties, BlockCount> voxel_block_properties(const BlockTable blocks) {
+    std::array<VoxelBlockProperties, BlockCount> table;
+    for (int id = 0; id < BlockCount; id++) {
+        const BlockProperties& block = blocks[id];
+        table[id].color = { block.color[0], block.color[1], block.color[2] };
+        table[id].textureIndex = block.texture_index;
+    }
+    return table;
+}
+
+/// the faces of the box [x, xEnd) x [y, yEnd) x `pattern` within the section that have at least one of its blocks
+/// bordering air, from PaddedChunk::exposed_faces(). Faces between two blocks of the box never border air,
+/// so all of its blocks can be looked at the same way.
+static uint8_t boxFaces(const uint16_t exposed[FaceCount][CUNK_CHUNK_SIZE][CUNK_CHUNK_SIZE], const int x, const int xEnd, const int y, const int yEnd, const uint16_t pattern) {
+    uint8_t faces = 0;
+    for (int direction = 0; direction < FaceCount; direction++) {
+        uint16_t any = 0;
+        for (int by = y; by < yEnd; by++) {
+            for (int bx = x; bx < xEnd; bx++)
+                any |= exposed[direction][by][bx];
+        }
+        faces |= ((any & pattern) != 0) << direction;
+    }
+    return faces;
+}
+
+/// whether the rows [x, xEnd) of `mask` all have the bits of `pattern` set
+static bool hasRectangle(const BitMask& mask, const int x, const int xEnd, const uint16_t pattern) {
+    for (int i = x; i < xEnd; i++) {
+        if ((mask.mask[i] & pattern) != pattern)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Merges the exposed blocks of `type` in slices[0] into GreedyVoxel boxes: first along z, then along x, then up into
+ * slices[1] to slices[numSlices - 1] as long as they have the same rectangle of the same type. Every box only covers
+ * blocks that are in the masks, so it shows exactly the faces those blocks show on their own.
+ * Merged bits are cleared, in the slices above too, so every block ends up in exactly one box.
+ */
+static void greedyMeshSlice(
+    const uint16_t exposedFaces[FaceCount][CUNK_CHUNK_SIZE][CUNK_CHUNK_SIZE],
+    SliceBitMasks* slices,
+    const int numSlices,
+    const BlockId type,
+    const int sliceY,
     const int worldY,
-    std::vector<uint8_t>& voxelBuffer,
-    size_t* numVoxels,
-    const std::unordered_map<BlockId, uint32_t>& idToIdx
+    uint8_t*& voxelBuffer,
+    size_t* numVoxels
 ) {
+    BitMask& mask = slices[0].masks[type];
     for (int x = 0; x < CUNK_CHUNK_SIZE; x++) {
         // keep greedily meshing until this row has none of this block type left
         while (mask.mask[x] != 0) {
@@ -88,23 +119,16 @@ void greedyMeshSlice(
                 xEnd++;
             }
 
-            GreedyVoxel gv;
-            gv.start.x = x + chunkPos.x * CUNK_CHUNK_SIZE;
-            gv.start.y = worldY;
-            gv.start.z = zStart + chunkPos.y * CUNK_CHUNK_SIZE;
-
-            gv.end.x = xEnd + chunkPos.x * CUNK_CHUNK_SIZE;
-            gv.end.y = worldY + 1;
-            gv.end.z = zEnd + chunkPos.y * CUNK_CHUNK_SIZE;
-
-            gv.color.x = block_colors[mask.type].r;
-            gv.color.y = block_colors[mask.type].g;
-            gv.color.z = block_colors[mask.type].b;
-
-            gv.textureIndex = idToIdx.contains(mask.type) ? idToIdx.at(mask.type) : idToIdx.at(BlockUnknown);
-
-            gv.copy_to(voxelBuffer);
+            // expand along y-axis, the whole rectangle has to be there in the slice above
+            int yLength = 1;
+            while (yLength < numSlices && hasRectangle(slices[yLength].masks[type], x, xEnd, pattern)) {
+                for (int i = x; i < xEnd; i++)
+                    slices[yLength].masks[type].mask[i] &= ~pattern;
+                yLength++;
+            }
 
+            const uint8_t faces = boxFaces(exposedFaces, x, xEnd, sliceY, sliceY + yLength, pattern);
+            GreedyVoxel::pack(x, worldY, zStart, xEnd - x, yLength, zLength, faces, type).copy_to(voxelBuffer);
             *numVoxels += 1;
 
             // clear the used bits
@@ -113,62 +137,259 @@ void greedyMeshSlice(
     }
 }
 
+void greedy_chunk_voxels_section(
+    const PaddedChunk& chunk,
+    const int section,
+    uint8_t* voxel_buffer,
+    size_t* num_voxels,
+    const bool mergeY
+) {
+    if (chunk.empty_section[section])
+        return;
+    uint16_t faces[FaceCount][CUNK_CHUNK_SIZE][CUNK_CHUNK_SIZE];
+    chunk.exposed_faces(section, faces);
+    // one BitMask for each block type present in each vertical slice, of the blocks with any face bordering air
+    SliceBitMasks slices[CUNK_CHUNK_SIZE];
+    for (int y = 0; y < CUNK_CHUNK_SIZE; y++) {
+        uint16_t exposed[CUNK_CHUNK_SIZE];
+        for (int x = 0; x < CUNK_CHUNK_SIZE; x++) {
+            exposed[x] = 0;
+            for (int direction = 0; direction < FaceCount; direction++)
+                exposed[x] |= faces[direction][y][x];
+        }
+        slices[y] = SliceBitMasks(chunk, toWorldY(section, y), exposed);
+    }
+    // boxes only grow upwards, so by the time a slice is merged the ones below it took what they could
+    for (int y = 0; y < CUNK_CHUNK_SIZE; y++) {
+        SliceBitMasks& slice = slices[y];
+        const int numSlices = mergeY ? CUNK_CHUNK_SIZE - y : 1;
+        for (int i = 0; i < slice.num_types; i++)
+            greedyMeshSlice(faces, &slice, numSlices, slice.types[i], y, toWorldY(section, y), voxel_buffer, num_voxels);
+    }
+}
+
 void greedy_chunk_voxels(
-    const ChunkData* chunk,
-    const ivec2& chunkPos,
-    ChunkNeighbors& neighbours,
-    std::vector<uint8_t>& voxel_buffer,
+    const PaddedChunk& chunk,
+    uint8_t* voxel_buffer,
     size_t* num_voxels,
-    const std::unordered_map<BlockId, uint32_t>& idToIdx
+    const bool mergeY
 ) {
-    // generate a BitMask for each block type, and for each vertical slice
-    for (int i = 1; i < BlockCount; i++) {
-        for (int y = 0; y < CUNK_CHUNK_MAX_HEIGHT; y++) {
-            auto mask = BitMask(chunk, neighbours, y, static_cast<BlockId>(i));
-            greedyMeshSlice(mask, chunkPos, y, voxel_buffer, num_voxels, idToIdx);
+    for (int section = 0; section < CUNK_CHUNK_SECTIONS_COUNT; section++) {
+        const size_t before = *num_voxels;
+        greedy_chunk_voxels_section(chunk, section, voxel_buffer, num_voxels, mergeY);
+        voxel_buffer += (*num_voxels - before) * sizeof(GreedyVoxel);
+    }
+}
+
+/// a GreedyVoxel with its coordinates and sizes unpacked, indexed by axis (x, y, z)
+struct UnpackedBox {
+    uint16_t start[3];
+    uint16_t size[3];
+    uint8_t faces;
+    uint8_t block;
+};
+
+/// merges the boxes that touch along `axis` (0 or 2) where they have the same type and cover the same range along the other axes
+static void merge_boxes_along(std::vector<UnpackedBox>& boxes, const int axis) {
+    const int other = 2 - axis;
+    // boxes that can merge end up next to each other, in order along `axis`
+    auto key = [&](const UnpackedBox& box) {
+        return std::tuple(box.block, box.start[1], box.size[1], box.start[other], box.size[other], box.start[axis]);
+    };
+    std::sort(boxes.begin(), boxes.end(), [&](const UnpackedBox& a, const UnpackedBox& b) { return key(a) < key(b); });
+
+    size_t merged = 0;
+    for (const UnpackedBox& box : boxes) {
+        if (merged > 0) {
+            UnpackedBox& last = boxes[merged - 1];
+            if (last.block == box.block && last.start[1] == box.start[1] && last.size[1] == box.size[1] &&
+                last.start[other] == box.start[other] && last.size[other] == box.size[other] &&
+                last.start[axis] + last.size[axis] == box.start[axis]) {
+                last.size[axis] += box.size[axis];
+                last.faces |= box.faces;
+                continue;
+            }
         }
+        boxes[merged++] = box;
+    }
+    boxes.resize(merged);
+}
+
+void merge_greedy_voxels(std::vector<GreedyVoxel>& boxes) {
+    std::vector<UnpackedBox> unpacked(boxes.size());
+    for (size_t i = 0; i < boxes.size(); i++) {
+        const GreedyVoxel& box = boxes[i];
+        unpacked[i] = {
+            { static_cast<uint16_t>(box.x()), static_cast<uint16_t>(box.y()), static_cast<uint16_t>(box.z()) },
+            { static_cast<uint16_t>(box.size_x()), static_cast<uint16_t>(box.size_y()), static_cast<uint16_t>(box.size_z()) },
+            box.faces(), box.block()
+        };
+    }
+    merge_boxes_along(unpacked, 0);
+    merge_boxes_along(unpacked, 2);
+
+    boxes.clear();
+    for (const UnpackedBox& box : unpacked) {
+        boxes.push_back(GreedyVoxel::pack(box.start[0], box.start[1], box.start[2], box.size[0], box.size[1], box.size[2],
+                                          box.faces, static_cast<BlockData>(box.block)));
     }
 }
 
 ChunkVoxels::ChunkVoxels(
     imr::Device& device,
     ChunkNeighbors& neighbors,
-    const ivec2& chunkPos,
     const bool greedyMeshing,
-    const std::unordered_map<BlockId, uint32_t>& idToIdx
+    MeshCache* cache,
+    uint64_t content_hash,
+    const bool keep_boxes
 ) {
-    std::vector<uint8_t> voxel_buffer;
     num_voxels = 0;
-    if (greedyMeshing) {
-        greedy_chunk_voxels(neighbors.neighbours[1][1], chunkPos, neighbors, voxel_buffer, &num_voxels,  idToIdx);
-    } else {
-        chunk_voxels(neighbors.neighbours[1][1], chunkPos, neighbors, voxel_buffer, &num_voxels, idToIdx);
+    neighbour_mask = loaded_neighbours_mask(neighbors);
+    const size_t voxel_size = greedyMeshing ? sizeof(GreedyVoxel) : sizeof(Voxel);
+
+    // voxels are chunk-local and only hold block ids, so only the blocks and the neighbours' edges go into the key
+    uint64_t key = 0;
+    if (cache) {
+        key = hash_combine(content_hash, MESHER_VERSION);
+        key = hash_combine(key, greedyMeshing ? 'G' : 'V');
+        key = hash_combine(key, neighbour_mask);
+        for (int side = 0; side < SideCount; side++) {
+            if (const ChunkData* neighbour = neighbors.neighbours[side_dx[side] + 1][side_dz[side] + 1])
+                key = hash_combine(key, neighbour_edge_key(*neighbour, static_cast<ChunkSide>(side)));
+        }
+        if (auto cached = cache->load(key)) {
+            buffer_size = cached->size;
+            num_voxels = buffer_size / voxel_size;
+            upload(device, cached->data);
+            if (greedyMeshing && keep_boxes)
+                keep(cached->data);
+            return;
+        }
+    }
+
+    const PaddedChunk& padded = PaddedChunk::scratch(neighbors, BlockStone);
+    // count first, so the voxels fit the scratch memory exactly and get written there directly
+    size_t section_bytes[CUNK_CHUNK_SECTIONS_COUNT + 1];
+    uint8_t* voxel_buffer = mesh_sections(padded, [&](int section) {
+        return padded.count_exposed_blocks(section) * voxel_size;
+    }, [&](int section, uint8_t* out) {
+        size_t section_voxels = 0;
+        if (greedyMeshing) {
+            greedy_chunk_voxels_section(padded, section, out, &section_voxels);
+        } else {
+            chunk_voxels_section(padded, section, out, &section_voxels);
+        }
+        return section_voxels * voxel_size;
+    }, section_bytes);
+    buffer_size = section_bytes[CUNK_CHUNK_SECTIONS_COUNT];
+    num_voxels = buffer_size / voxel_size;
+    upload(device, voxel_buffer);
+    if (greedyMeshing && keep_boxes)
+        keep(voxel_buffer);
+    if (cache)
+        cache->store(key, { std::span<const uint8_t>(voxel_buffer, buffer_size) });
+}
+
+void lod_chunk_voxels(const ChunkData& chunk, const int lod, uint8_t* out, size_t* num_voxels) {
+    assert(lod > 0 && lod < VOXEL_LOD_COUNT);
+    const LodCells cells(chunk, lod);
+    const int f = 1 << lod;
+    *num_voxels = 0;
+    for (int cx = 0; cx < cells.size; cx++) {
+        for (int cy = 0; cy < cells.height; cy++) {
+            for (int cz = 0; cz < cells.size; cz++) {
+                const BlockId type = cells.get(cx, cy, cz);
+                if (type == BlockAir)
+                    continue;
+                uint8_t faces = 0;
+                for (int direction = 0; direction < FaceCount; direction++) {
+                    if (cells.get(cx + face_dx[direction], cy + face_dy[direction], cz + face_dz[direction]) == BlockAir)
+                        faces |= 1 << direction;
+                }
+                if (faces) {
+                    Voxel::pack(cx * f, cy * f, cz * f, faces, type, f).copy_to(out);
+                    *num_voxels += 1;
+                }
+            }
+        }
     }
-    const size_t voxel_buffer_size = voxel_buffer.size();
-    if (voxel_buffer_size > 0) {
-        gpu_buffer = std::make_unique<imr::Buffer>(device, voxel_buffer_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
-        gpu_buffer->uploadDataSync(0, voxel_buffer_size, voxel_buffer.data());
+}
+
+ChunkVoxels::ChunkVoxels(imr::Device& device, const ChunkData& chunk, const int lod, MeshCache* cache, uint64_t content_hash) {
+    neighbour_mask = (1 << SideCount) - 1;
+    uint64_t key = 0;
+    if (cache) {
+        key = hash_combine(content_hash, MESHER_VERSION);
+        key = hash_combine(key, 'L');
+        key = hash_combine(key, lod);
+        if (auto cached = cache->load(key)) {
+            buffer_size = cached->size;
+            num_voxels = buffer_size / sizeof(Voxel);
+            upload(device, cached->data);
+            return;
+        }
     }
+
+    uint8_t* voxel_buffer = mesher_scratch(lod_voxels_max(lod) * sizeof(Voxel));
+    lod_chunk_voxels(chunk, lod, voxel_buffer, &num_voxels);
+    buffer_size = num_voxels * sizeof(Voxel);
+    upload(device, voxel_buffer);
+    if (cache)
+        cache->store(key, { std::span<const uint8_t>(voxel_buffer, buffer_size) });
 }
 
-void ChunkVoxels::update(const float delta) {
-    if (!is_playing_loading_animation) {
-        return;
+std::vector<GreedyVoxel> batch_greedy_voxels(const std::span<const std::span<const GreedyVoxel>> chunks, const int size) {
+    assert(size >= 1 && size <= MAX_BATCH_CHUNKS && chunks.size() == static_cast<size_t>(size * size));
+    std::vector<GreedyVoxel> batch, border;
+    for (int dx = 0; dx < size; dx++) {
+        for (int dz = 0; dz < size; dz++) {
+            for (const GreedyVoxel& box : chunks[dx * size + dz]) {
+                const GreedyVoxel moved = GreedyVoxel::pack(box.x() + dx * CUNK_CHUNK_SIZE, box.y(), box.z() + dz * CUNK_CHUNK_SIZE,
+                                                            box.size_x(), box.size_y(), box.size_z(), box.faces(), box.block());
+                // the chunk's own boxes were merged as far as they go already, only at its border there is more to merge
+                const bool on_border = box.x() == 0 || box.x() + box.size_x() == CUNK_CHUNK_SIZE ||
+                                       box.z() == 0 || box.z() + box.size_z() == CUNK_CHUNK_SIZE;
+                (on_border ? border : batch).push_back(moved);
+            }
+        }
     }
-    animation_progress += delta * speed;
-    if (animation_progress >= 1.0f) {
-        rotation = identity_mat4;
-        radius = 0.5f;
-        height_adjust = 0;
-        is_playing_loading_animation = false;
-        return;
+    merge_greedy_voxels(border);
+    batch.insert(batch.end(), border.begin(), border.end());
+    return batch;
+}
+
+ChunkVoxels::ChunkVoxels(imr::Device& device, const std::span<const ChunkVoxels* const> members, const int size) {
+    neighbour_mask = (1 << SideCount) - 1;
+    spawn_time = members[0]->spawn_time;
+    std::vector<std::span<const GreedyVoxel>> chunks;
+    for (const ChunkVoxels* member : members) {
+        assert(member->boxes.size() == member->num_voxels);
+        spawn_time = std::min(spawn_time, member->spawn_time);
+        chunks.emplace_back(member->boxes);
     }
-    const float angle = animation_progress * angle_target;
-    const float rad = animation_progress * radius_target;
-    const float h = height_adjust_start + animation_progress * -height_adjust_start;
-    rotation = rotate_axis_mat4(1, angle);
-    radius = rad;
-    height_adjust = h;
+    const std::vector<GreedyVoxel> batch = batch_greedy_voxels(chunks, size);
+    num_voxels = batch.size();
+    buffer_size = num_voxels * sizeof(GreedyVoxel);
+    upload(device, reinterpret_cast<const uint8_t*>(batch.data()));
 }
 
+void ChunkVoxels::keep(const uint8_t* voxels) {
+    boxes.resize(num_voxels);
+    memcpy(boxes.data(), voxels, num_voxels * sizeof(GreedyVoxel));
+}
 
+void ChunkVoxels::upload(imr::Device& device, const uint8_t* voxels) {
+    if (buffer_size > 0) {
+        gpu_buffer = std::make_unique<imr::Buffer>(device, buffer_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
+        upload_readonly(*gpu_buffer, voxels, buffer_size);
+    }
+}
+
+uint8_t loaded_neighbours_mask(const ChunkNeighbors& neighbors) {
+    uint8_t mask = 0;
+    for (int side = 0; side < SideCount; side++) {
+        if (neighbors.neighbours[side_dx[side] + 1][side_dz[side] + 1])
+            mask |= 1 << side;
+    }
+    return mask;
+}
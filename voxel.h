@@ -2,80 +2,214 @@
 #define VOXEL_H
 
 #include "nasl/nasl.h"
+#include <array>
+#include <span>
 #include <vector>
 #include <cstdint>
 #include "BitMask.hpp"
 
+#include "block_properties.h"
 #include "chunk_mesh.h"
-#include "nasl/nasl_mat.h"
 
 using namespace nasl;
 
+/**
+ * One exposed block in 8 bytes, expanded again in voxel.vert: bits 0-3 x, 4-12 y, 13-16 z within the chunk,
+ * 17-22 which faces border air (bit per FaceDirection), then the BlockId in bits 0-7 of a word of its own.
+ * The chunk origin comes from a push constant, the color and texture of the block from a table (VoxelBlockProperties).
+ * The cells of lod_chunk_voxels() are cubes of `size` blocks per axis, with the size minus one in bits 8-11, 12-15
+ * and 16-19 of the second word like a GreedyVoxel's, so both voxel shaders can draw them.
+ */
 struct Voxel {
-    ivec3 position = ivec3{0, 0, 0};
-    vec3 color = vec3{1.0f, 0.0f, 1.0f};
-    uint32_t textureIndex = -1;
-
-    void copy_to(std::vector<uint8_t>& buf) const {
-        uint8_t tmp[sizeof(Voxel)];
-        memcpy(tmp, this, sizeof(Voxel));
-        for (auto b : tmp)
-            buf.push_back(b);
+    uint32_t position;
+    uint32_t block;
+
+    static Voxel pack(unsigned x, unsigned y, unsigned z, uint8_t faces, BlockData block, unsigned size = 1) {
+        assert(x < CUNK_CHUNK_SIZE && y < CUNK_CHUNK_MAX_HEIGHT && z < CUNK_CHUNK_SIZE && faces < (1 << FaceCount));
+        assert(size >= 1 && size <= CUNK_CHUNK_SIZE);
+        const uint32_t extent = size - 1;
+        return { x | y << 4 | z << 13 | static_cast<uint32_t>(faces) << 17, block | extent << 8 | extent << 12 | extent << 16 };
+    }
+
+    unsigned x() const { return position & 0xF; }
+    unsigned y() const { return (position >> 4) & 0x1FF; }
+    unsigned z() const { return (position >> 13) & 0xF; }
+    uint8_t faces() const { return (position >> 17) & 0x3F; }
+    BlockId block_id() const { return static_cast<BlockId>(block & 0xFF); }
+    unsigned size() const { return ((block >> 8) & 0xF) + 1; }
+
+    void copy_to(uint8_t*& out) const {
+        memcpy(out, this, sizeof(Voxel));
+        out += sizeof(Voxel);
     }
 };
 
+/// how many chunks a VoxelBatch (see ChunkVoxels) can span along x and z, so its boxes still fit a GreedyVoxel
+constexpr int MAX_BATCH_CHUNKS = 8;
+
+/**
+ * A box of exposed blocks of the same type in 8 bytes, expanded again in greedyVoxel.vert. The first word is
+ * laid out like Voxel::position for the lowest corner, with the faces of the box that have at least one block
+ * bordering air; the second has the BlockId in bits 0-7 and the size minus one along x, y and z in 8-11, 12-15, 16-19.
+ * Boxes of a batch can be up to MAX_BATCH_CHUNKS chunks wide and start in any of its chunks: the upper three bits
+ * of x and z go into bits 23-25 and 26-28 of the first word, those of the sizes along x and z into bits 20-22 and
+ * 23-25 of the second. They are 0 for the boxes of a single chunk, and a 1x1x1 box is the same bits as a Voxel.
+ */
 struct GreedyVoxel {
-    ivec3 start;
-    ivec3 end;
-    vec3 color;
-    uint32_t textureIndex;
+    uint32_t start;
+    uint32_t block_size;
 
-    void copy_to(std::vector<uint8_t>& buf) const {
-        uint8_t tmp[sizeof(GreedyVoxel)];
-        memcpy(tmp, this, sizeof(GreedyVoxel));
-        for (auto b : tmp)
-            buf.push_back(b);
+    static GreedyVoxel pack(unsigned x, unsigned y, unsigned z, unsigned size_x, unsigned size_y, unsigned size_z, uint8_t faces, BlockData block) {
+        constexpr unsigned batch_size = MAX_BATCH_CHUNKS * CUNK_CHUNK_SIZE;
+        assert(x < batch_size && y < CUNK_CHUNK_MAX_HEIGHT && z < batch_size && faces < (1 << FaceCount));
+        assert(size_x >= 1 && size_x <= batch_size && size_y >= 1 && size_y <= CUNK_CHUNK_SIZE && size_z >= 1 && size_z <= batch_size);
+        const unsigned sx = size_x - 1, sz = size_z - 1;
+        return {
+            (x & 0xF) | y << 4 | (z & 0xF) << 13 | static_cast<uint32_t>(faces) << 17 | (x >> 4) << 23 | (z >> 4) << 26,
+            block | (sx & 0xF) << 8 | (size_y - 1) << 12 | (sz & 0xF) << 16 | (sx >> 4) << 20 | (sz >> 4) << 23
+        };
     }
+
+    unsigned x() const { return (start & 0xF) | ((start >> 23) & 0x7) << 4; }
+    unsigned y() const { return (start >> 4) & 0x1FF; }
+    unsigned z() const { return ((start >> 13) & 0xF) | ((start >> 26) & 0x7) << 4; }
+    uint8_t faces() const { return (start >> 17) & 0x3F; }
+    BlockId block() const { return static_cast<BlockId>(block_size & 0xFF); }
+    unsigned size_x() const { return (((block_size >> 8) & 0xF) | ((block_size >> 20) & 0x7) << 4) + 1; }
+    unsigned size_y() const { return ((block_size >> 12) & 0xF) + 1; }
+    unsigned size_z() const { return (((block_size >> 16) & 0xF) | ((block_size >> 23) & 0x7) << 4) + 1; }
+
+    void copy_to(uint8_t*& out) const {
+        memcpy(out, this, sizeof(GreedyVoxel));
+        out += sizeof(GreedyVoxel);
+    }
+};
+
+static_assert(sizeof(Voxel) == 8 && sizeof(GreedyVoxel) == 8);
+
+/// voxel.vert's and greedyVoxel.vert's BlockProperties, one per BlockId
+struct VoxelBlockProperties {
+    vec3 color;
+    uint32_t textureIndex;
 };
 
+static_assert(sizeof(VoxelBlockProperties) == 16);
+
+/// the part of `blocks` the voxel shaders look the color and texture of each BlockId up in
+std::array<VoxelBlockProperties, BlockCount> voxel_block_properties(BlockTable blocks);
+
+
+/// emits one Voxel for every block that borders air.
+/// `voxel_buffer` needs room for PaddedChunk::count_exposed_blocks() of them, which is also enough for the greedy ones.
+void chunk_voxels(
+    const PaddedChunk& chunk,
+    uint8_t* voxel_buffer,
+    size_t* num_voxels
+);
+
+/// merges exposed blocks of the same type into GreedyVoxel boxes, within each y slice first and then up through
+/// the slices of each section. With `mergeY` false the boxes stay one block tall, like they used to be.
+void greedy_chunk_voxels(
+    const PaddedChunk& chunk,
+    uint8_t* voxel_buffer,
+    size_t* num_voxels,
+    bool mergeY = true
+);
+
+/// chunk_voxels() and greedy_chunk_voxels() for a single section, adding to `num_voxels`
+void chunk_voxels_section(
+    const PaddedChunk& chunk,
+    int section,
+    uint8_t* voxel_buffer,
+    size_t* num_voxels
+);
+void greedy_chunk_voxels_section(
+    const PaddedChunk& chunk,
+    int section,
+    uint8_t* voxel_buffer,
+    size_t* num_voxels,
+    bool mergeY = true
+);
+
+/// how many levels of detail voxels have, the coarsest merging 4x4x4 blocks into one cell
+constexpr int VOXEL_LOD_COUNT = 3;
+static_assert(VOXEL_LOD_COUNT <= MESH_LOD_COUNT, "the cells are LodCells");
+
+/// the most voxels lod_chunk_voxels() can emit
+constexpr size_t lod_voxels_max(int lod) {
+    return (CUNK_CHUNK_SIZE >> lod) * (CUNK_CHUNK_SIZE >> lod) * (CUNK_CHUNK_MAX_HEIGHT >> lod);
+}
+
+/**
+ * The voxels of `chunk` at level of detail `lod` > 0: one Voxel of 2^lod blocks per axis for every LodCells cell that
+ * borders an empty one, with the cell's majority block type. Like lod_chunk_mesh(), around the chunk is air, so it
+ * needs no neighbours. `out` needs room for lod_voxels_max(lod) voxels.
+ */
+void lod_chunk_voxels(const ChunkData& chunk, int lod, uint8_t* out, size_t* num_voxels);
+
+/// merges boxes of the same type that touch along x or z and cover the same range along the other two axes, like
+/// the boxes two neighbouring chunks cut a flat area into. Faces between the merged boxes never border air, so the
+/// merged box gets the faces of both. `boxes` is reordered.
+void merge_greedy_voxels(std::vector<GreedyVoxel>& boxes);
+
+/// the boxes of `size` x `size` neighbouring chunks in one set, relative to the first chunk. chunks[dx * size + dz]
+/// are the boxes of the chunk at dx, dz from it. The boxes on the chunk borders are merged with merge_greedy_voxels().
+std::vector<GreedyVoxel> batch_greedy_voxels(std::span<const std::span<const GreedyVoxel>> chunks, int size);
+
+/// how long the loading animation of the voxel shaders takes, has to match LOADING_SECONDS in
+/// shaders/voxel_projection.glsl
+constexpr float LOADING_ANIMATION_SECONDS = 2.0f;
 
 struct ChunkVoxels {
     std::unique_ptr<imr::Buffer> gpu_buffer;
-    size_t num_voxels;
-
-    /// how much we want to rotate in total
-    static constexpr float angle_target = M_PI * 2.0f;
-    /// initial -angle_goal rotation, so we are at identity_mat4 when the animation is done
-    mat4 rotation = rotate_axis_mat4(1, -angle_target);
-    /// initial radius
-    float radius = 0.35f;
-    /// how far we want to expand in total
-    static constexpr float radius_target = 0.5f;
-    /// 0.0 to 1.0, how far we are through the animation
-    float animation_progress = 0.0f;
-    /// animation speed multiplier; animation will take roughly 1/speed seconds
-    static constexpr float speed = 0.5f;
-    /// whether we are still playing the loading animation
-    bool is_playing_loading_animation = true;
-    /// where the blocks start in the Y axis
-    static constexpr float height_adjust_start = 20.0f;
-    /// Gives current adjusted height based on animation progress
-    float height_adjust = height_adjust_start;
+    /// when set, a VkDrawIndirectCommand with the number of voxels as its instance count, which the GPU counts up
+    /// while writing them (see GpuMesher)
+    std::unique_ptr<imr::Buffer> indirect;
+    size_t num_voxels = 0;
+    size_t buffer_size = 0;
+    /// which neighbours (bit per ChunkSide) were loaded when this was built, missing ones are treated as solid
+    uint8_t neighbour_mask = 0;
+
+    /// when the loading animation of these voxels started, in GameVoxels' frame time. voxel.vert and greedyVoxel.vert
+    /// play it from there, so voxels that replace others copy their spawn time to carry on where those were.
+    float spawn_time = 0.0f;
+    /// a copy of the GreedyVoxel boxes in host memory, kept when they may get merged into a batch
+    std::vector<GreedyVoxel> boxes;
 
+    /// looks the voxels up in `cache` first and stores them there after building them, if it's not null.
+    /// `content_hash` is hash_chunk() of the chunk in the center of `neighbors`.
+    /// With `keep_boxes` greedy voxels also stay in `boxes`, for batching.
     ChunkVoxels(
         imr::Device& device,
         ChunkNeighbors& neighbors,
-        const ivec2& chunkPos,
         bool greedyMeshing,
-        const std::unordered_map<BlockId, uint32_t>& idToIdx
+        MeshCache* cache = nullptr,
+        uint64_t content_hash = 0,
+        bool keep_boxes = false
     );
+    /**
+     * A batch: the greedy voxels of `size` x `size` neighbouring chunks in one buffer, so they take a single draw.
+     * members[dx * size + dz] are the voxels of the chunk at dx, dz from the batch's first chunk, which the boxes are
+     * relative to, and need their `boxes`; see batch_greedy_voxels().
+     */
+    ChunkVoxels(imr::Device& device, std::span<const ChunkVoxels* const> members, int size);
+    /// lod_chunk_voxels() of `chunk`, which don't depend on the neighbours
+    ChunkVoxels(imr::Device& device, const ChunkData& chunk, int lod, MeshCache* cache = nullptr, uint64_t content_hash = 0);
+    /// no voxels yet, for builders that fill them in themselves
+    explicit ChunkVoxels(uint8_t neighbour_mask) : neighbour_mask(neighbour_mask) {}
 
     [[nodiscard]] VkDeviceAddress voxel_buffer_device_address() const {
         return gpu_buffer->device_address();
     }
 
-    void update(float delta);
+private:
+    void upload(imr::Device& device, const uint8_t* voxels);
+    /// copies the num_voxels greedy voxels at `voxels` into `boxes`
+    void keep(const uint8_t* voxels);
 };
 
+/// bit per ChunkSide for the horizontal neighbours that are loaded
+uint8_t loaded_neighbours_mask(const ChunkNeighbors& neighbors);
+
 
 #endif
@@ -0,0 +1,178 @@
+#include "voxel_dag.h"
+#include "mesh_cache.h"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cmath>
+#include <unordered_set>
+#include <utility>
+
+size_t VoxelDag::NodeHash::operator()(const DagNode& node) const {
+    uint64_t h = 0;
+    for (DagRef child : node.children)
+        h = hash_combine(h, child);
+    return h;
+}
+
+DagRef VoxelDag::intern(const DagNode& node) {
+    // a cube whose halves are all the same uniform cube is uniform itself
+    if (dag_is_uniform(node.children[0]) && std::all_of(std::begin(node.children), std::end(node.children), [&](DagRef child) {
+            return child == node.children[0];
+        }))
+        return node.children[0];
+    auto [it, added] = index.try_emplace(node, static_cast<DagRef>(nodes.size()));
+    if (added) {
+        assert(nodes.size() < DAG_UNIFORM);
+        nodes.push_back(node);
+    }
+    return it->second;
+}
+
+DagRef VoxelDag::build(const ChunkSection& section, int x, int y, int z, int size) {
+    if (size == 1)
+        return dag_uniform(section.block_data[y][z][x]);
+    const int half = size / 2;
+    DagNode node;
+    for (int octant = 0; octant < 8; octant++)
+        node.children[octant] = build(section, x + (octant & 1) * half, y + (octant >> 1 & 1) * half, z + (octant >> 2) * half, half);
+    return intern(node);
+}
+
+DagChunk VoxelDag::add(const ChunkData& chunk) {
+    DagChunk roots;
+    for (int section = 0; section < CUNK_CHUNK_SECTIONS_COUNT; section++) {
+        const ChunkSection* s = chunk.sections[section];
+        roots.sections[section] = s ? build(*s, 0, 0, 0, CUNK_CHUNK_SIZE) : dag_uniform(BlockAir);
+    }
+    return roots;
+}
+
+BlockId VoxelDag::get(const DagChunk& chunk, int x, int y, int z) const {
+    assert(x >= 0 && x < CUNK_CHUNK_SIZE && y >= 0 && y < CUNK_CHUNK_MAX_HEIGHT && z >= 0 && z < CUNK_CHUNK_SIZE);
+    DagRef ref = chunk.sections[y / CUNK_CHUNK_SIZE];
+    y %= CUNK_CHUNK_SIZE;
+    for (int half = CUNK_CHUNK_SIZE / 2; !dag_is_uniform(ref); half /= 2) {
+        const int octant = (x & half ? 1 : 0) | (y & half ? 2 : 0) | (z & half ? 4 : 0);
+        ref = nodes[ref].children[octant];
+    }
+    return dag_block(ref);
+}
+
+std::optional<DagHit> VoxelDag::raycast(const DagChunk& chunk, const nasl::vec3 origin, const nasl::vec3 direction, const float max_distance) const {
+    const float o[3] = { origin.x, origin.y, origin.z };
+    const float d[3] = { direction.x, direction.y, direction.z };
+    const int extent[3] = { CUNK_CHUNK_SIZE, CUNK_CHUNK_MAX_HEIGHT, CUNK_CHUNK_SIZE };
+    // the face a ray going in the positive direction of each axis enters blocks through
+    constexpr FaceDirection entry_face[3] = { FaceMinusX, FaceMinusY, FaceMinusZ };
+
+    // clip the ray to the chunk
+    float t = 0.0f, t_end = max_distance;
+    FaceDirection face = FaceCount;
+    for (int axis = 0; axis < 3; axis++) {
+        if (d[axis] == 0.0f) {
+            if (o[axis] < 0.0f || o[axis] >= extent[axis])
+                return std::nullopt;
+            continue;
+        }
+        float near = (0.0f - o[axis]) / d[axis], far = (extent[axis] - o[axis]) / d[axis];
+        if (near > far)
+            std::swap(near, far);
+        if (near > t) {
+            t = near;
+            face = static_cast<FaceDirection>(entry_face[axis] + (d[axis] < 0.0f));
+        }
+        t_end = std::min(t_end, far);
+    }
+    if (t > t_end)
+        return std::nullopt;
+
+    int cell[3];
+    for (int axis = 0; axis < 3; axis++)
+        cell[axis] = std::clamp(static_cast<int>(floorf(o[axis] + d[axis] * t)), 0, extent[axis] - 1);
+
+    while (true) {
+        // the largest uniform cube the cell is in
+        DagRef ref = chunk.sections[cell[1] / CUNK_CHUNK_SIZE];
+        int size = CUNK_CHUNK_SIZE;
+        int corner[3] = { 0, cell[1] / CUNK_CHUNK_SIZE * CUNK_CHUNK_SIZE, 0 };
+        while (!dag_is_uniform(ref)) {
+            size /= 2;
+            int octant = 0;
+            for (int axis = 0; axis < 3; axis++) {
+                if (cell[axis] >= corner[axis] + size) {
+                    corner[axis] += size;
+                    octant |= 1 << axis;
+                }
+            }
+            // octants are indexed x | y << 1 | z << 2, like the axes here
+            ref = nodes[ref].children[octant];
+        }
+        if (dag_block(ref) != BlockAir)
+            return DagHit { cell[0], cell[1], cell[2], dag_block(ref), face, t };
+
+        // leave the cube through the side the ray reaches first
+        int exit_axis = -1;
+        float t_exit = INFINITY;
+        for (int axis = 0; axis < 3; axis++) {
+            if (d[axis] == 0.0f)
+                continue;
+            const float bound = d[axis] > 0.0f ? corner[axis] + size : corner[axis];
+            const float t_axis = (bound - o[axis]) / d[axis];
+            if (t_axis < t_exit) {
+                t_exit = t_axis;
+                exit_axis = axis;
+            }
+        }
+        if (exit_axis < 0 || t_exit > t_end)
+            return std::nullopt;
+        t = std::max(t, t_exit);
+        face = static_cast<FaceDirection>(entry_face[exit_axis] + (d[exit_axis] < 0.0f));
+        for (int axis = 0; axis < 3; axis++) {
+            if (axis == exit_axis)
+                cell[axis] = d[axis] > 0.0f ? corner[axis] + size : corner[axis] - 1;
+            else // rounding may put the point just outside the cube, it still leaves through `exit_axis`
+                cell[axis] = std::clamp(static_cast<int>(floorf(o[axis] + d[axis] * t)), corner[axis], corner[axis] + size - 1);
+        }
+        if (cell[exit_axis] < 0 || cell[exit_axis] >= extent[exit_axis])
+            return std::nullopt;
+    }
+}
+
+size_t VoxelDag::index_bytes() const {
+    // a bucket pointer plus a heap node with the key, the value and the next pointer, like libstdc++ lays them out
+    return index.bucket_count() * sizeof(void*) + index.size() * (sizeof(DagNode) + sizeof(DagRef) + 2 * sizeof(void*));
+}
+
+size_t VoxelDag::chunk_bytes(const DagChunk& chunk) const {
+    std::unordered_set<DagRef> reached;
+    std::vector<DagRef> stack(std::begin(chunk.sections), std::end(chunk.sections));
+    while (!stack.empty()) {
+        const DagRef ref = stack.back();
+        stack.pop_back();
+        if (dag_is_uniform(ref) || !reached.insert(ref).second)
+            continue;
+        stack.insert(stack.end(), std::begin(nodes[ref].children), std::end(nodes[ref].children));
+    }
+    return sizeof(DagChunk) + reached.size() * sizeof(DagNode);
+}
+
+ChunkStorageBytes chunk_storage_bytes(const ChunkData& chunk, const VoxelDag& dag, const DagChunk& roots) {
+    ChunkStorageBytes bytes;
+    for (const ChunkSection* section : chunk.sections) {
+        if (!section)
+            continue;
+        bytes.raw += sizeof(ChunkSection);
+        bool used[BlockCount] = {};
+        size_t types = 0;
+        for (auto& slice : section->block_data)
+            for (auto& row : slice)
+                for (BlockData block : row)
+                    types += !std::exchange(used[block], true);
+        // a single type needs no indices
+        const size_t bits = std::bit_width(types - 1);
+        bytes.palette += types * sizeof(BlockData) + (bits * CUNK_CHUNK_SIZE * CUNK_CHUNK_SIZE * CUNK_CHUNK_SIZE + 7) / 8;
+    }
+    bytes.dag = dag.chunk_bytes(roots);
+    return bytes;
+}
@@ -0,0 +1,106 @@
+#ifndef SIGCRAFT_VOXEL_DAG_H
+#define SIGCRAFT_VOXEL_DAG_H
+
+#include "chunk_mesh.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "nasl/nasl.h"
+
+extern "C" {
+#include "enklume/block_data.h"
+}
+
+/**
+ * A reference to a cube of a VoxelDag: with bit 31 set, the whole cube is the BlockId in bits 0-7, else it is split
+ * into eight and the rest is the index of its DagNode. Cubes that are one block type all the way through, like the
+ * air above the terrain or the stone below it, never get a node.
+ */
+using DagRef = uint32_t;
+
+constexpr DagRef DAG_UNIFORM = 1u << 31;
+
+constexpr DagRef dag_uniform(BlockData block) { return DAG_UNIFORM | block; }
+constexpr bool dag_is_uniform(DagRef ref) { return ref & DAG_UNIFORM; }
+constexpr BlockId dag_block(DagRef ref) { return static_cast<BlockId>(ref & 0xFF); }
+
+/// the eight halves of a cube, indexed x | y << 1 | z << 2 by which half along each axis they are in
+struct DagNode {
+    DagRef children[8];
+
+    bool operator==(const DagNode&) const = default;
+};
+
+static_assert(sizeof(DagNode) == 32);
+
+/// a chunk as the roots of its sections, each a cube of CUNK_CHUNK_SIZE blocks
+struct DagChunk {
+    DagRef sections[CUNK_CHUNK_SECTIONS_COUNT];
+};
+
+/// what a ray hit, in chunk-local block coordinates
+struct DagHit {
+    int x, y, z;
+    BlockId block;
+    /// the face of the block the ray entered through, FaceCount if it started inside the block
+    FaceDirection face;
+    /// along the ray, in units of its direction
+    float distance;
+};
+
+/**
+ * A sparse voxel octree of any number of chunks in which identical subtrees are stored only once, making it a DAG.
+ * Nodes are hash-consed as they are built bottom up, so the same 2x2x2 pattern of blocks, or the same half of a
+ * hill, is shared between all sections and chunks that have it. Nodes are only ever added: a store that outlives
+ * the chunks it was built for gets rebuilt from the chunks still in use.
+ */
+struct VoxelDag {
+    std::vector<DagNode> nodes;
+
+    /// adds the sections of `chunk`, sharing every subtree that is in the DAG already
+    DagChunk add(const ChunkData& chunk);
+
+    /// the block at chunk-local x, y, z
+    BlockId get(const DagChunk& chunk, int x, int y, int z) const;
+
+    /**
+     * The first non-air block along origin + t * direction for t in [0, max_distance], within `chunk` and in its
+     * coordinates. Air cubes are skipped whole, at whatever level of the DAG they are uniform.
+     */
+    std::optional<DagHit> raycast(const DagChunk& chunk, nasl::vec3 origin, nasl::vec3 direction, float max_distance) const;
+
+    /// bytes of the nodes, and of the index finding the existing copy of a node, which only building needs
+    size_t node_bytes() const { return nodes.size() * sizeof(DagNode); }
+    size_t index_bytes() const;
+
+    /// bytes of the nodes `chunk` refers to, as if it had a DAG of its own
+    size_t chunk_bytes(const DagChunk& chunk) const;
+
+private:
+    struct NodeHash {
+        size_t operator()(const DagNode& node) const;
+    };
+    std::unordered_map<DagNode, DagRef, NodeHash> index;
+
+    /// the cube of `size` blocks at x, y, z of `section`
+    DagRef build(const ChunkSection& section, int x, int y, int z, int size);
+    DagRef intern(const DagNode& node);
+};
+
+/// how big a chunk's blocks are stored in different ways, see VoxelDag::chunk_bytes()
+struct ChunkStorageBytes {
+    /// a ChunkSection per section that isn't air
+    size_t raw = 0;
+    /// per section that isn't air a palette of its block types and an index into it for every block, as few bits as
+    /// the palette needs, like Minecraft stores them
+    size_t palette = 0;
+    size_t dag = 0;
+};
+
+ChunkStorageBytes chunk_storage_bytes(const ChunkData& chunk, const VoxelDag& dag, const DagChunk& roots);
+
+#endif
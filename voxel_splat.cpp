@@ -0,0 +1,165 @@
+#include "voxel_splat.h"
+
+#include "imr/util.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+
+/// splat.comp's local_size_x
+constexpr uint32_t GROUP_SIZE = 64;
+
+static_assert(sizeof(VoxelSplatter::SplatDraw) == 40, "splat.glsl's SplatDraw");
+
+VoxelSplatter::VoxelSplatter(imr::Device& device, imr::Swapchain& swapchain, const TextureManager& texture_manager, const Sampler& sampler, const bool atomic64)
+    : atomic64(atomic64), device(device), swapchain(swapchain), texture_manager(texture_manager), sampler(sampler) {
+    static_assert(PER_DISPATCH_SPLAT_CONSTANTS == 192 && offsetof(decltype(splat_constants), visibility) == 160, "the push constants of splat.comp");
+    static_assert(offsetof(decltype(resolve_constants), visibility) == 96 && sizeof(resolve_constants) == 120, "the push constants of splat_resolve.frag");
+    load_shaders();
+
+    constexpr VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+    draws_buffer = std::make_unique<imr::Buffer>(device, MAX_SPLAT_DRAWS * sizeof(SplatDraw), usage);
+    queue = std::make_unique<imr::Buffer>(device, sizeof(Queue) + SPLAT_QUEUE_CAPACITY * sizeof(uint32_t), usage | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT);
+    splat_constants.draws = resolve_constants.draws = draws_buffer->device_address();
+    splat_constants.queue = queue->device_address();
+    splat_constants.queue_capacity = SPLAT_QUEUE_CAPACITY;
+}
+
+bool VoxelSplatter::supports_atomic64(imr::Device& device) {
+    VkPhysicalDeviceVulkan12Features features12 = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES };
+    VkPhysicalDeviceFeatures2 features = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2, .pNext = &features12 };
+    vkGetPhysicalDeviceFeatures2(device.physical_device, &features);
+    return features.features.shaderInt64 && features12.shaderBufferInt64Atomics;
+}
+
+void VoxelSplatter::require_atomic64(vkb::PhysicalDeviceSelector& selector) {
+    selector.set_required_features({ .shaderInt64 = VK_TRUE });
+    selector.set_required_features_12({ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES, .shaderBufferInt64Atomics = VK_TRUE });
+}
+
+void VoxelSplatter::load_shaders() {
+    module = std::make_unique<imr::ShaderModule>(device, atomic64 ? "splat64.comp.spv" : "splat.comp.spv");
+    entry_point = std::make_unique<imr::ShaderEntryPoint>(*module, VK_SHADER_STAGE_COMPUTE_BIT, "main");
+    pipeline = std::make_unique<imr::ComputePipeline>(device, *entry_point);
+
+    resolve_shaders = std::make_unique<VoxelShaders>(device, swapchain, std::vector<std::string> { "raymarch.vert.spv", "splat_resolve.frag.spv" });
+    resolve_textures.reset(resolve_shaders->pipeline->create_bind_helper());
+    resolve_textures->set_combined_image_sampler(0, 0, *texture_manager.m_blockTextures->textures, sampler.sampler);
+}
+
+void VoxelSplatter::reload_shaders() {
+    vkDeviceWaitIdle(device.device);
+    load_shaders();
+}
+
+bool VoxelSplatter::add(const ChunkVoxels& voxels, const ivec2 chunk_position) {
+    SplatDraw draw = {
+        .voxels = voxels.voxel_buffer_device_address(),
+        .indirect = voxels.indirect ? voxels.indirect->device_address() : 0,
+        .chunk_position = chunk_position,
+        .spawn_time = voxels.spawn_time,
+        .counted = voxels.indirect != nullptr,
+    };
+    // the ids only have room for so many voxels per draw, bigger batches become several
+    for (size_t first = 0; first < voxels.num_voxels; first += MAX_SPLAT_DRAW_VOXELS) {
+        if (draws.size() == MAX_SPLAT_DRAWS)
+            return false;
+        assert(!draw.counted || voxels.num_voxels <= MAX_SPLAT_DRAW_VOXELS);
+        draw.voxel_count = std::min(voxels.num_voxels - first, MAX_SPLAT_DRAW_VOXELS);
+        draws.push_back(draw);
+        draw.voxels += MAX_SPLAT_DRAW_VOXELS * sizeof(GreedyVoxel);
+    }
+    return true;
+}
+
+void VoxelSplatter::barrier(VkCommandBuffer cmdbuf, VkPipelineStageFlags2 src_stages, VkPipelineStageFlags2 dst_stages, VkAccessFlags2 dst_access) {
+    device.dispatch.cmdPipelineBarrier2KHR(cmdbuf, tmpPtr((VkDependencyInfo) {
+        .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+        .dependencyFlags = 0,
+        .memoryBarrierCount = 1,
+        .pMemoryBarriers = tmpPtr((VkMemoryBarrier2) {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+            .srcStageMask = src_stages,
+            .srcAccessMask = VK_ACCESS_2_SHADER_WRITE_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT,
+            .dstStageMask = dst_stages,
+            .dstAccessMask = dst_access,
+        })
+    }));
+}
+
+void VoxelSplatter::dispatch(VkCommandBuffer cmdbuf, Mode mode, Pass pass) {
+    splat_constants.mode = mode;
+    splat_constants.pass = pass;
+    vkCmdPushConstants(cmdbuf, pipeline->layout(), VK_SHADER_STAGE_COMPUTE_BIT, 0, PER_DISPATCH_SPLAT_CONSTANTS, &splat_constants);
+    if (mode == ModeSplatQueued) {
+        vkCmdDispatchIndirect(cmdbuf, queue->handle, offsetof(Queue, dispatch));
+        return;
+    }
+    for (uint32_t draw = 0; draw < draws.size(); draw++) {
+        splat_constants.draw = draw;
+        vkCmdPushConstants(cmdbuf, pipeline->layout(), VK_SHADER_STAGE_COMPUTE_BIT, PER_DISPATCH_SPLAT_CONSTANTS, sizeof(uint32_t), &splat_constants.draw);
+        vkCmdDispatch(cmdbuf, (draws[draw].voxel_count + GROUP_SIZE - 1) / GROUP_SIZE, 1, 1);
+    }
+}
+
+void VoxelSplatter::splat(imr::Swapchain::SimplifiedRenderContext& context, const View& view) {
+    auto cmdbuf = context.cmdbuf();
+    const VkExtent2D size = { context.image().size().width, context.image().size().height };
+    if (!visibility || size.width != visibility_size.width || size.height != visibility_size.height) {
+        if (const imr::Buffer* released = visibility.release())
+            context.frame().addCleanupAction([=] { delete released; });
+        visibility = std::make_unique<imr::Buffer>(device, size_t(size.width) * size.height * 2 * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
+        visibility_size = size;
+        splat_constants.visibility = resolve_constants.visibility = visibility->device_address();
+    }
+
+    splat_constants.matrix = view.matrix;
+    splat_constants.inverse_matrix = view.inverse_matrix;
+    splat_constants.camera_position = view.camera_position;
+    splat_constants.time = view.time;
+    splat_constants.screen_size = view.screen_size;
+    splat_constants.greedy = view.greedy;
+
+    // the previous frame may still be reading the buffers written here
+    barrier(cmdbuf, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT,
+            VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT);
+    vkCmdFillBuffer(cmdbuf, visibility->handle, 0, VK_WHOLE_SIZE, 0xFFFFFFFF);
+    const Queue empty = { .dispatch = { 0, 1, 1 }, .queued = 0 };
+    vkCmdUpdateBuffer(cmdbuf, queue->handle, 0, sizeof(empty), &empty);
+    // vkCmdUpdateBuffer() takes at most 64 KiB at once
+    constexpr size_t update_draws = 65536 / sizeof(SplatDraw);
+    for (size_t first = 0; first < draws.size(); first += update_draws) {
+        const size_t count = std::min(draws.size() - first, update_draws);
+        vkCmdUpdateBuffer(cmdbuf, draws_buffer->handle, first * sizeof(SplatDraw), count * sizeof(SplatDraw), &draws[first]);
+    }
+    barrier(cmdbuf, VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT);
+
+    vkCmdBindPipeline(cmdbuf, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline->pipeline());
+    constexpr VkPipelineStageFlags2 queued_stages = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT;
+    constexpr VkAccessFlags2 queued_access = VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT | VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT;
+    const Pass passes[2] = { atomic64 ? PassDepthId : PassDepth, PassId };
+    for (int pass = 0; pass < (atomic64 ? 1 : 2); pass++) {
+        dispatch(cmdbuf, ModeSplat, passes[pass]);
+        barrier(cmdbuf, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, queued_stages, queued_access);
+        dispatch(cmdbuf, ModeSplatQueued, passes[pass]);
+        barrier(cmdbuf, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+                VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT);
+    }
+    draws.clear();
+}
+
+void VoxelSplatter::resolve(VkCommandBuffer cmdbuf, const View& view) {
+    resolve_constants.inverse_matrix = view.inverse_matrix;
+    resolve_constants.camera_position = view.camera_position;
+    resolve_constants.time = view.time;
+    resolve_constants.screen_size = view.screen_size;
+    resolve_constants.greedy = view.greedy;
+    resolve_constants.textures = view.textures;
+    resolve_constants.block_table = view.block_table;
+
+    resolve_textures->commit_frame(cmdbuf);
+    auto& resolve_pipeline = resolve_shaders->pipeline;
+    vkCmdBindPipeline(cmdbuf, VK_PIPELINE_BIND_POINT_GRAPHICS, resolve_pipeline->pipeline());
+    vkCmdPushConstants(cmdbuf, resolve_pipeline->layout(), VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(resolve_constants), &resolve_constants);
+    vkCmdDraw(cmdbuf, 3, 1, 0, 0);
+}
@@ -0,0 +1,147 @@
+#ifndef SIGCRAFT_VOXEL_SPLAT_H
+#define SIGCRAFT_VOXEL_SPLAT_H
+
+#include "voxel.h"
+#include "shaders.h"
+#include "texture.hpp"
+
+#include <memory>
+#include <vector>
+
+/// how many SplatDraws a frame can have, splat.glsl's ids have 15 bits for them
+constexpr size_t MAX_SPLAT_DRAWS = 1 << 15;
+/// how many voxels a SplatDraw can have, the other 17 bits of the ids; more get split into several draws
+constexpr size_t MAX_SPLAT_DRAW_VOXELS = 1 << 17;
+/// how many voxels too big for a single invocation get a workgroup each, the most a dispatch can have
+constexpr uint32_t SPLAT_QUEUE_CAPACITY = 65535;
+
+/**
+ * Draws the voxels of GameVoxels without rasterizing a quad for each: a compute pass (shaders/splat.comp) projects
+ * every voxel onto the screen and splats the distance along the ray of each pixel its box covers, with the id of the
+ * voxel, into a visibility buffer, keeping the nearest with atomics. A fullscreen pass (shaders/splat_resolve.frag)
+ * then shades every pixel once, with its voxel, instead of every voxel that covers it.
+ * With 64 bit atomics distance and id go into one atomicMin. Without, like on lavapipe, the distances are splatted
+ * first and the ids of the voxels at those distances in a second pass, which is twice the projection work.
+ */
+struct VoxelSplatter {
+    /// splat.glsl's SplatDraw: the voxels of a chunk or batch
+    struct SplatDraw {
+        VkDeviceAddress voxels;
+        /// a VkDrawIndirectCommand with the number of voxels as its instance count, read instead of voxel_count
+        /// if `counted` is set (see GpuMesher::voxels())
+        VkDeviceAddress indirect;
+        ivec2 chunk_position;
+        float spawn_time;
+        uint32_t voxel_count;
+        uint32_t counted;
+        uint32_t padding;
+    };
+
+    /// what the voxels are drawn with this frame, like GameVoxels' push constants
+    struct View {
+        mat4 matrix;
+        mat4 inverse_matrix;
+        vec3 camera_position;
+        float time;
+        vec2 screen_size;
+        bool greedy;
+        bool textures;
+        VkDeviceAddress block_table;
+    };
+
+    const bool atomic64;
+
+    /// `atomic64` needs a device created with require_atomic64(). The textures are the ones `texture_manager` loaded for GameVoxels.
+    VoxelSplatter(imr::Device& device, imr::Swapchain& swapchain, const TextureManager& texture_manager, const Sampler& sampler, bool atomic64);
+    VoxelSplatter(const VoxelSplatter&) = delete;
+
+    /// whether the GPU of `device` has the 64 bit buffer atomics of splat64.comp, shaderInt64 and shaderBufferInt64Atomics
+    static bool supports_atomic64(imr::Device& device);
+    /// makes the device created with `selector` enable them, see main()
+    static void require_atomic64(vkb::PhysicalDeviceSelector& selector);
+
+    /// queues `voxels` for this frame. Returns false once MAX_SPLAT_DRAWS draws are queued.
+    bool add(const ChunkVoxels& voxels, ivec2 chunk_position);
+    /// splats the voxels queued since the last call, outside of any rendering
+    void splat(imr::Swapchain::SimplifiedRenderContext& context, const View& view);
+    /// shades the pixels, within withRenderTargets() after splat()
+    void resolve(VkCommandBuffer cmdbuf, const View& view);
+    /// loads the shaders again (Ctrl+R)
+    void reload_shaders();
+
+private:
+    /// splat.comp's MODE_ constants
+    enum Mode : uint32_t {
+        ModeSplat,
+        ModeSplatQueued,
+    };
+    /// splat.comp's PASS_ constants
+    enum Pass : uint32_t {
+        PassDepthId,
+        PassDepth,
+        PassId,
+    };
+
+    /// splat.comp's Queue, followed by SPLAT_QUEUE_CAPACITY ids
+    struct Queue {
+        VkDispatchIndirectCommand dispatch;
+        uint32_t queued;
+    };
+
+    struct {
+        mat4 matrix;
+        mat4 inverse_matrix;
+        vec3 camera_position;
+        float time;
+        vec2 screen_size;
+        uint32_t greedy;
+        uint32_t pass;
+        VkDeviceAddress visibility;
+        VkDeviceAddress draws;
+        VkDeviceAddress queue;
+        uint32_t queue_capacity;
+        uint32_t mode;
+        uint32_t draw;
+    } splat_constants;
+    static constexpr uint32_t PER_DISPATCH_SPLAT_CONSTANTS = offsetof(decltype(splat_constants), draw);
+
+    struct {
+        mat4 inverse_matrix;
+        vec3 camera_position;
+        float time;
+        vec2 screen_size;
+        uint32_t greedy;
+        uint32_t textures;
+        VkDeviceAddress visibility;
+        VkDeviceAddress draws;
+        VkDeviceAddress block_table;
+    } resolve_constants;
+
+    imr::Device& device;
+    imr::Swapchain& swapchain;
+    const TextureManager& texture_manager;
+    const Sampler& sampler;
+
+    std::unique_ptr<imr::ShaderModule> module;
+    std::unique_ptr<imr::ShaderEntryPoint> entry_point;
+    std::unique_ptr<imr::ComputePipeline> pipeline;
+    /// raymarch.vert's fullscreen triangle with splat_resolve.frag
+    std::unique_ptr<VoxelShaders> resolve_shaders;
+    /// binds the block textures to resolve_shaders
+    std::unique_ptr<imr::DescriptorBindHelper> resolve_textures;
+
+    /// two words per pixel, recreated when the size of the image changes
+    std::unique_ptr<imr::Buffer> visibility;
+    VkExtent2D visibility_size = {};
+    /// the SplatDraws of a frame, written with the frame's commands so frames in flight don't share them
+    std::unique_ptr<imr::Buffer> draws_buffer;
+    std::unique_ptr<imr::Buffer> queue;
+    std::vector<SplatDraw> draws;
+
+    void load_shaders();
+    void dispatch(VkCommandBuffer cmdbuf, Mode mode, Pass pass);
+    /// makes the writes of the commands so far visible to those after it
+    void barrier(VkCommandBuffer cmdbuf, VkPipelineStageFlags2 src_stages, VkPipelineStageFlags2 dst_stages, VkAccessFlags2 dst_access);
+};
+
+#endif
@@ -1,11 +1,15 @@
 #include "world.h"
 
-World::World(const char* filename) {
+#include <algorithm>
+#include <iostream>
+
+World::World(const char* filename, size_t cache_budget) : cache_budget(cache_budget), mesh_cache(MeshCache::user_directory(filename)) {
     allocator = enkl_get_malloc_free_allocator();
     enkl_world = cunk_open_mcworld(filename, &allocator);
 }
 
 World::~World() {
+    lru.clear();
     regions.clear();
     cunk_close_mcworld(enkl_world);
 }
@@ -67,12 +71,65 @@ Chunk* World::load_chunk(int cx, int cz) {
 }
 
 void World::unload_chunk(Chunk* chunk) {
+    if (chunk->retained)
+        remove_from_cache(chunk);
     Region* region = &chunk->region;
     region->unload_chunk(chunk);
     if (region->chunks.size() == 0)
         unload_region(region);
 }
 
+void World::retain_chunk(Chunk* chunk) {
+    assert(!chunk->retained);
+    chunk->retained = true;
+    chunk->retained_bytes = chunk->memory_footprint();
+    lru.push_front(chunk);
+    chunk->lru_position = lru.begin();
+    lru_bytes += chunk->retained_bytes;
+    cache_stats.retained++;
+}
+
+void World::reuse_chunk(Chunk* chunk) {
+    remove_from_cache(chunk);
+    cache_stats.reused++;
+    if (chunk->gpu_bytes(RepresentationAll) > 0)
+        cache_stats.reused_gpu++;
+}
+
+void World::shrink_retained_chunk(Chunk* chunk, size_t bytes) {
+    if (!chunk->retained)
+        return;
+    bytes = std::min(bytes, chunk->retained_bytes);
+    chunk->retained_bytes -= bytes;
+    lru_bytes -= bytes;
+}
+
+void World::remove_from_cache(Chunk* chunk) {
+    assert(chunk->retained);
+    lru.erase(chunk->lru_position);
+    lru_bytes -= chunk->retained_bytes;
+    chunk->retained = false;
+    chunk->retained_bytes = 0;
+}
+
+void World::evict_cached_chunks(const std::function<void(Chunk*)>& release) {
+    while (lru_bytes > cache_budget && !lru.empty()) {
+        Chunk* oldest = lru.back();
+        release(oldest);
+        unload_chunk(oldest);
+        cache_stats.evicted++;
+    }
+}
+
+void World::print_cache_stats() const {
+    const ChunkCacheStats& s = cache_stats;
+    std::cout << "Chunk cache: " << lru.size() << " chunks (" << lru_bytes / (1024 * 1024) << " MiB) held, "
+              << s.decoded << " decoded, " << s.retained << " retained, "
+              << s.reused << " reused (" << s.reused_gpu << " with GPU data), "
+              << s.evicted << " evicted" << std::endl;
+    mesh_cache.print_stats();
+}
+
 void World::unload_region(Region* region) {
     assert(region->loaded);
     assert(!region->unloaded);
@@ -129,8 +186,39 @@ Chunk::Chunk(Region& r, int cx, int cz) : region(r), cx(cx), cz(cz) {
         enkl_chunk = cunk_open_mcchunk(r.enkl_region, rcx, rcz);
         if (enkl_chunk) {
             load_from_mcchunk(&data, enkl_chunk);
+            r.world.cache_stats.decoded++;
         }
     }
+    content_hash = hash_chunk(data);
+}
+
+size_t Chunk::memory_footprint() const {
+    size_t bytes = sizeof(Chunk);
+    for (auto section : data.sections) {
+        if (section)
+            bytes += sizeof(ChunkSection);
+    }
+    // the host copy of the boxes kept for batching
+    if (greedy_voxels)
+        bytes += greedy_voxels->boxes.size() * sizeof(GreedyVoxel);
+    return bytes + gpu_bytes(RepresentationAll);
+}
+
+size_t Chunk::gpu_bytes(uint8_t representations) const {
+    size_t bytes = 0;
+    for (auto& mesh : meshes) {
+        if (mesh && (representations & RepresentationMesh))
+            bytes += mesh->buffer_size;
+    }
+    if (voxels && (representations & RepresentationVoxels))
+        bytes += voxels->buffer_size;
+    if (greedy_voxels && (representations & RepresentationGreedyVoxels))
+        bytes += greedy_voxels->buffer_size;
+    for (auto& lod : lod_voxels) {
+        if (lod && (representations & RepresentationVoxelLods))
+            bytes += lod->buffer_size;
+    }
+    return bytes;
 }
 
 Chunk::~Chunk() {
@@ -9,8 +9,12 @@ extern "C" {
 }
 
 #include "chunk_mesh.h"
+#include "mesh_cache.h"
 #include "voxel.h"
 
+#include <functional>
+#include <list>
+
 struct Int2 {
     int32_t x, z;
     bool operator==(const Int2 &other) const {
@@ -31,17 +35,63 @@ struct std::hash<Int2> {
 struct World;
 struct Region;
 
+/// GPU representations a chunk can hold side by side, one per render mode
+enum ChunkRepresentation : uint8_t {
+    RepresentationMesh = 1 << 0,
+    RepresentationVoxels = 1 << 1,
+    RepresentationGreedyVoxels = 1 << 2,
+    /// the coarser levels of detail of the voxels, which both voxel modes draw
+    RepresentationVoxelLods = 1 << 3,
+    RepresentationAll = RepresentationMesh | RepresentationVoxels | RepresentationGreedyVoxels | RepresentationVoxelLods,
+};
+
 struct Chunk {
     Region& region;
     int cx, cz;
     McChunk* enkl_chunk = nullptr;
     ChunkData data = {};
+    /// hash_chunk() of `data`, what the mesh cache keys of this chunk are derived from
+    uint64_t content_hash = 0;
     std::unique_ptr<ChunkVoxels> voxels;
-    std::unique_ptr<ChunkMesh> mesh;
+    std::unique_ptr<ChunkVoxels> greedy_voxels;
+    /// lod_chunk_voxels() indexed by level of detail minus one, usually only the one the chunk was last drawn at is built
+    std::unique_ptr<ChunkVoxels> lod_voxels[VOXEL_LOD_COUNT - 1];
+    /// indexed by level of detail, usually only the one the chunk was last drawn at is built
+    std::unique_ptr<ChunkMesh> meshes[MESH_LOD_COUNT];
+
+    /// set while the chunk sits in the world's cache: still decoded (and possibly meshed), but not drawn
+    bool retained = false;
+    std::list<Chunk*>::iterator lru_position;
+    size_t retained_bytes = 0;
 
     Chunk(Region&, int x, int z);
     Chunk(const Chunk&) = delete;
     ~Chunk();
+
+    std::unique_ptr<ChunkVoxels>& voxels_for(bool greedy, int lod = 0) {
+        if (lod > 0)
+            return lod_voxels[lod - 1];
+        return greedy ? greedy_voxels : voxels;
+    }
+
+    /// bytes held by this chunk, including GPU buffers of its mesh and voxels
+    size_t memory_footprint() const;
+    /// bytes of GPU buffers held for the given ChunkRepresentation bits
+    size_t gpu_bytes(uint8_t representations) const;
+};
+
+/// Counters for the retained-chunk cache, so we can see how much work the unload hysteresis saves.
+struct ChunkCacheStats {
+    /// chunks decoded from the region files
+    size_t decoded = 0;
+    /// chunks that left the unload radius and went into the cache instead of being destroyed
+    size_t retained = 0;
+    /// cache hits: chunks that came back into range without being decoded again
+    size_t reused = 0;
+    /// cache hits that also still had their mesh or voxels, so nothing had to be rebuilt
+    size_t reused_gpu = 0;
+    /// chunks destroyed to keep the cache within its budget
+    size_t evicted = 0;
 };
 
 struct Region {
@@ -68,7 +118,13 @@ struct World {
     McWorld* enkl_world;
     std::unordered_map<Int2, std::unique_ptr<Region>> regions;
 
-    explicit World(const char*);
+    /// how many bytes retained chunks may occupy before the least recently used ones are destroyed
+    size_t cache_budget;
+    ChunkCacheStats cache_stats;
+    /// meshes and voxels of chunks from this and earlier sessions, kept in the user's cache directory
+    MeshCache mesh_cache;
+
+    explicit World(const char*, size_t cache_budget = 512 * 1024 * 1024);
     World(const World&) = delete;
     ~World();
 
@@ -76,7 +132,23 @@ struct World {
     void unload_chunk(Chunk*);
     Chunk* get_loaded_chunk(int x, int z);
     std::vector<Chunk*> loaded_chunks();
+
+    /// moves a chunk out of the drawn set and into the LRU cache
+    void retain_chunk(Chunk*);
+    /// takes a chunk out of the cache because it is back within range
+    void reuse_chunk(Chunk*);
+    /// takes `bytes` of GPU buffers that were freed from a chunk off what the cache counts, if the chunk is retained
+    void shrink_retained_chunk(Chunk*, size_t bytes);
+    /// destroys least recently used chunks until the cache fits its budget again.
+    /// `release` is called on every chunk before it is destroyed, so callers can defer freeing GPU resources.
+    void evict_cached_chunks(const std::function<void(Chunk*)>& release);
+    void print_cache_stats() const;
 private:
+    /// retained chunks, most recently retained first
+    std::list<Chunk*> lru;
+    size_t lru_bytes = 0;
+
+    void remove_from_cache(Chunk*);
     Region* get_loaded_region(int rx, int rz);
     Region* load_region(int rx, int rz);
     void unload_region(Region*);